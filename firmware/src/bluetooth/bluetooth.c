@@ -12,17 +12,25 @@
  ******************************************************************************/
 
 /* C Standard Library includes */
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 /* Zephyr Projet includes */
 #include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/bluetooth/hci_driver.h>
 #include <bluetooth/services/nus.h>
 #include <zephyr/settings/settings.h>
 
 /* Application includes */
+#include "stats/stats.h"
+#include "energy/energy.h"
+#include "ring.h"
 #include "bluetooth.h"
 
 /* Generating includes */
@@ -41,10 +49,67 @@ LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 #define DEVICE_NAME CONFIG_BT_DEVICE_NAME
 #define DEVICE_NAME_LEN	(sizeof(DEVICE_NAME) - 1)
 
+/* Heart Rate Measurement characteristic flags */
+#define HRS_FLAG_CONTACT_DETECTED   BIT(1)
+#define HRS_FLAG_CONTACT_SUPPORTED  BIT(2)
+#define HRS_FLAG_RR_PRESENT         BIT(4)
+#define HRS_BODY_SENSOR_LOCATION    0x01    /**< Chest */
+#define HRS_MAX_RR_COUNT            4       /**< Keep measurement within a default 23 bytes MTU */
+
+/* ECG service, whole protobuf messages in each notification */
+#define BT_UUID_ECG_VAL             BT_UUID_128_ENCODE(0x8e3a0001, 0x52c4, 0x4f0d, 0xa6b7, 0x1d9e5c2f3b60)
+#define BT_UUID_ECG_DATA_VAL        BT_UUID_128_ENCODE(0x8e3a0002, 0x52c4, 0x4f0d, 0xa6b7, 0x1d9e5c2f3b60)
+#define BT_UUID_ECG_CONTROL_VAL     BT_UUID_128_ENCODE(0x8e3a0003, 0x52c4, 0x4f0d, 0xa6b7, 0x1d9e5c2f3b60)
+#define BT_UUID_ECG_ENERGY_VAL      BT_UUID_128_ENCODE(0x8e3a0004, 0x52c4, 0x4f0d, 0xa6b7, 0x1d9e5c2f3b60)
+#define BT_UUID_ECG                 BT_UUID_DECLARE_128(BT_UUID_ECG_VAL)
+#define BT_UUID_ECG_DATA            BT_UUID_DECLARE_128(BT_UUID_ECG_DATA_VAL)
+#define BT_UUID_ECG_CONTROL         BT_UUID_DECLARE_128(BT_UUID_ECG_CONTROL_VAL)
+#define BT_UUID_ECG_ENERGY          BT_UUID_DECLARE_128(BT_UUID_ECG_ENERGY_VAL)
+#define ECG_ATT_HEADER              3       /**< Notification opcode and handle */
+#define ECG_MAX_PAYLOAD             (CONFIG_BT_L2CAP_TX_MTU - ECG_ATT_HEADER)
+#define ECG_CONTINUATION            0x00    /**< Zero length prefix, notification continues a split message */
+#define ECG_MAX_MESSAGE             0x3FFF  /**< Longest message, two bytes length prefix */
+#define ECG_ENERGY_MAX_SIZE         64      /**< Largest Energy message */
+
+/* Notification air time estimate */
+#define L2CAP_HEADER                4       /**< Length and channel of each notification */
+#define LL_PACKET_OVERHEAD          10      /**< Preamble, access address, header and CRC of each packet */
+
+#define BLE_MAX_LINKS               CONFIG_BT_MAX_CONN
+#define NUS_RING_SIZE               CONFIG_APP_NUS_RING_SIZE /**< Transfers waiting for every subscriber, stored once */
+#define NUS_ALL_LINKS               BIT_MASK(BLE_MAX_LINKS)
+
+BUILD_ASSERT(BLE_MAX_LINKS <= RING_MAX_READERS, "Links of a transfer are a byte mask");
+
+/* Connection interval requested during bulk transfers (1.25 ms units) */
+#define BULK_MIN_INT                6       /**< 7.5 ms */
+#define BULK_MAX_INT                12      /**< 15 ms */
+#define BULK_TIMEOUT                400     /**< 4 s supervision timeout */
+#define BULK_RETRY_MS               1       /**< Wait for notification buffers to be released */
+
+/* Low power link profile: 100 to 200 ms, 4 skipped events, 6 s supervision timeout */
+#define LOW_POWER_MIN_INT           80
+#define LOW_POWER_MAX_INT           160
+#define LOW_POWER_LATENCY           4
+#define LOW_POWER_TIMEOUT           600
+
 /*******************************************************************************
  * PRIVATE TYPEDEFS
  ******************************************************************************/
 
+/* Connected central, reading the transfers ring at its own pace */
+typedef struct
+{
+    struct bt_conn * conn;
+    bool     busy;          /**< Notification in flight */
+    ble_link_profile_t profile;
+    uint8_t  phy;           /**< TX PHY (BT_GAP_LE_PHY_*) */
+    uint16_t data_length;   /**< Link layer TX payload */
+    uint32_t frame_end;     /**< End of frame being split across ECG service notifications */
+    uint16_t piece_left;    /**< Bytes of that message still to send, 0 between messages */
+    uint8_t  packet[ECG_MAX_PAYLOAD];       /**< ECG service notification */
+} ble_link_t;
+
 /*******************************************************************************
  * STATIC VARIABLES
  ******************************************************************************/
@@ -52,6 +117,7 @@ LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 static struct bt_data _ad[] = {
 	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
 	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
+	BT_DATA_BYTES(BT_DATA_UUID16_ALL, BT_UUID_16_ENCODE(BT_UUID_HRS_VAL)),
 };
 
 static char device_name[DEVICE_NAME_LEN+10] = {0};
@@ -60,15 +126,45 @@ static const struct bt_data _sd[] = {
 	BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_NUS_VAL),
 };
 
-static struct bt_conn *_conn = NULL;
-static enum bt_nus_send_status _nus_send_status = BT_NUS_SEND_STATUS_DISABLED;
+static ble_link_t _links[BLE_MAX_LINKS];
+static const struct bt_gatt_attr * _nus_tx_attr;
 
 static BLE_ReceiveCallback_t _receive_callback = NULL;
 static BLE_EventCallback_t _event_callback = NULL;
+static BLE_LinkCallback_t _link_callback = NULL;
+
+/* Each transfer is copied once, then sent to every subscriber from its own
+ * position, so that a slow central only loses its own oldest transfers when
+ * the ring is full. Each link reads the ring with the reader of same index */
+static uint8_t _ring_buffer[NUS_RING_SIZE];
+static ring_reader_t _readers[BLE_MAX_LINKS];
+static ring_t _ring;
+static struct k_spinlock _tx_lock;
+static const uint8_t _delimiter = 0;
+
+/* One transfer copied at a time, ring space is reserved under TX lock and
+ * filled after it, transfers are then published in order */
+static K_MUTEX_DEFINE(_send_mutex);
+
+/* Link owned by a bulk transfer, live transfers skip it meanwhile */
+static ble_link_t * _bulk_link;
+
+/* Connection parameters of each link profile, low latency is the bulk transfer one */
+static const struct bt_le_conn_param _profiles[NUM_OF_BLE_LINK_PROFILES] = {
+    [BLE_LINK_BALANCED]    = BT_LE_CONN_PARAM_INIT(CONFIG_BT_PERIPHERAL_PREF_MIN_INT, CONFIG_BT_PERIPHERAL_PREF_MAX_INT,
+                                                   CONFIG_BT_PERIPHERAL_PREF_LATENCY, CONFIG_BT_PERIPHERAL_PREF_TIMEOUT),
+    [BLE_LINK_LOW_POWER]   = BT_LE_CONN_PARAM_INIT(LOW_POWER_MIN_INT, LOW_POWER_MAX_INT,
+                                                   LOW_POWER_LATENCY, LOW_POWER_TIMEOUT),
+    [BLE_LINK_LOW_LATENCY] = BT_LE_CONN_PARAM_INIT(BULK_MIN_INT, BULK_MAX_INT, 0, BULK_TIMEOUT),
+};
 
-static uint8_t * _tx_buffer;
-static uint32_t _bytes_to_send;
-static uint32_t mtu_size;
+static bool _hrs_notify_enabled = false;
+
+/* Last Energy message, read by centrals from the ECG service */
+static uint8_t _energy[ECG_ENERGY_MAX_SIZE];
+static uint16_t _energy_length;
+static struct k_spinlock _energy_lock;
+static const uint8_t _hrs_body_sensor_location = HRS_BODY_SENSOR_LOCATION;
 
 
 /*******************************************************************************
@@ -90,7 +186,27 @@ static void nus_receive_callback(struct bt_conn *conn,
                                   const uint8_t *const data, uint16_t len);
 static void nus_sent_callback(struct bt_conn *conn);
 static void nus_send_enabled_callback(enum bt_nus_send_status status);
-static void nus_send_next_packet(void);
+static void nus_send_next_packet(ble_link_t * p_link);
+static void ecg_send_next_packet(ble_link_t * p_link);
+static void ecg_sent_callback(struct bt_conn *conn, void *user_data);
+
+static ble_link_t * link_get(const struct bt_conn * conn);
+static bool link_subscribed(const ble_link_t * p_link);
+static bool link_nus_subscribed(const ble_link_t * p_link);
+static bool link_ecg_subscribed(const ble_link_t * p_link);
+static ring_reader_t * link_reader(const ble_link_t * p_link);
+static int  ring_send(uint8_t links, const uint8_t * p_data, uint16_t length);
+static void adv_work_handler(struct k_work * work);
+
+static void hrs_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value);
+static ssize_t hrs_read_body_sensor_location(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                                             void *buf, uint16_t len, uint16_t offset);
+static void ecg_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value);
+static ssize_t ecg_write_control(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                                 const void *buf, uint16_t len, uint16_t offset, uint8_t flags);
+static ssize_t ecg_read_energy(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                               void *buf, uint16_t len, uint16_t offset);
+static void link_count_airtime(const ble_link_t * p_link, uint32_t length);
 
 /* This should be declared upper but needs static function prototypes */
 static struct bt_conn_cb _conn_cb = {
@@ -102,12 +218,42 @@ static struct bt_conn_cb _conn_cb = {
 	    .le_data_len_updated = le_data_length_updated
 };
 
+static K_WORK_DEFINE(_adv_work, adv_work_handler);
+
 static struct bt_nus_cb _nus_cb = {
 	.received     = nus_receive_callback,
     .sent         = nus_sent_callback,
     .send_enabled = nus_send_enabled_callback,
 };
 
+/* Standard Heart Rate Service, implemented here as Zephyr one does not support RR intervals */
+BT_GATT_SERVICE_DEFINE(hrs_svc,
+	BT_GATT_PRIMARY_SERVICE(BT_UUID_HRS),
+	BT_GATT_CHARACTERISTIC(BT_UUID_HRS_MEASUREMENT, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(hrs_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(BT_UUID_HRS_BODY_SENSOR, BT_GATT_CHRC_READ,
+			       BT_GATT_PERM_READ, hrs_read_body_sensor_location, NULL, NULL),
+);
+
+/* ECG service, the same stream as NUS without COBS: each data notification is
+ * one or more whole protobuf messages, each one preceded by its length as a
+ * varint (protobuf delimited format), so that centrals decode it as received.
+ * Control characteristic takes one bare Command or Timestamp message per write.
+ * Energy characteristic holds the last bare Energy message (empty until the
+ * fuel gauge was read twice), as Battery Service has no room for it.
+ * A central subscribed to both services only receives the stream from this one. */
+BT_GATT_SERVICE_DEFINE(ecg_svc,
+	BT_GATT_PRIMARY_SERVICE(BT_UUID_ECG),
+	BT_GATT_CHARACTERISTIC(BT_UUID_ECG_DATA, BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(ecg_ccc_cfg_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(BT_UUID_ECG_CONTROL, BT_GATT_CHRC_WRITE | BT_GATT_CHRC_WRITE_WITHOUT_RESP,
+			       BT_GATT_PERM_WRITE, NULL, ecg_write_control, NULL),
+	BT_GATT_CHARACTERISTIC(BT_UUID_ECG_ENERGY, BT_GATT_CHRC_READ,
+			       BT_GATT_PERM_READ, ecg_read_energy, NULL, NULL),
+);
+
 /*******************************************************************************
  * GLOBAL FUNCTIONS
  ******************************************************************************/
@@ -116,6 +262,7 @@ int BLE_Init(void)
 {
 	int err = 0;
 
+    RING_Init(&_ring, _ring_buffer, sizeof(_ring_buffer), _readers, BLE_MAX_LINKS);
     bt_conn_cb_register(&_conn_cb);
 
 	err = bt_enable(NULL);
@@ -141,6 +288,8 @@ int BLE_Init(void)
 	if (err) {
 		LOG_ERR("Failed to initialize UART service (err: %d)", err);
 	}
+    /* NUS reports subscription changes of all centrals at once, each one is checked on its own */
+    _nus_tx_attr = bt_gatt_find_by_uuid(NULL, 0, BT_UUID_NUS_TX);
 
     /* Automatically add 2 MSB of MAC address to the name */
     /*bt_addr_le_t addrs[CONFIG_BT_ID_MAX] = {0};
@@ -168,7 +317,7 @@ void BLE_StartAdvertising(void)
 
 	err = bt_le_adv_start(BT_LE_ADV_CONN, _ad, ARRAY_SIZE(_ad), _sd, ARRAY_SIZE(_sd));
 
-	if (err) {
+	if (err && err != -EALREADY) {
 		LOG_ERR("Advertising failed to start (err %d)", err);
 	}
 }
@@ -187,13 +336,31 @@ void BLE_StopAdvertising(void)
 
 bool BLE_IsConnected(void)
 {
-    return !(_conn == NULL);
+    for (uint8_t i = 0; i < BLE_MAX_LINKS; i++)
+    {
+        if (_links[i].conn != NULL) {
+            return true;
+        }
+    }
+    return false;
 }
 
 
 bool BLE_IsSendEnabled(void)
 {
-    return (_nus_send_status == BT_NUS_SEND_STATUS_ENABLED);
+    for (uint8_t i = 0; i < BLE_MAX_LINKS; i++)
+    {
+        if (link_subscribed(&_links[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool BLE_IsLinkSendEnabled(uint8_t link)
+{
+    return (link < BLE_MAX_LINKS) && link_subscribed(&_links[link]);
 }
 
 
@@ -201,36 +368,242 @@ void BLE_Disconnect(void)
 {
     int err = 0;
 
-    if (_conn == NULL) {
+    if (!BLE_IsConnected()) {
         LOG_ERR("%s", "Failed to disconnect a non-existing connection");
         return;
     }
 
-    err = bt_conn_disconnect(_conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+    for (uint8_t i = 0; i < BLE_MAX_LINKS; i++)
+    {
+        if (_links[i].conn == NULL) {
+            continue;
+        }
+        err = bt_conn_disconnect(_links[i].conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+        if (err) {
+            LOG_ERR("Failed to disconnect (err %d)", err);
+        }
+    }
+}
+
+
+int BLE_Send(uint8_t * p_data, uint16_t length)
+{
+    return ring_send(NUS_ALL_LINKS, p_data, length);
+}
+
+
+int BLE_SendTo(uint8_t link, const uint8_t * p_data, uint16_t length)
+{
+    if (link >= BLE_MAX_LINKS) {
+        return -EINVAL;
+    }
+    return ring_send(BIT(link), p_data, length);
+}
+
+
+bool BLE_IsSendBusy(void)
+{
+    bool busy = (_bulk_link != NULL);
+
+    /* Busy until one subscriber has sent all previous transfers */
+    for (uint8_t i = 0; i < BLE_MAX_LINKS; i++)
+    {
+        if (!link_subscribed(&_links[i]) || &_links[i] == _bulk_link) {
+            continue;
+        }
+        if (RING_IsEmpty(&_ring, &_readers[i])) {
+            return false;
+        }
+        busy = true;
+    }
+    return busy;
+}
+
+
+int BLE_BulkBegin(uint8_t link)
+{
+    int err = 0;
+
+    if (link >= BLE_MAX_LINKS || _links[link].conn == NULL) {
+        return -ENOTCONN;
+    }
+    /* Segments are a byte stream, sent over NUS only */
+    if (!link_nus_subscribed(&_links[link])) {
+        return -EACCES;
+    }
+
+    ble_link_t * p_link = &_links[link];
+    k_spinlock_key_t key = k_spin_lock(&_tx_lock);
+    if ((_bulk_link != NULL && _bulk_link != p_link) || !RING_IsEmpty(&_ring, link_reader(p_link)))
+    {
+        k_spin_unlock(&_tx_lock, key);
+        return -EBUSY;
+    }
+    _bulk_link = p_link;
+    k_spin_unlock(&_tx_lock, key);
+
+    /* Fastest link the central accepts, transfer goes on with current settings otherwise */
+    err = bt_conn_le_phy_update(p_link->conn, BT_CONN_LE_PHY_PARAM_2M);
     if (err) {
-        LOG_ERR("Failed to disconnect (err %d)", err);
+        LOG_WRN("Failed to request 2M PHY (err %d)", err);
     }
-    
+    err = bt_conn_le_data_len_update(p_link->conn, BT_LE_DATA_LEN_PARAM_MAX);
+    if (err) {
+        LOG_WRN("Failed to request data length (err %d)", err);
+    }
+    err = bt_conn_le_param_update(p_link->conn, &_profiles[BLE_LINK_LOW_LATENCY]);
+    if (err) {
+        LOG_WRN("Failed to request connection interval (err %d)", err);
+    }
+    return 0;
 }
 
 
-void BLE_Send(uint8_t * p_data, uint16_t length)
+int BLE_SendBulk(const uint8_t * p_data, uint32_t length)
 {
-    if (_conn == NULL) {
-        LOG_ERR("%s", "No connection to send NUS data");
-        return;
+    int err = 0;
+
+    while (length > 0)
+    {
+        ble_link_t * p_link = _bulk_link;
+        if (p_link == NULL || p_link->conn == NULL) {
+            return -ENOTCONN;
+        }
+
+        uint16_t chunk = MIN(length, bt_nus_get_mtu(p_link->conn));
+        if (chunk == 0) {
+            return -EINVAL;
+        }
+
+        /* Notifications are queued without waiting for each other, so that
+         * the controller sends as many as fit in each connection event */
+        err = bt_nus_send(p_link->conn, p_data, chunk);
+        if (err == -ENOMEM) {
+            k_msleep(BULK_RETRY_MS);
+            continue;
+        }
+        if (err) {
+            LOG_ERR("Failed to send bulk data (err %d)", err);
+            STATS_Add(STATS_TX_ERRORS, 1);
+            return err;
+        }
+        link_count_airtime(p_link, chunk);
+        p_data += chunk;
+        length -= chunk;
     }
+    return 0;
+}
 
-    if (_nus_send_status == BT_NUS_SEND_STATUS_DISABLED) {
-        LOG_ERR("%s", "NUS notifications not enabled");
+
+void BLE_BulkEnd(void)
+{
+    ble_link_t * p_link = _bulk_link;
+
+    _bulk_link = NULL;
+
+    /* Back to the connection interval of the central profile */
+    if (p_link != NULL && p_link->conn != NULL)
+    {
+        int err = bt_conn_le_param_update(p_link->conn, &_profiles[p_link->profile]);
+        if (err) {
+            LOG_WRN("Failed to restore connection interval (err %d)", err);
+        }
+    }
+}
+
+
+int BLE_GetLinkInfo(uint8_t link, ble_link_info_t * p_info)
+{
+    struct bt_conn_info info = {0};
+
+    if (link >= BLE_MAX_LINKS || _links[link].conn == NULL) {
+        return -ENOTCONN;
+    }
+
+    int err = bt_conn_get_info(_links[link].conn, &info);
+    if (err) {
+        return err;
+    }
+    p_info->phy = info.le.phy->tx_phy;
+    p_info->interval_us = info.le.interval * 1250;
+    p_info->data_length = info.le.data_len->tx_max_len;
+    p_info->mtu = bt_nus_get_mtu(_links[link].conn);
+    return 0;
+}
+
+
+int BLE_SetLinkProfile(uint8_t link, ble_link_profile_t profile)
+{
+    if (link >= BLE_MAX_LINKS || _links[link].conn == NULL) {
+        return -ENOTCONN;
+    }
+    if (profile >= NUM_OF_BLE_LINK_PROFILES) {
+        return -EINVAL;
+    }
+
+    /* Applied after a bulk transfer on this link, which needs its own parameters */
+    _links[link].profile = profile;
+    if (_bulk_link == &_links[link]) {
+        return 0;
+    }
+
+    int err = bt_conn_le_param_update(_links[link].conn, &_profiles[profile]);
+    if (err) {
+        LOG_ERR("Failed to request connection parameters (err %d)", err);
+    }
+    return err;
+}
+
+
+struct bt_conn * BLE_GetConnection(uint8_t link)
+{
+    return (link < BLE_MAX_LINKS) ? _links[link].conn : NULL;
+}
+
+
+bool BLE_IsHeartRateEnabled(void)
+{
+    return _hrs_notify_enabled;
+}
+
+
+void BLE_SendHeartRate(uint16_t bpm, const uint16_t * p_rr, uint8_t rr_count, bool contact)
+{
+    int err = 0;
+    uint8_t hrm[2 + 2 * HRS_MAX_RR_COUNT];
+    uint8_t length = 0;
+
+    if (!_hrs_notify_enabled) {
         return;
     }
 
-    _tx_buffer     = p_data;
-    _bytes_to_send = length;
-    mtu_size = bt_nus_get_mtu(_conn);
-    LOG_DBG("MTU %u", mtu_size);
-    nus_send_next_packet();
+    /* Heart rate value is sent on 8 bits, RR intervals are 1/1024 s units */
+    hrm[length++] = HRS_FLAG_CONTACT_SUPPORTED | (contact ? HRS_FLAG_CONTACT_DETECTED : 0)
+                  | ((rr_count > 0) ? HRS_FLAG_RR_PRESENT : 0);
+    hrm[length++] = (bpm > UINT8_MAX) ? UINT8_MAX : bpm;
+    for (uint8_t i = 0; i < MIN(rr_count, HRS_MAX_RR_COUNT); i++) {
+        sys_put_le16(p_rr[i], &hrm[length]);
+        length += 2;
+    }
+
+    err = bt_gatt_notify(NULL, &hrs_svc.attrs[1], hrm, length);
+    if (err && err != -ENOTCONN) {
+        LOG_ERR("Failed to send heart rate (err %d)", err);
+    }
+}
+
+
+int BLE_SetEnergy(const uint8_t * p_data, uint16_t length)
+{
+    if (length > sizeof(_energy)) {
+        return -EMSGSIZE;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&_energy_lock);
+    memcpy(_energy, p_data, length);
+    _energy_length = length;
+    k_spin_unlock(&_energy_lock, key);
+    return 0;
 }
 
 
@@ -245,6 +618,11 @@ void BLE_SetEventCallback(BLE_EventCallback_t event_callback)
     _event_callback = event_callback;
 }
 
+void BLE_SetLinkCallback(BLE_LinkCallback_t link_callback)
+{
+    _link_callback = link_callback;
+}
+
 /*******************************************************************************
  * STATIC FUNCTIONS
  ******************************************************************************/
@@ -271,17 +649,42 @@ static void ble_connected(struct bt_conn *conn, uint8_t err)
 	}
 
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
-	_conn = bt_conn_ref(conn);
+    ble_link_t * p_link = link_get(NULL);
+    if (p_link == NULL) {
+        LOG_ERR("No room for connection from %s", addr);
+        return;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&_tx_lock);
+    memset(p_link, 0, sizeof(*p_link));
+    RING_Attach(&_ring, link_reader(p_link));
+    p_link->phy = BT_GAP_LE_PHY_1M;
+    p_link->data_length = BT_GAP_DATA_LEN_DEFAULT;
+	p_link->conn = bt_conn_ref(conn);
+    k_spin_unlock(&_tx_lock, key);
 
-	err = bt_conn_get_info(_conn, &info);
+	err = bt_conn_get_info(p_link->conn, &info);
 	if (err) {
 		LOG_ERR("Failed to get connection info %d", err);
 		return;
 	}
+    p_link->phy = info.le.phy->tx_phy;
+    p_link->data_length = info.le.data_len->tx_max_len;
 
-    mtu_size = bt_nus_get_mtu(_conn);
+    /* Keep advertising for another central, from a work item as the stack is busy here */
+    if (link_get(NULL) != NULL) {
+        k_work_submit(&_adv_work);
+    }
 
-    if (_event_callback != NULL) {
+    /* Events tell when the first central connects and when the last one leaves */
+    bool first = true;
+    for (uint8_t i = 0; i < BLE_MAX_LINKS; i++) {
+        first &= (&_links[i] == p_link) || (_links[i].conn == NULL);
+    }
+    if (_link_callback != NULL) {
+        _link_callback(p_link - _links, true);
+    }
+    if (first && _event_callback != NULL) {
         _event_callback(BLE_EVT_CONNECTED);
     }
 }
@@ -293,14 +696,22 @@ static void ble_disconnected(struct bt_conn *conn, uint8_t reason)
 
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 
-	if (_conn) {
-		bt_conn_unref(_conn);
-		_conn = NULL;
+    ble_link_t * p_link = link_get(conn);
+	if (p_link) {
+        k_spinlock_key_t key = k_spin_lock(&_tx_lock);
+        if (_bulk_link == p_link) {
+            _bulk_link = NULL;
+        }
+        p_link->conn = NULL;
+        RING_Detach(link_reader(p_link));
+        k_spin_unlock(&_tx_lock, key);
+		bt_conn_unref(conn);
+        if (_link_callback != NULL) {
+            _link_callback(p_link - _links, false);
+        }
 	}
 
-    _nus_send_status = BT_NUS_SEND_STATUS_DISABLED;
-
-    if (_event_callback != NULL) {
+    if (!BLE_IsConnected() && _event_callback != NULL) {
     _event_callback(BLE_EVT_DISCONNECTED);
     }
 }
@@ -326,6 +737,11 @@ static void le_phy_updated(struct bt_conn *conn,
 {
 	LOG_WRN("LE PHY updated: TX PHY %s, RX PHY %s",
 	       phy2str(param->tx_phy), phy2str(param->rx_phy));
+
+    ble_link_t * p_link = link_get(conn);
+    if (p_link != NULL) {
+        p_link->phy = param->tx_phy;
+    }
 }
 
 static void le_data_length_updated(struct bt_conn *conn,
@@ -334,7 +750,11 @@ static void le_data_length_updated(struct bt_conn *conn,
 	LOG_WRN("LE data len updated: TX (len: %d time: %d)"
 	       " RX (len: %d time: %d)", info->tx_max_len,
 	       info->tx_max_time, info->rx_max_len, info->rx_max_time);
-    mtu_size = bt_nus_get_mtu(conn);
+
+    ble_link_t * p_link = link_get(conn);
+    if (p_link != NULL) {
+        p_link->data_length = info->tx_max_len;
+    }
 }
 
 static void nus_receive_callback(struct bt_conn *conn, 
@@ -344,16 +764,29 @@ static void nus_receive_callback(struct bt_conn *conn,
 
 	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, ARRAY_SIZE(addr));
 
-    if (_receive_callback != NULL) {
-        _receive_callback(data, len);
+    ble_link_t * p_link = link_get(conn);
+    if (p_link != NULL && _receive_callback != NULL) {
+        _receive_callback(p_link - _links, data, len, true);
     }
 }
 
 static void nus_sent_callback(struct bt_conn *conn)
 {
-    if (_bytes_to_send != 0) {
-        nus_send_next_packet();
+    ble_link_t * p_link = link_get(conn);
+    if (p_link == NULL) {
+        return;
     }
+
+    /* Each central goes on at its own pace */
+    k_spinlock_key_t key = k_spin_lock(&_tx_lock);
+    p_link->busy = false;
+    k_spin_unlock(&_tx_lock, key);
+    nus_send_next_packet(p_link);
+}
+
+static void ecg_sent_callback(struct bt_conn *conn, void *user_data)
+{
+    nus_sent_callback(conn);
 }
 
 static void nus_send_enabled_callback(enum bt_nus_send_status status)
@@ -367,31 +800,371 @@ static void nus_send_enabled_callback(enum bt_nus_send_status status)
             _event_callback(BLE_EVT_NUS_DISABLED);
         }
     }
-    _nus_send_status = status;
 }
 
-static void nus_send_next_packet(void)
+static void hrs_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+    _hrs_notify_enabled = (value == BT_GATT_CCC_NOTIFY);
+    LOG_INF("HRS notifications %s", _hrs_notify_enabled ? "enabled" : "disabled");
+    if (_event_callback != NULL) {
+        _event_callback(_hrs_notify_enabled ? BLE_EVT_HRS_ENABLED : BLE_EVT_HRS_DISABLED);
+    }
+}
+
+static ssize_t hrs_read_body_sensor_location(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                                             void *buf, uint16_t len, uint16_t offset)
+{
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &_hrs_body_sensor_location,
+				 sizeof(_hrs_body_sensor_location));
+}
+
+/* Subscription to either stream is reported the same way */
+static void ecg_ccc_cfg_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+    LOG_INF("ECG notifications %s", (value == BT_GATT_CCC_NOTIFY) ? "enabled" : "disabled");
+    if (_event_callback != NULL) {
+        _event_callback((value == BT_GATT_CCC_NOTIFY) ? BLE_EVT_NUS_ENABLED : BLE_EVT_NUS_DISABLED);
+    }
+}
+
+static ssize_t ecg_write_control(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                                 const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    if (offset != 0) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+
+    ble_link_t * p_link = link_get(conn);
+    if (p_link != NULL && _receive_callback != NULL) {
+        _receive_callback(p_link - _links, buf, len, false);
+    }
+    return len;
+}
+
+static ssize_t ecg_read_energy(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                               void *buf, uint16_t len, uint16_t offset)
+{
+    uint8_t value[ECG_ENERGY_MAX_SIZE];
+
+    /* Copy, as a long read spans several requests */
+    k_spinlock_key_t key = k_spin_lock(&_energy_lock);
+    uint16_t length = _energy_length;
+    memcpy(value, _energy, length);
+    k_spin_unlock(&_energy_lock, key);
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, value, length);
+}
+
+/* Send next part of the transfers a central has not received yet, one notification at a time */
+static void nus_send_next_packet(ble_link_t * p_link)
 {
     int err = 0;
-  
-    mtu_size = bt_nus_get_mtu(_conn);
-    if (mtu_size == 0) {
+    const uint8_t * p_chunk;
+    uint32_t chunk;
+    ring_reader_t * p_reader = link_reader(p_link);
+
+    if (link_ecg_subscribed(p_link)) {
+        ecg_send_next_packet(p_link);
+        return;
+    }
+
+    struct bt_conn * conn = p_link->conn;
+    uint32_t mtu_size = (conn != NULL) ? bt_nus_get_mtu(conn) : 0;
+
+    k_spinlock_key_t key = k_spin_lock(&_tx_lock);
+    if (conn == NULL || p_link->conn != conn || p_link->busy || RING_IsEmpty(&_ring, p_reader))
+    {
+        k_spin_unlock(&_tx_lock, key);
+        return;
+    }
+    if (mtu_size == 0)
+    {
         LOG_ERR("%s", "Failed to send NUS data (mtu size is 0)");
-        _bytes_to_send = 0;
+        STATS_Add(STATS_TX_ERRORS, 1);
+        RING_Skip(&_ring, p_reader);
+        k_spin_unlock(&_tx_lock, key);
         return;
     }
 
-    if (_bytes_to_send <= mtu_size) {
-        mtu_size = _bytes_to_send;
+    if (p_reader->resync)
+    {
+        /* Transfer cut short is closed, so that next frame is decoded */
+        p_chunk = &_delimiter;
+        chunk = sizeof(_delimiter);
+        p_reader->resync = false;
     }
+    else
+    {
+        if (p_reader->tail == p_reader->record_end && !RING_NextRecord(&_ring, p_reader))
+        {
+            k_spin_unlock(&_tx_lock, key);
+            return;
+        }
 
-    err = bt_nus_send(_conn, _tx_buffer, mtu_size);
-    if (err) {
+        /* Stack copies data at once, ring bytes are only held while it does */
+        chunk = RING_Hold(&_ring, p_reader, mtu_size, &p_chunk);
+    }
+    p_link->piece_left = 0;
+    p_link->busy = true;
+    k_spin_unlock(&_tx_lock, key);
+
+    err = bt_nus_send(conn, p_chunk, chunk);
+
+    key = k_spin_lock(&_tx_lock);
+    RING_Release(p_reader);
+    if (err)
+    {
+        p_link->busy = false;
+        RING_Skip(&_ring, p_reader);
+    }
+    k_spin_unlock(&_tx_lock, key);
+
+    if (!err) {
+        link_count_airtime(p_link, chunk);
+    }
+
+    /* Central no longer subscribed is not an error, its transfers are dropped */
+    if (err && err != -EINVAL) {
         LOG_ERR("Failed to send NUS data (err %d)", err);
-        _bytes_to_send = 0;
-    return;
-	}
+        STATS_Add(STATS_TX_ERRORS, 1);
+    }
+}
+
+/* Send next whole messages of the transfers a central has not received yet,
+ * frames COBS decoded into one notification of length prefixed messages. A
+ * message longer than a notification starts one of its own and goes on in
+ * the next ones, each starting with a zero length prefix. */
+static void ecg_send_next_packet(ble_link_t * p_link)
+{
+    int err = 0;
+    uint32_t length = 0;
+    ring_reader_t * p_reader = link_reader(p_link);
+
+    struct bt_conn * conn = p_link->conn;
+    uint16_t mtu = (conn != NULL) ? bt_gatt_get_mtu(conn) : 0;
+    uint32_t payload = (mtu > ECG_ATT_HEADER) ? MIN(mtu - ECG_ATT_HEADER, ECG_MAX_PAYLOAD) : 0;
+
+    k_spinlock_key_t key = k_spin_lock(&_tx_lock);
+    if (conn == NULL || p_link->conn != conn || p_link->busy || payload <= 2)
+    {
+        k_spin_unlock(&_tx_lock, key);
+        return;
+    }
+
+    /* Transfer cut short, a split message is left incomplete and next
+     * notification does not continue it */
+    if (p_reader->resync) {
+        p_link->piece_left = 0;
+    }
+    p_reader->resync = false;
+
+    if (p_link->piece_left > 0)
+    {
+        uint32_t piece = MIN(p_link->piece_left, payload - 1);
+        p_link->packet[length++] = ECG_CONTINUATION;
+        RING_Decode(&_ring, p_reader, &p_link->packet[length], piece);
+        length += piece;
+        p_link->piece_left -= piece;
+        if (p_link->piece_left == 0) {
+            p_reader->tail = p_link->frame_end;
+        }
+    }
+    else while (!RING_IsEmpty(&_ring, p_reader))
+    {
+        if (p_reader->tail == p_reader->record_end && !RING_NextRecord(&_ring, p_reader)) {
+            break;
+        }
 
-    _bytes_to_send -= mtu_size;
-    _tx_buffer     += mtu_size;
-}
\ No newline at end of file
+        uint32_t frame = RING_GetFrame(&_ring, p_reader);
+        uint32_t size = RING_GetDecodedSize(&_ring, p_reader, frame);
+        uint32_t prefix = (size < 0x80) ? 1 : 2;
+        if (size == 0 || size > ECG_MAX_MESSAGE)
+        {
+            /* Partial frame, left by NUS before this central subscribed here */
+            LOG_WRN("ECG frame of %u bytes dropped", frame);
+            p_reader->tail += frame;
+            STATS_Add(STATS_LINK_DROPPED, 1);
+            continue;
+        }
+        if (length + prefix + size > payload && length > 0) {
+            break;
+        }
+
+        /* Message length as a varint */
+        if (prefix > 1) {
+            p_link->packet[length++] = (size & 0x7F) | 0x80;
+            p_link->packet[length++] = size >> 7;
+        } else {
+            p_link->packet[length++] = size;
+        }
+
+        /* Decoder starts on frame code byte */
+        RING_BeginDecode(p_reader);
+        uint32_t frame_end = p_reader->tail + frame;
+        uint32_t piece = MIN(size, payload - length);
+        RING_Decode(&_ring, p_reader, &p_link->packet[length], piece);
+        length += piece;
+        if (piece < size)
+        {
+            p_link->piece_left = size - piece;
+            p_link->frame_end = frame_end;
+            STATS_Add(STATS_OVERSIZE, 1);
+            break;
+        }
+        p_reader->tail = frame_end;
+    }
+    if (length == 0)
+    {
+        k_spin_unlock(&_tx_lock, key);
+        return;
+    }
+    p_link->busy = true;
+    k_spin_unlock(&_tx_lock, key);
+
+    /* Stack copies the notification at once, packet is free again when this returns */
+    struct bt_gatt_notify_params params = {
+        .attr = &ecg_svc.attrs[1],
+        .data = p_link->packet,
+        .len  = length,
+        .func = ecg_sent_callback,
+    };
+    err = bt_gatt_notify_cb(conn, &params);
+    if (err)
+    {
+        key = k_spin_lock(&_tx_lock);
+        p_link->busy = false;
+        RING_Skip(&_ring, p_reader);
+        p_link->piece_left = 0;
+        k_spin_unlock(&_tx_lock, key);
+    }
+    else {
+        link_count_airtime(p_link, length);
+    }
+
+    /* Central no longer subscribed is not an error, its transfers are dropped */
+    if (err && err != -EINVAL) {
+        LOG_ERR("Failed to send ECG data (err %d)", err);
+        STATS_Add(STATS_TX_ERRORS, 1);
+    }
+}
+
+/* Link of a connection, or a free link for NULL */
+static ble_link_t * link_get(const struct bt_conn * conn)
+{
+    for (uint8_t i = 0; i < BLE_MAX_LINKS; i++)
+    {
+        if (_links[i].conn == conn) {
+            return &_links[i];
+        }
+    }
+    return NULL;
+}
+
+/* Account radio TX time of a notification, link layer packets estimated from
+ * negotiated payload size (empty acknowledgements and retries not included) */
+static void link_count_airtime(const ble_link_t * p_link, uint32_t length)
+{
+    uint32_t pdu = length + ECG_ATT_HEADER + L2CAP_HEADER;
+    uint32_t packets = DIV_ROUND_UP(pdu, MAX(p_link->data_length, BT_GAP_DATA_LEN_DEFAULT));
+    uint32_t us_per_byte;
+
+    switch (p_link->phy)
+    {
+        case BT_GAP_LE_PHY_2M:    us_per_byte = 4;  break;
+        case BT_GAP_LE_PHY_CODED: us_per_byte = 64; break;  /* S=8 coding */
+        default:                  us_per_byte = 8;  break;
+    }
+    ENERGY_AddActive(ENERGY_RADIO_TX, (pdu + packets * LL_PACKET_OVERHEAD) * us_per_byte);
+}
+
+/* Central receiving the transfers, from either service */
+static bool link_subscribed(const ble_link_t * p_link)
+{
+    return link_nus_subscribed(p_link) || link_ecg_subscribed(p_link);
+}
+
+static bool link_nus_subscribed(const ble_link_t * p_link)
+{
+    return (p_link->conn != NULL) && (_nus_tx_attr != NULL) &&
+           bt_gatt_is_subscribed(p_link->conn, _nus_tx_attr, BT_GATT_CCC_NOTIFY);
+}
+
+static bool link_ecg_subscribed(const ble_link_t * p_link)
+{
+    return (p_link->conn != NULL) &&
+           bt_gatt_is_subscribed(p_link->conn, &ecg_svc.attrs[1], BT_GATT_CCC_NOTIFY);
+}
+
+/* Reader of the transfers ring of a link */
+static ring_reader_t * link_reader(const ble_link_t * p_link)
+{
+    return &_readers[p_link - _links];
+}
+
+/* Queue a transfer for some of the subscribers, each one sends it at its own pace */
+static int ring_send(uint8_t links, const uint8_t * p_data, uint16_t length)
+{
+    int err = 0;
+    bool subscribed[BLE_MAX_LINKS];
+    bool queued = false;
+
+    if (!BLE_IsConnected()) {
+        LOG_ERR("%s", "No connection to send NUS data");
+        return -ENOTCONN;
+    }
+
+    for (uint8_t i = 0; i < BLE_MAX_LINKS; i++) {
+        subscribed[i] = link_subscribed(&_links[i]) && (links & BIT(i));
+        queued |= subscribed[i] && (&_links[i] != _bulk_link);
+    }
+    if (!queued) {
+        LOG_ERR("%s", "NUS notifications not enabled");
+        return (_bulk_link != NULL) ? -EBUSY : -EACCES;
+    }
+    if (length == 0 || length + RING_RECORD_HEADER > sizeof(_ring_buffer)) {
+        return -EMSGSIZE;
+    }
+
+    k_mutex_lock(&_send_mutex, K_FOREVER);
+
+    /* Space beyond head is not read by any central until published */
+    k_spinlock_key_t key = k_spin_lock(&_tx_lock);
+    err = RING_Reserve(&_ring, length);
+    k_spin_unlock(&_tx_lock, key);
+
+    if (err)
+    {
+        k_mutex_unlock(&_send_mutex);
+        LOG_ERR("NUS busy, %u bytes dropped", length);
+        return err;
+    }
+
+    RING_Write(&_ring, links, p_data, length);
+
+    key = k_spin_lock(&_tx_lock);
+    RING_Publish(&_ring, length);
+
+    /* Centrals not subscribed skip this transfer */
+    for (uint8_t i = 0; i < BLE_MAX_LINKS; i++)
+    {
+        if (!link_subscribed(&_links[i]) || &_links[i] == _bulk_link)
+        {
+            RING_Skip(&_ring, &_readers[i]);
+            _links[i].piece_left = 0;
+        }
+    }
+    STATS_Max(STATS_TX_HIGH_WATER, RING_Used(&_ring));
+    k_spin_unlock(&_tx_lock, key);
+    k_mutex_unlock(&_send_mutex);
+
+    for (uint8_t i = 0; i < BLE_MAX_LINKS; i++) {
+        nus_send_next_packet(&_links[i]);
+    }
+    return 0;
+}
+
+/* Advertising restarted for the next central */
+static void adv_work_handler(struct k_work * work)
+{
+    BLE_StartAdvertising();
+}
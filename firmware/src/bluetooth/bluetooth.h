@@ -21,13 +21,12 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 
+struct bt_conn;
+
 /*******************************************************************************
  * MACROS AND DEFINES
  ******************************************************************************/
 
-#define BLE_RX_MAX_BUFFER_SIZE      255             /**< Maximum payload from BLE messages received */
-#define BLE_TX_MAX_BUFFER_SIZE      255             /**< Maximum payload for BLE messages sent */
-
 /*******************************************************************************
  * TYPEDEFS
  ******************************************************************************/
@@ -38,37 +37,36 @@ typedef enum
     BLE_EVT_CONNECTED = 0,
     BLE_EVT_DISCONNECTED,
     BLE_EVT_NUS_ENABLED,
-    BLE_EVT_NUS_DISABLED
+    BLE_EVT_NUS_DISABLED,
+    BLE_EVT_HRS_ENABLED,
+    BLE_EVT_HRS_DISABLED
 } ble_event_type_t;
 
-/* Requests / commands /messages codes enumeration */
+/* Connection parameters requested for a central, same values as protobuf LinkProfile */
 typedef enum
 {
-    BLE_REQ_START_MEASURE = 0,
-    BLE_REQ_STOP_MEASURE = 1,
-    BLE_MSG_MEASURE_DATA = 2,
-    NUM_OF_BLE_MSG_TYPES,
-} ble_packet_type_t;
-
-/* BLE messages structure type */
-typedef struct
-{
-    uint16_t type;
-    uint16_t length;    // this is data length, not full packet length (full length = data length + 4)
-    uint8_t  data[];    // this should be aligned, so a pointer can be used
-} ble_rx_packet_t;
+    BLE_LINK_BALANCED = 0,      /**< Peripheral preferred parameters, set on connection */
+    BLE_LINK_LOW_POWER,
+    BLE_LINK_LOW_LATENCY,
+    NUM_OF_BLE_LINK_PROFILES,
+} ble_link_profile_t;
 
+/* Connection settings, reported with bulk transfer throughput */
 typedef struct
 {
-    uint16_t type;
-    uint16_t length;    // this is data length, not full packet length (full length = data length + 4)
-    uint8_t  data[BLE_TX_MAX_BUFFER_SIZE];
-} ble_tx_packet_t;
-
-/* BLE user callback types */
+    uint8_t  phy;           /**< TX PHY (BT_GAP_LE_PHY_*) */
+    uint32_t interval_us;   /**< Connection interval */
+    uint16_t data_length;   /**< Link layer TX payload */
+    uint16_t mtu;           /**< NUS payload per notification */
+} ble_link_info_t;
+
+/* BLE user callback types, link is the index of the central (0 to CONFIG_BT_MAX_CONN - 1),
+ * received data is a COBS frame from NUS if framed, a bare message from ECG service otherwise */
 typedef void (*BLE_EventCallback_t)(ble_event_type_t event);
-typedef void (*BLE_ReceiveCallback_t)(const uint8_t *const p_data, 
-                                      uint16_t length);
+typedef void (*BLE_ReceiveCallback_t)(uint8_t link, const uint8_t *const p_data,
+                                      uint16_t length, bool framed);
+/* Central connected or gone, for every central unlike connection events */
+typedef void (*BLE_LinkCallback_t)(uint8_t link, bool connected);
 
 /*******************************************************************************
  * EXPORTED VARIABLES
@@ -83,10 +81,23 @@ void BLE_StartAdvertising(void);
 void BLE_StopAdvertising(void);
 bool BLE_IsConnected(void);
 bool BLE_IsSendEnabled(void);
+bool BLE_IsLinkSendEnabled(uint8_t link);
 void BLE_Disconnect(void);
-void BLE_Send(uint8_t * p_data, uint16_t length);
+int  BLE_Send(uint8_t * p_data, uint16_t length);
+int  BLE_SendTo(uint8_t link, const uint8_t * p_data, uint16_t length);
+bool BLE_IsSendBusy(void);
+int  BLE_BulkBegin(uint8_t link);
+int  BLE_SendBulk(const uint8_t * p_data, uint32_t length);
+void BLE_BulkEnd(void);
+int  BLE_GetLinkInfo(uint8_t link, ble_link_info_t * p_info);
+int  BLE_SetLinkProfile(uint8_t link, ble_link_profile_t profile);
+struct bt_conn * BLE_GetConnection(uint8_t link);
+bool BLE_IsHeartRateEnabled(void);
+void BLE_SendHeartRate(uint16_t bpm, const uint16_t * p_rr, uint8_t rr_count, bool contact);
+int  BLE_SetEnergy(const uint8_t * p_data, uint16_t length);
 void BLE_SetReceiveCallback(BLE_ReceiveCallback_t receive_callback);
 void BLE_SetEventCallback(BLE_EventCallback_t event_callback);
+void BLE_SetLinkCallback(BLE_LinkCallback_t link_callback);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,303 @@
+/**
+ *******************************************************************************
+ * @file    ring.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Transfers ring module source file
+ *
+ * Each transfer is copied once, then read by every reader from its own
+ * position, so that a slow reader only loses its own oldest transfers when
+ * the ring is full. Transfers are stored after a header giving their length
+ * and the readers they go to.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+
+/* Application includes */
+#include "nanocobs/cobs.h"
+#include "stats/stats.h"
+#include "ring.h"
+
+/*******************************************************************************
+ * EXTERN VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define COBS_FULL_BLOCK     0xFF    /**< Code of a block with no zero after it */
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+static uint8_t  get_byte(const ring_t * p_ring, uint32_t position);
+static uint16_t get_length(const ring_t * p_ring, uint32_t position);
+static uint32_t reader_floor(const ring_reader_t * p_reader);
+
+/*******************************************************************************
+ * GLOBAL FUNCTIONS
+ ******************************************************************************/
+
+void RING_Init(ring_t * p_ring, uint8_t * p_buffer, uint32_t size,
+               ring_reader_t * p_readers, uint8_t reader_count)
+{
+    p_ring->p_buffer = p_buffer;
+    p_ring->size = size;
+    p_ring->head = 0;
+    p_ring->p_readers = p_readers;
+    p_ring->reader_count = reader_count;
+    memset(p_readers, 0, reader_count * sizeof(ring_reader_t));
+}
+
+void RING_Attach(const ring_t * p_ring, ring_reader_t * p_reader)
+{
+    memset(p_reader, 0, sizeof(*p_reader));
+    p_reader->tail = p_ring->head;
+    p_reader->record_end = p_ring->head;
+    p_reader->active = true;
+}
+
+void RING_Detach(ring_reader_t * p_reader)
+{
+    p_reader->active = false;
+}
+
+void RING_Skip(const ring_t * p_ring, ring_reader_t * p_reader)
+{
+    p_reader->tail = p_ring->head;
+    p_reader->record_end = p_ring->head;
+    p_reader->resync = false;
+}
+
+bool RING_IsEmpty(const ring_t * p_ring, const ring_reader_t * p_reader)
+{
+    return p_reader->tail == p_ring->head;
+}
+
+uint32_t RING_Used(const ring_t * p_ring)
+{
+    uint32_t used = 0;
+
+    for (uint8_t i = 0; i < p_ring->reader_count; i++)
+    {
+        if (p_ring->p_readers[i].active) {
+            used = MAX(used, p_ring->head - reader_floor(&p_ring->p_readers[i]));
+        }
+    }
+    return used;
+}
+
+int RING_Reserve(ring_t * p_ring, uint16_t length)
+{
+    uint32_t needed = length + RING_RECORD_HEADER;
+
+    if (needed > p_ring->size) {
+        return -EMSGSIZE;
+    }
+
+    while (p_ring->size - RING_Used(p_ring) < needed)
+    {
+        ring_reader_t * p_slow = NULL;
+        for (uint8_t i = 0; i < p_ring->reader_count; i++)
+        {
+            ring_reader_t * p_reader = &p_ring->p_readers[i];
+            if (p_reader->active &&
+                (p_slow == NULL || p_ring->head - reader_floor(p_reader) > p_ring->head - reader_floor(p_slow))) {
+                p_slow = p_reader;
+            }
+        }
+        if (p_slow == NULL || p_slow->copying) {
+            return -EBUSY;
+        }
+
+        /* A transfer cut short costs the reader this frame only, see resync */
+        uint32_t target = p_ring->head + needed - p_ring->size;
+        if (p_slow->tail != p_slow->record_end)
+        {
+            p_slow->tail = p_slow->record_end;
+            p_slow->resync = true;
+            STATS_Add(STATS_LINK_DROPPED, 1);
+        }
+        while ((int32_t)(target - p_slow->tail) > 0)
+        {
+            p_slow->tail += RING_RECORD_HEADER + get_length(p_ring, p_slow->tail);
+            STATS_Add(STATS_LINK_DROPPED, 1);
+        }
+        p_slow->record_end = p_slow->tail;
+    }
+    return 0;
+}
+
+void RING_Write(ring_t * p_ring, uint8_t readers, const uint8_t * p_data, uint16_t length)
+{
+    uint8_t header[RING_RECORD_HEADER];
+    uint32_t position = p_ring->head;
+
+    sys_put_le16(length, header);
+    header[RING_RECORD_HEADER - 1] = readers;
+    for (uint32_t i = 0; i < RING_RECORD_HEADER; i++) {
+        p_ring->p_buffer[(position + i) % p_ring->size] = header[i];
+    }
+
+    uint32_t offset = (position + RING_RECORD_HEADER) % p_ring->size;
+    uint32_t first_part = MIN(length, p_ring->size - offset);
+    memcpy(&p_ring->p_buffer[offset], p_data, first_part);
+    memcpy(p_ring->p_buffer, p_data + first_part, length - first_part);
+}
+
+void RING_Publish(ring_t * p_ring, uint16_t length)
+{
+    p_ring->head += length + RING_RECORD_HEADER;
+}
+
+bool RING_NextRecord(const ring_t * p_ring, ring_reader_t * p_reader)
+{
+    uint8_t bit = BIT(p_reader - p_ring->p_readers);
+
+    while (p_reader->tail != p_ring->head)
+    {
+        uint32_t position = p_reader->tail;
+        bool wanted = (get_byte(p_ring, position + RING_RECORD_HEADER - 1) & bit) != 0;
+        p_reader->record_end = position + RING_RECORD_HEADER + get_length(p_ring, position);
+        p_reader->tail = wanted ? position + RING_RECORD_HEADER : p_reader->record_end;
+        if (wanted) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t RING_Hold(const ring_t * p_ring, ring_reader_t * p_reader, uint32_t max, const uint8_t ** pp_data)
+{
+    uint32_t offset = p_reader->tail % p_ring->size;
+    uint32_t count = MIN(p_reader->record_end - p_reader->tail, p_ring->size - offset);
+
+    count = MIN(count, max);
+    *pp_data = &p_ring->p_buffer[offset];
+    p_reader->hold = p_reader->tail;
+    p_reader->copying = true;
+    p_reader->tail += count;
+    return count;
+}
+
+void RING_Release(ring_reader_t * p_reader)
+{
+    p_reader->copying = false;
+}
+
+uint32_t RING_GetFrame(const ring_t * p_ring, const ring_reader_t * p_reader)
+{
+    uint32_t length = 0;
+
+    while (p_reader->tail + length != p_reader->record_end)
+    {
+        if (get_byte(p_ring, p_reader->tail + length++) == COBS_FRAME_DELIMITER) {
+            break;
+        }
+    }
+    return length;
+}
+
+uint32_t RING_GetDecodedSize(const ring_t * p_ring, const ring_reader_t * p_reader, uint32_t frame)
+{
+    uint32_t position = p_reader->tail;
+    uint32_t end = position + frame - 1;
+    uint32_t size = 0;
+
+    if (frame < 2 || get_byte(p_ring, end) != COBS_FRAME_DELIMITER) {
+        return 0;
+    }
+    while (position != end)
+    {
+        uint8_t code = get_byte(p_ring, position);
+        if (code == COBS_FRAME_DELIMITER || code > end - position) {
+            return 0;
+        }
+        position += code;
+        size += code - 1;
+
+        /* Zero replaced by next code byte, none after a full block */
+        if (code != COBS_FULL_BLOCK && position != end) {
+            size++;
+        }
+    }
+    return size;
+}
+
+void RING_BeginDecode(ring_reader_t * p_reader)
+{
+    /* First code byte does not stand for a zero */
+    p_reader->cobs_code = COBS_FULL_BLOCK;
+    p_reader->cobs_left = 0;
+}
+
+void RING_Decode(const ring_t * p_ring, ring_reader_t * p_reader, uint8_t * p_out, uint32_t count)
+{
+    uint32_t i = 0;
+
+    while (i < count)
+    {
+        if (p_reader->cobs_left > 0)
+        {
+            p_out[i++] = get_byte(p_ring, p_reader->tail++);
+            p_reader->cobs_left--;
+            continue;
+        }
+
+        /* Block over, next code byte stands for a zero unless block was full */
+        bool zero = (p_reader->cobs_code != COBS_FULL_BLOCK);
+        p_reader->cobs_code = get_byte(p_ring, p_reader->tail++);
+        p_reader->cobs_left = p_reader->cobs_code - 1;
+        if (zero) {
+            p_out[i++] = 0;
+        }
+    }
+}
+
+/*******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
+
+static uint8_t get_byte(const ring_t * p_ring, uint32_t position)
+{
+    return p_ring->p_buffer[position % p_ring->size];
+}
+
+/* Length of the transfer stored at a ring position */
+static uint16_t get_length(const ring_t * p_ring, uint32_t position)
+{
+    uint8_t header[sizeof(uint16_t)];
+
+    for (uint32_t i = 0; i < sizeof(header); i++) {
+        header[i] = get_byte(p_ring, position + i);
+    }
+    return sys_get_le16(header);
+}
+
+/* Oldest ring position still needed by a reader */
+static uint32_t reader_floor(const ring_reader_t * p_reader)
+{
+    return p_reader->copying ? p_reader->hold : p_reader->tail;
+}
@@ -0,0 +1,205 @@
+/**
+ *******************************************************************************
+ * @file    ring.h
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Transfers ring module header file
+ *******************************************************************************
+ */
+
+#ifndef __RING_H__
+#define __RING_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*******************************************************************************
+ * MACROS AND DEFINES
+ ******************************************************************************/
+
+#define RING_RECORD_HEADER  3       /**< Transfer length and readers it goes to, before each transfer */
+#define RING_MAX_READERS    8       /**< Readers of a transfer are a byte mask */
+
+/*******************************************************************************
+ * TYPEDEFS
+ ******************************************************************************/
+
+/* Reader of the transfers, at its own pace */
+typedef struct
+{
+    bool     active;        /**< Ring space is kept for this reader */
+    bool     copying;       /**< Bytes from hold being copied, not to be overwritten */
+    bool     resync;        /**< Transfer cut short, delimiter to be sent first */
+    uint32_t hold;
+    uint32_t tail;          /**< Ring position of next byte to read */
+    uint32_t record_end;    /**< End of transfer being read, tail between transfers */
+    uint8_t  cobs_code;     /**< Code byte of COBS block being decoded */
+    uint8_t  cobs_left;     /**< Bytes left in that block */
+} ring_reader_t;
+
+/* Transfers stored once for every reader, positions are free running byte counters */
+typedef struct
+{
+    uint8_t *       p_buffer;
+    uint32_t        size;
+    uint32_t        head;       /**< Position after last published transfer */
+    ring_reader_t * p_readers;
+    uint8_t         reader_count;
+} ring_t;
+
+/*******************************************************************************
+ * EXPORTED VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/*
+ * Ring and readers are not locked, callers serialize calls on the same ring.
+ * Bytes beyond head are not read until published, a transfer may be written
+ * there outside of the caller lock as long as one transfer is written at a time.
+ */
+
+/**
+ * @brief Initialize an empty ring, no reader active
+ * @param [out] p_ring ring
+ * @param [in]  p_buffer transfers storage
+ * @param [in]  size storage size
+ * @param [in]  p_readers readers storage
+ * @param [in]  reader_count number of readers, up to RING_MAX_READERS
+ */
+void RING_Init(ring_t * p_ring, uint8_t * p_buffer, uint32_t size,
+               ring_reader_t * p_readers, uint8_t reader_count);
+
+/**
+ * @brief Start a reader from the next transfer published
+ * @param [in] p_ring ring
+ * @param [in] p_reader reader of this ring
+ */
+void RING_Attach(const ring_t * p_ring, ring_reader_t * p_reader);
+
+/**
+ * @brief Stop a reader, ring space is no longer kept for it
+ * @param [in] p_reader reader
+ */
+void RING_Detach(ring_reader_t * p_reader);
+
+/**
+ * @brief Drop the transfers a reader has not read yet
+ * @param [in] p_ring ring
+ * @param [in] p_reader reader of this ring
+ */
+void RING_Skip(const ring_t * p_ring, ring_reader_t * p_reader);
+
+/**
+ * @brief Tell if a reader has read every transfer published
+ * @param [in] p_ring ring
+ * @param [in] p_reader reader of this ring
+ * @return true if nothing is left to read
+ */
+bool RING_IsEmpty(const ring_t * p_ring, const ring_reader_t * p_reader);
+
+/**
+ * @brief Bytes still needed by the slowest active reader
+ * @param [in] p_ring ring
+ * @return used bytes
+ */
+uint32_t RING_Used(const ring_t * p_ring);
+
+/**
+ * @brief Make room for a transfer, dropping oldest transfers of the slowest
+ * readers when the ring is full
+ * @param [in] p_ring ring
+ * @param [in] length transfer length
+ * @return 0 on success, -EMSGSIZE if the transfer is longer than the ring,
+ * -EBUSY if the slowest reader bytes are being copied
+ */
+int RING_Reserve(ring_t * p_ring, uint16_t length);
+
+/**
+ * @brief Write a transfer in the space reserved beyond head
+ * @param [in] p_ring ring
+ * @param [in] readers mask of readers the transfer goes to
+ * @param [in] p_data transfer
+ * @param [in] length transfer length, as reserved
+ */
+void RING_Write(ring_t * p_ring, uint8_t readers, const uint8_t * p_data, uint16_t length);
+
+/**
+ * @brief Publish the transfer written beyond head to readers
+ * @param [in] p_ring ring
+ * @param [in] length transfer length, as written
+ */
+void RING_Publish(ring_t * p_ring, uint16_t length);
+
+/**
+ * @brief Start next transfer for a reader, skipping the ones going to others
+ * @param [in] p_ring ring
+ * @param [in] p_reader reader of this ring
+ * @return false when there is none left
+ */
+bool RING_NextRecord(const ring_t * p_ring, ring_reader_t * p_reader);
+
+/**
+ * @brief Hold next contiguous bytes of the transfer being read, they are not
+ * overwritten until RING_Release()
+ * @param [in]  p_ring ring
+ * @param [in]  p_reader reader of this ring, within a transfer
+ * @param [in]  max most bytes wanted
+ * @param [out] pp_data first byte held
+ * @return bytes held, reader goes on after them
+ */
+uint32_t RING_Hold(const ring_t * p_ring, ring_reader_t * p_reader, uint32_t max, const uint8_t ** pp_data);
+
+/**
+ * @brief Release the bytes held by a reader
+ * @param [in] p_reader reader
+ */
+void RING_Release(ring_reader_t * p_reader);
+
+/**
+ * @brief Length of the COBS frame a reader is on, delimiter included
+ * @param [in] p_ring ring
+ * @param [in] p_reader reader of this ring, within a transfer
+ * @return frame length, up to the end of the transfer if it has no delimiter
+ */
+uint32_t RING_GetFrame(const ring_t * p_ring, const ring_reader_t * p_reader);
+
+/**
+ * @brief Decoded size of the COBS frame a reader is on
+ * @param [in] p_ring ring
+ * @param [in] p_reader reader of this ring
+ * @param [in] frame frame length from RING_GetFrame()
+ * @return decoded size, 0 if not a whole frame
+ */
+uint32_t RING_GetDecodedSize(const ring_t * p_ring, const ring_reader_t * p_reader, uint32_t frame);
+
+/**
+ * @brief Start decoding the COBS frame a reader is on
+ * @param [in] p_reader reader, on frame code byte
+ */
+void RING_BeginDecode(ring_reader_t * p_reader);
+
+/**
+ * @brief Decode next bytes of a COBS frame, reader goes on after them
+ * @param [in]  p_ring ring
+ * @param [in]  p_reader reader of this ring
+ * @param [out] p_out decoded bytes
+ * @param [in]  count bytes to decode, within the decoded size
+ */
+void RING_Decode(const ring_t * p_ring, ring_reader_t * p_reader, uint8_t * p_out, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RING_H__ */
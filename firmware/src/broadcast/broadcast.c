@@ -0,0 +1,267 @@
+/**
+ *******************************************************************************
+ * @file    broadcast.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Periodic advertising broadcast module source file
+ *
+ * NUS EcgBuffer frames are also gathered into batches, which replace the
+ * periodic advertising data once per interval, so that any number of
+ * scanners receive the stream without connecting. A batch is made of up to
+ * BCAST_AD_COUNT manufacturer data structures, each starting with the
+ * company identifier. Once concatenated, their data is a batch sequence
+ * number (16 bits, little endian) followed by whole COBS frames, exactly as
+ * on NUS. The controller repeats the last batch until the next update,
+ * scanners skip it from its sequence number. Batches are not acknowledged:
+ * a frame lost on air shows as a gap in EcgBuffer.sequence.
+ *
+ * Throughput ceiling is BCAST_BATCH_SIZE (1510 bytes) per interval, that is
+ * 75 kB/s at 20 ms, 15 kB/s at 100 ms and 1.5 kB/s at 1 s, for ~1.1 kB/s
+ * with one 512 Hz output in 100 samples frames. Larger frames than a batch
+ * are never broadcast. A full batch takes ~6 ms of air time on 2M PHY.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/sys/byteorder.h>
+
+/* Application includes */
+#include "bluetooth/bluetooth.h"
+#include "broadcast.h"
+
+/*******************************************************************************
+ * EXTERN VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define LOG_MODULE_NAME broadcast
+LOG_MODULE_REGISTER(LOG_MODULE_NAME);
+
+#define BCAST_COMPANY_ID        0xFFFF      /**< Bluetooth SIG test identifier */
+#define BCAST_COMPANY_SIZE      2
+#define BCAST_HEADER_SIZE       2           /**< Batch sequence number */
+#define BCAST_AD_SIZE           254         /**< Largest AD structure data */
+#define BCAST_AD_COUNT          6           /**< 1536 bytes on air, below controller 1650 bytes */
+#define BCAST_BATCH_SIZE        (BCAST_AD_COUNT * (BCAST_AD_SIZE - BCAST_COMPANY_SIZE) - BCAST_HEADER_SIZE)
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+static struct bt_le_ext_adv * adv;
+static atomic_t enabled;
+static uint32_t interval_ms = BCAST_DEFAULT_INTERVAL_MS;
+static uint16_t batch_sequence;
+
+/* Frames are gathered in one batch while the other one is being advertised */
+static struct k_spinlock batch_lock;
+static uint8_t batches[2][BCAST_BATCH_SIZE];
+static size_t batch_lengths[2];
+static uint8_t batch_fill;
+
+static uint8_t ad_data[BCAST_AD_COUNT][BCAST_AD_SIZE];
+
+/*******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+static void update_work_handler(struct k_work * work);
+
+static K_WORK_DELAYABLE_DEFINE(update_work, update_work_handler);
+
+/*******************************************************************************
+ * GLOBAL FUNCTIONS
+ ******************************************************************************/
+
+int BCAST_Init(void)
+{
+    const char * p_name = bt_get_name();
+
+    int err = bt_le_ext_adv_create(BT_LE_EXT_ADV_NCONN, NULL, &adv);
+    if (err) {
+        LOG_ERR("Failed to create broadcast advertising set (err %d)", err);
+        return err;
+    }
+
+    /* Scanners find the train from device name */
+    struct bt_data ad = BT_DATA(BT_DATA_NAME_COMPLETE, p_name, strlen(p_name));
+    err = bt_le_ext_adv_set_data(adv, &ad, 1, NULL, 0);
+    if (err) {
+        LOG_ERR("Failed to set broadcast advertising data (err %d)", err);
+    }
+    return err;
+}
+
+int BCAST_Configure(bool enable, uint32_t interval)
+{
+    int err = 0;
+
+    if (adv == NULL) {
+        return -ENODEV;
+    }
+    if (interval == 0) {
+        interval = BCAST_DEFAULT_INTERVAL_MS;
+    }
+    if (enable && (interval < BCAST_MIN_INTERVAL_MS || interval > BCAST_MAX_INTERVAL_MS)) {
+        return -EINVAL;
+    }
+
+    /* Train parameters can only be changed while stopped */
+    if (atomic_set(&enabled, false))
+    {
+        k_work_cancel_delayable(&update_work);
+        bt_le_per_adv_stop(adv);
+        bt_le_ext_adv_stop(adv);
+    }
+    if (!enable)
+    {
+        LOG_INF("%s", "Broadcast stopped");
+        return 0;
+    }
+
+    /* Interval in 1.25 ms units */
+    uint16_t units = (interval * 4) / 5;
+    err = bt_le_per_adv_set_param(adv, BT_LE_PER_ADV_PARAM(units, units, BT_LE_PER_ADV_OPT_NONE));
+    if (!err) {
+        err = bt_le_per_adv_start(adv);
+    }
+    if (!err) {
+        err = bt_le_ext_adv_start(adv, BT_LE_EXT_ADV_START_DEFAULT);
+    }
+    if (err) {
+        LOG_ERR("Failed to start broadcast (err %d)", err);
+        return err;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&batch_lock);
+    batch_lengths[0] = 0;
+    batch_lengths[1] = 0;
+    k_spin_unlock(&batch_lock, key);
+
+    interval_ms = interval;
+    atomic_set(&enabled, true);
+    k_work_reschedule(&update_work, K_MSEC(interval_ms));
+    LOG_INF("Broadcast every %u ms", interval_ms);
+    return 0;
+}
+
+bool BCAST_IsEnabled(void)
+{
+    return atomic_get(&enabled);
+}
+
+int BCAST_TransferSync(uint8_t link)
+{
+    if (!atomic_get(&enabled)) {
+        return -EAGAIN;
+    }
+
+    struct bt_conn * conn = BLE_GetConnection(link);
+    if (conn == NULL) {
+        return -ENOTCONN;
+    }
+
+    int err = bt_le_per_adv_set_info_transfer(adv, conn, 0);
+    if (err) {
+        LOG_ERR("Failed to transfer broadcast sync info (err %d)", err);
+    }
+    return err;
+}
+
+void BCAST_Push(const uint8_t * p_frame, size_t length)
+{
+    if (!atomic_get(&enabled)) {
+        return;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&batch_lock);
+    uint8_t fill = batch_fill;
+    bool fits = (batch_lengths[fill] + length <= BCAST_BATCH_SIZE);
+    if (fits)
+    {
+        memcpy(&batches[fill][batch_lengths[fill]], p_frame, length);
+        batch_lengths[fill] += length;
+    }
+    k_spin_unlock(&batch_lock, key);
+
+    if (!fits) {
+        LOG_WRN("Broadcast batch full, %u bytes frame dropped", length);
+    }
+}
+
+/*******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
+
+/* Advertise frames gathered during last interval */
+static void update_work_handler(struct k_work * work)
+{
+    struct bt_data ad[BCAST_AD_COUNT];
+    size_t count = 0;
+    size_t offset = 0;
+
+    if (!atomic_get(&enabled)) {
+        return;
+    }
+    k_work_reschedule(k_work_delayable_from_work(work), K_MSEC(interval_ms));
+
+    k_spinlock_key_t key = k_spin_lock(&batch_lock);
+    uint8_t batch = batch_fill;
+    batch_fill ^= 1;
+    k_spin_unlock(&batch_lock, key);
+
+    /* Controller repeats previous batch until there is a new one */
+    size_t length = batch_lengths[batch];
+    if (length == 0) {
+        return;
+    }
+
+    /* Batch is split over AD structures, concatenated back by scanners */
+    while (count < BCAST_AD_COUNT && (offset < length || count == 0))
+    {
+        uint8_t * p_data = ad_data[count];
+        size_t used = BCAST_COMPANY_SIZE;
+
+        sys_put_le16(BCAST_COMPANY_ID, p_data);
+        if (count == 0)
+        {
+            sys_put_le16(++batch_sequence, &p_data[used]);
+            used += BCAST_HEADER_SIZE;
+        }
+        size_t part = MIN(length - offset, BCAST_AD_SIZE - used);
+        memcpy(&p_data[used], &batches[batch][offset], part);
+        offset += part;
+        used += part;
+
+        ad[count].type = BT_DATA_MANUFACTURER_DATA;
+        ad[count].data_len = used;
+        ad[count].data = p_data;
+        count++;
+    }
+    batch_lengths[batch] = 0;
+
+    int err = bt_le_per_adv_set_data(adv, ad, count);
+    if (err) {
+        LOG_ERR("Failed to update broadcast data (err %d)", err);
+    }
+}
@@ -0,0 +1,86 @@
+/**
+ *******************************************************************************
+ * @file    broadcast.h
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Periodic advertising broadcast module header file
+ *******************************************************************************
+ */
+
+#ifndef __BROADCAST_H__
+#define __BROADCAST_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*******************************************************************************
+ * MACROS AND DEFINES
+ ******************************************************************************/
+
+#define BCAST_DEFAULT_INTERVAL_MS   100     /**< Periodic advertising interval if not set */
+#define BCAST_MIN_INTERVAL_MS       20
+#define BCAST_MAX_INTERVAL_MS       1000
+
+/*******************************************************************************
+ * TYPEDEFS
+ ******************************************************************************/
+
+/*******************************************************************************
+ * EXPORTED VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/**
+ * @brief Create advertising set of broadcast, must be called after BLE_Init()
+ * @return 0 on success, negative error code from Bluetooth stack otherwise
+ */
+int BCAST_Init(void);
+
+/**
+ * @brief Start, reconfigure or stop broadcasting
+ * @param [in] enable true to broadcast, goes on while disconnected
+ * @param [in] interval_ms periodic advertising interval, 0 for default
+ * @return 0 on success, -EINVAL if interval is out of range, negative error
+ * code from Bluetooth stack otherwise
+ */
+int BCAST_Configure(bool enable, uint32_t interval_ms);
+
+/**
+ * @brief Tell if broadcasting, acquisition should then go on while disconnected
+ */
+bool BCAST_IsEnabled(void);
+
+/**
+ * @brief Send periodic advertising sync info to a central (PAST), so that it
+ * syncs to the train without scanning
+ * @param [in] link central index
+ * @return 0 on success, -EAGAIN if not broadcasting, negative error code from
+ * Bluetooth stack otherwise
+ */
+int BCAST_TransferSync(uint8_t link);
+
+/**
+ * @brief Queue an encoded frame for next periodic advertising data update,
+ * does nothing if not broadcasting
+ * @param [in] p_frame complete COBS frame
+ * @param [in] length frame length
+ */
+void BCAST_Push(const uint8_t * p_frame, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BROADCAST_H__ */
@@ -20,6 +20,8 @@
 #include <zephyr/device.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/counter.h>
+#include <nrfx_timer.h>
+#include <helpers/nrfx_gppi.h>
 
 /* Application includes */
 #include "calendar.h"
@@ -40,8 +42,15 @@ LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 
 #define RTC_PRESCALER (15)                                /**< Power of 2 for RTC frequency (15 is 32768 Hz) - TO BE SET ACCORDING TO PRESCALER IN DTS FILE */
 #define RTC_FREQUENCY (1 << RTC_PRESCALER)                /**< RTC counter frequency in Hz (8 - 32768) */
-#define COUNTER_TO_SECS(counts) (counts >> RTC_PRESCALER) /**< Macro to convert RTC counter value in seconds */
-#define SECS_TO_COUNTER(secs) (secs << RTC_PRESCALER)     /**< Macro to convert seconds in RTC counter value */
+#define COUNTER_TO_SECS(counts) ((counts) >> RTC_PRESCALER) /**< Macro to convert RTC counter value in seconds */
+#define SECS_TO_COUNTER(secs) ((uint64_t)(secs) << RTC_PRESCALER) /**< Macro to convert seconds in RTC counter value */
+#define COUNTER_TO_US(counts) (((uint64_t)(counts) * USEC_PER_SEC) >> RTC_PRESCALER) /**< Sub-second RTC counter value in microseconds */
+#define US_TO_COUNTER(us) (((uint64_t)(us) << RTC_PRESCALER) / USEC_PER_SEC)  /**< Microseconds in RTC counter value */
+
+BUILD_ASSERT(RTC_FREQUENCY == CAL_TICKS_PER_SEC, "Calendar ticks must match RTC frequency");
+
+#define CAPTURE_TIMER_IDX   2                       /**< TIMER started by captured event, measures time elapsed since then */
+#define CAPTURE_TIMER_CC    NRF_TIMER_CC_CHANNEL0
 
 /*******************************************************************************
  * PRIVATE TYPEDEFS
@@ -55,8 +64,21 @@ static const struct device *counter_dev = DEVICE_DT_GET(DT_NODELABEL(rtc2));
 static struct counter_top_cfg top_cfg;
 static struct counter_config_info config_info;
 
-static uint64_t time_offset = 0; /**< UNIX 64 bit epoch in seconds - Current time is time_offset + (RTC counter value converted in seconds) */
-static uint32_t tick_offset = 0; /**< Microsecs offset set at initial time */
+/* Extended counter and wall clock offset, read with a sequence lock: the
+ * sequence is odd while the overflow interrupt or CAL_SetTime updates them */
+static atomic_t seq;
+static uint32_t overflows = 0;  /**< RTC counter wraps since start */
+static uint64_t epoch_ticks = 0; /**< Unix epoch in RTC ticks when extended counter was 0 (modulo 2^64) */
+
+/* Host clock model from time synchronization, replaces epoch_ticks when set */
+static bool sync_enabled = false;
+static uint64_t sync_ref_ticks; /**< Reference instant in ticks */
+static int64_t sync_ref_us;     /**< Host time at reference instant (Unix epoch in microseconds) */
+static int32_t sync_skew_ppb;   /**< Host clock rate relative to RTC, minus one */
+
+static const nrfx_timer_t capture_timer = NRFX_TIMER_INSTANCE(CAPTURE_TIMER_IDX);
+static uint8_t capture_channel;
+static bool capture_ready = false;
 
 /*******************************************************************************
  * GLOBAL VARIABLES
@@ -71,9 +93,10 @@ static uint32_t tick_offset = 0; /**< Microsecs offset set at initial time */
 static void rtc_init(void);
 static void rtc_deinit(void);
 static void rtc_set_time(const uint64_t timestamp, const uint32_t us);
-static void rtc_get_time(uint64_t * p_timestamp, uint32_t * p_us);
+static uint64_t rtc_get_ticks(void);
 
 static void counter_top_value_cb(const struct device *dev, void *user_data);
+static void capture_timer_handler(nrf_timer_event_t event_type, void * p_context);
 
 /*******************************************************************************
  * GLOBAL FUNCTIONS
@@ -112,7 +135,170 @@ void CAL_SetTime(const uint64_t timestamp, const uint32_t us)
  */
 void CAL_GetTime(uint64_t *p_timestamp, uint32_t *p_us)
 {
-    rtc_get_time(p_timestamp, p_us);
+    CAL_TicksToTime(rtc_get_ticks(), p_timestamp, p_us);
+}
+
+/**
+ * @brief Return monotonic RTC ticks since calendar start, unaffected by
+ * CAL_SetTime. Cheap enough for hot paths, can be called from interrupts
+ * @return ticks at CAL_TICKS_PER_SEC
+ */
+uint64_t CAL_GetTicks64(void)
+{
+    return rtc_get_ticks();
+}
+
+/**
+ * @brief Convert ticks from CAL_GetTicks64 to calendar time
+ * @param[in] ticks monotonic ticks
+ * @param[out] p_timestamp Unix epoch
+ * @param[out] p_us microseconds
+ */
+void CAL_TicksToTime(uint64_t ticks, uint64_t * p_timestamp, uint32_t * p_us)
+{
+    atomic_val_t start;
+    uint64_t offset;
+    bool synced;
+    uint64_t ref_ticks;
+    int64_t ref_us;
+    int32_t skew_ppb;
+
+    do {
+        start = atomic_get(&seq);
+        offset = epoch_ticks;
+        synced = sync_enabled;
+        ref_ticks = sync_ref_ticks;
+        ref_us = sync_ref_us;
+        skew_ppb = sync_skew_ppb;
+    } while ((start & 1) || start != atomic_get(&seq));
+
+    if (synced)
+    {
+        /* Elapsed RTC time since reference, corrected by host clock rate */
+        int64_t elapsed_us = ((int64_t)(ticks - ref_ticks) * USEC_PER_SEC) / RTC_FREQUENCY;
+        int64_t time_us = ref_us + elapsed_us + (elapsed_us * skew_ppb) / 1000000000LL;
+        *p_timestamp = time_us / USEC_PER_SEC;
+        *p_us = time_us % USEC_PER_SEC;
+        return;
+    }
+
+    /* Unsigned wrap-around gives the right result whatever the offset sign */
+    uint64_t time = ticks + offset;
+    *p_timestamp = COUNTER_TO_SECS(time);
+    *p_us = COUNTER_TO_US(time & (RTC_FREQUENCY - 1));
+}
+
+/**
+ * @brief Follow host clock estimated by time synchronization, until next
+ * CAL_SetTime or CAL_ClearSync
+ * @param[in] ref_ticks reference instant from CAL_GetTicks64
+ * @param[in] ref_us host time at reference instant (Unix epoch in microseconds)
+ * @param[in] skew_ppb host clock rate relative to RTC minus one, in parts per billion
+ */
+void CAL_SetSync(uint64_t ref_ticks, int64_t ref_us, int32_t skew_ppb)
+{
+    unsigned int key = irq_lock();
+    atomic_inc(&seq);
+    sync_ref_ticks = ref_ticks;
+    sync_ref_us = ref_us;
+    sync_skew_ppb = skew_ppb;
+    sync_enabled = true;
+    atomic_inc(&seq);
+    irq_unlock(key);
+}
+
+/**
+ * @brief Stop following host clock, time goes on from last CAL_SetTime
+ */
+void CAL_ClearSync(void)
+{
+    unsigned int key = irq_lock();
+    atomic_inc(&seq);
+    sync_enabled = false;
+    atomic_inc(&seq);
+    irq_unlock(key);
+}
+
+/**
+ * @brief Route a peripheral event to time capture hardware. RTC2 cannot be
+ * captured on nRF52, so the event starts a 1 MHz TIMER through (D)PPI and the
+ * event time is the calendar time minus the TIMER count when it is read
+ * @param[in] event_address address of the event register to capture
+ * @return 0 on success, negative error code otherwise
+ */
+int CAL_CaptureInit(uint32_t event_address)
+{
+    nrfx_timer_config_t timer_cfg = NRFX_TIMER_DEFAULT_CONFIG(NRFX_MHZ_TO_HZ(1));
+    timer_cfg.bit_width = NRF_TIMER_BIT_WIDTH_32;
+
+    if (nrfx_timer_init(&capture_timer, &timer_cfg, capture_timer_handler) != NRFX_SUCCESS)
+    {
+        LOG_ERR("capture timer init failed");
+        return -EIO;
+    }
+    /* Leave timer powered on but stopped, to be started by event */
+    nrfx_timer_enable(&capture_timer);
+    nrfx_timer_pause(&capture_timer);
+
+    if (nrfx_gppi_channel_alloc(&capture_channel) != NRFX_SUCCESS)
+    {
+        LOG_ERR("no (D)PPI channel available for capture");
+        return -ENOMEM;
+    }
+    nrfx_gppi_channel_endpoints_setup(capture_channel, event_address,
+                                      nrfx_timer_task_address_get(&capture_timer, NRF_TIMER_TASK_START));
+    capture_ready = true;
+    return 0;
+}
+
+/**
+ * @brief Capture time of next occurrence of the event
+ */
+void CAL_CaptureArm(void)
+{
+    if (!capture_ready) {
+        return;
+    }
+    nrfx_timer_pause(&capture_timer);
+    nrfx_timer_clear(&capture_timer);
+    nrfx_gppi_channels_enable(BIT(capture_channel));
+}
+
+/**
+ * @brief Return calendar time of the event captured since arming, time is
+ * quantized by RTC tick only (~30 us)
+ * @param[in] delay_us known latency between the instant of interest and the event
+ * @param[out] p_timestamp Unix epoch of the instant
+ * @param[out] p_us microseconds of the instant
+ * @return 0 on success, -EAGAIN if event did not occur, -ENODEV if capture is not initialized
+ */
+int CAL_CaptureGet(uint32_t delay_us, uint64_t * p_timestamp, uint32_t * p_us)
+{
+    uint64_t timestamp;
+    uint32_t us;
+
+    if (!capture_ready) {
+        return -ENODEV;
+    }
+
+    /* Read both clocks as close as possible, convert afterwards */
+    unsigned int key = irq_lock();
+    uint32_t elapsed = nrfx_timer_capture(&capture_timer, CAPTURE_TIMER_CC);
+    uint64_t ticks = rtc_get_ticks();
+    irq_unlock(key);
+    CAL_TicksToTime(ticks, &timestamp, &us);
+
+    nrfx_gppi_channels_disable(BIT(capture_channel));
+    nrfx_timer_pause(&capture_timer);
+
+    if (elapsed == 0) {
+        return -EAGAIN;
+    }
+
+    int64_t time_us = (int64_t)timestamp * USEC_PER_SEC + us - elapsed - delay_us;
+    *p_timestamp = time_us / USEC_PER_SEC;
+    *p_us = time_us % USEC_PER_SEC;
+    return 0;
 }
 
 /*******************************************************************************
@@ -177,57 +363,56 @@ static void rtc_deinit(void)
 
 static void rtc_set_time(const uint64_t timestamp, const uint32_t us)
 {
-    int err;
-
-    if (counter_dev == NULL)
-    {
-        LOG_ERR("calendar counter does not exist");
-        return;
-    }
-
-    /* Reset counter to zero by setting top value */
-    err = counter_set_top_value(counter_dev, &top_cfg);
-    if (err != 0)
-    {
-        LOG_ERR("setting counter top value failed (code %d)", err);
-        return;
-    }
-
-    time_offset = timestamp;
-
-    float usecs = (float)(us);
-    float freq  = (float)(RTC_FREQUENCY);
-    tick_offset = (uint32_t)(usecs* freq * 0.000001f);
+    /* Counter keeps running, only wall clock offset changes */
+    uint64_t time = SECS_TO_COUNTER(timestamp) + US_TO_COUNTER(us);
+
+    unsigned int key = irq_lock();
+    uint64_t ticks = rtc_get_ticks();
+    atomic_inc(&seq);
+    epoch_ticks = time - ticks;
+    sync_enabled = false;
+    atomic_inc(&seq);
+    irq_unlock(key);
 }
 
-static void rtc_get_time(uint64_t * p_timestamp, uint32_t * p_us)
+/* Extended 64 bit counter, safe against counter wrap before its interrupt is served */
+static uint64_t rtc_get_ticks(void)
 {
-    int err;
+    atomic_val_t start;
+    uint32_t wraps;
+    uint32_t counter_value = 0;
+    bool pending;
 
     if (counter_dev == NULL)
     {
         LOG_ERR("calendar counter does not exist");
-        *p_timestamp = time_offset;
+        return 0;
     }
 
-    uint32_t counter_value;
-    err = counter_get_value(counter_dev, &counter_value);
-    if (err != 0)
-    {
-        LOG_ERR("reading counter failed (code %d)", err);
-        *p_timestamp = time_offset;
+    do {
+        start = atomic_get(&seq);
+        wraps = overflows;
+        counter_get_value(counter_dev, &counter_value);
+        pending = counter_get_pending_int(counter_dev) != 0;
+    } while ((start & 1) || start != atomic_get(&seq));
+
+    /* Counter wrapped but overflow interrupt did not run yet */
+    if (pending && counter_value < (config_info.max_top_value / 2)) {
+        wraps++;
     }
-    /* Add the original tick offset for microseconds */
-    counter_value += tick_offset;
-    uint32_t sec = COUNTER_TO_SECS(counter_value);
-    *p_timestamp = time_offset + sec;
-    uint64_t mod = counter_value - SECS_TO_COUNTER(sec);
-    *p_us = (uint32_t)(mod * 1000000ULL / RTC_FREQUENCY);
+
+    return (uint64_t)wraps * ((uint64_t)config_info.max_top_value + 1) + counter_value;
 }
 
 static void counter_top_value_cb(const struct device *dev, void *user_data)
 {
-    uint32_t time = COUNTER_TO_SECS((config_info.max_top_value + 1));
-    time_offset += time;
-    LOG_INF("counter loop %u ticks is %u secs", config_info.max_top_value, time);
+    atomic_inc(&seq);
+    overflows++;
+    atomic_inc(&seq);
+    LOG_DBG("counter loop %u ticks", config_info.max_top_value);
+}
+
+static void capture_timer_handler(nrf_timer_event_t event_type, void * p_context)
+{
+    /* No compare interrupt is enabled */
 }
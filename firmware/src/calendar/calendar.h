@@ -24,6 +24,8 @@ extern "C"
  * MACROS AND DEFINES
  ******************************************************************************/
 
+#define CAL_TICKS_PER_SEC   32768   /**< Resolution of CAL_GetTicks64 */
+
 /*******************************************************************************
  * TYPEDEFS
  ******************************************************************************/
@@ -40,6 +42,13 @@ void CAL_Init(void);
 void CAL_Deinit(void);
 void CAL_SetTime(const uint64_t timestamp, const uint32_t us);
 void CAL_GetTime(uint64_t * p_timestamp, uint32_t * p_us);
+uint64_t CAL_GetTicks64(void);
+void CAL_TicksToTime(uint64_t ticks, uint64_t * p_timestamp, uint32_t * p_us);
+void CAL_SetSync(uint64_t ref_ticks, int64_t ref_us, int32_t skew_ppb);
+void CAL_ClearSync(void);
+int CAL_CaptureInit(uint32_t event_address);
+void CAL_CaptureArm(void);
+int CAL_CaptureGet(uint32_t delay_us, uint64_t * p_timestamp, uint32_t * p_us);
 
 #ifdef __cplusplus
 }
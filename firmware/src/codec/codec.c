@@ -0,0 +1,168 @@
+/**
+ *******************************************************************************
+ * @file    codec.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Protobuf and COBS framing module source file
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <errno.h>
+#include <stdint.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+
+/* Application includes */
+#include "codec.h"
+#include "profile/profile.h"
+
+/*******************************************************************************
+ * EXTERN VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define LOG_MODULE_NAME codec
+LOG_MODULE_REGISTER(LOG_MODULE_NAME);
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+/* Protobuf output stream state, COBS time is told apart when profiling */
+typedef struct
+{
+    cobs_enc_ctx_t cobs;
+#if defined(CONFIG_APP_PROFILING)
+    uint32_t cobs_cycles;
+#endif
+} codec_stream_t;
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+static bool cobs_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count);
+
+/*******************************************************************************
+ * GLOBAL FUNCTIONS
+ ******************************************************************************/
+
+int CODEC_Encode(const pb_msgdesc_t * fields, const void * p_message,
+                 uint8_t * p_buffer, size_t size)
+{
+    codec_stream_t stream = {0};
+    unsigned length;
+
+    cobs_ret_t cobs_ret = cobs_encode_inc_begin(p_buffer, size, &stream.cobs);
+    if (cobs_ret != COBS_RET_SUCCESS) {
+        return -EINVAL;
+    }
+
+    /* Protobuf output is COBS encoded on the fly, so frames of any length need no copy */
+    pb_ostream_t ostream = {
+        .callback = cobs_write,
+        .state = &stream,
+        .max_size = SIZE_MAX,
+        .bytes_written = 0,
+    };
+
+    PROF_START(PROF_PB_ENCODE);
+    bool pb_ret = pb_encode(&ostream, fields, p_message);
+    PROF_ADD(PROF_PB_ENCODE, PROF_ELAPSED(PROF_PB_ENCODE) - stream.cobs_cycles);
+    if (pb_ret == false) {
+        LOG_ERR("Error while encoding protobuf : %s", PB_GET_ERROR(&ostream));
+        return -ENOMEM;
+    }
+
+    PROF_START(PROF_COBS);
+    cobs_ret = cobs_encode_inc_end(&stream.cobs, &length);
+    PROF_ACCUMULATE(PROF_COBS, stream.cobs_cycles);
+    PROF_ADD(PROF_COBS, stream.cobs_cycles);
+    if (cobs_ret != COBS_RET_SUCCESS) {
+        LOG_ERR("Error while encoding COBS message (err %u)", cobs_ret);
+        return -EINVAL;
+    }
+
+    return length;
+}
+
+int CODEC_EncodeMessage(const pb_msgdesc_t * fields, const void * p_message,
+                        uint8_t * p_buffer, size_t size)
+{
+    pb_ostream_t ostream = pb_ostream_from_buffer(p_buffer, size);
+
+    bool pb_ret = pb_encode(&ostream, fields, p_message);
+    if (pb_ret == false) {
+        LOG_ERR("Error while encoding protobuf : %s", PB_GET_ERROR(&ostream));
+        return -ENOMEM;
+    }
+
+    return ostream.bytes_written;
+}
+
+int CODEC_Decode(const pb_msgdesc_t * fields, void * p_message,
+                 uint8_t * p_buffer, size_t length)
+{
+    int ret = CODEC_Unframe(p_buffer, length);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return CODEC_DecodeMessage(fields, p_message, p_buffer + 1, ret);
+}
+
+int CODEC_Unframe(uint8_t * p_buffer, size_t length)
+{
+    /* Code byte and delimiter are left in place, message is in between */
+    cobs_ret_t cobs_ret = cobs_decode_inplace(p_buffer, length);
+    if (cobs_ret != COBS_RET_SUCCESS) {
+        LOG_ERR("error %d while decoding cobs", cobs_ret);
+        return -EINVAL;
+    }
+
+    return length - 2;
+}
+
+int CODEC_DecodeMessage(const pb_msgdesc_t * fields, void * p_message,
+                        const uint8_t * p_buffer, size_t length)
+{
+    pb_istream_t istream = pb_istream_from_buffer(p_buffer, length);
+    bool status = pb_decode(&istream, fields, p_message);
+    if (!status) {
+        LOG_ERR("protobuf decoding failed: %s", PB_GET_ERROR(&istream));
+        return -EBADMSG;
+    }
+
+    return 0;
+}
+
+/*******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
+
+/* Protobuf output stream callback */
+static bool cobs_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count)
+{
+    codec_stream_t * p_stream = stream->state;
+
+    PROF_START(PROF_COBS);
+    cobs_ret_t ret = cobs_encode_inc(&p_stream->cobs, buf, count);
+    PROF_ACCUMULATE(PROF_COBS, p_stream->cobs_cycles);
+    return (ret == COBS_RET_SUCCESS);
+}
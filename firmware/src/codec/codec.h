@@ -0,0 +1,101 @@
+/**
+ *******************************************************************************
+ * @file    codec.h
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Protobuf and COBS framing module header file
+ *******************************************************************************
+ */
+
+#ifndef __CODEC_H__
+#define __CODEC_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pb.h>
+#include "nanocobs/cobs.h"
+
+/*******************************************************************************
+ * MACROS AND DEFINES
+ ******************************************************************************/
+
+/**< Buffer size needed to frame a message of maximum encoded size msg_size */
+#define CODEC_BUFFER_SIZE(msg_size)     COBS_ENCODE_MAX(msg_size)
+
+/*******************************************************************************
+ * TYPEDEFS
+ ******************************************************************************/
+
+/*******************************************************************************
+ * EXPORTED VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/**
+ * @brief Encode a protobuf message into a COBS frame (zero delimiter included)
+ * @param [in]  fields protobuf message descriptor
+ * @param [in]  p_message message to encode
+ * @param [out] p_buffer output buffer of CODEC_BUFFER_SIZE(message max size)
+ * @param [in]  size output buffer size
+ * @return frame length in bytes, or negative error code
+ */
+int CODEC_Encode(const pb_msgdesc_t * fields, const void * p_message,
+                 uint8_t * p_buffer, size_t size);
+
+/**
+ * @brief Encode a bare protobuf message, e.g. for a GATT characteristic value
+ * @param [in]  fields protobuf message descriptor
+ * @param [in]  p_message message to encode
+ * @param [out] p_buffer output buffer of message max size
+ * @param [in]  size output buffer size
+ * @return message length in bytes, or negative error code
+ */
+int CODEC_EncodeMessage(const pb_msgdesc_t * fields, const void * p_message,
+                        uint8_t * p_buffer, size_t size);
+
+/**
+ * @brief Decode in place a COBS frame (zero delimiter included) into a protobuf message
+ * @param [in]  fields protobuf message descriptor
+ * @param [out] p_message decoded message
+ * @param [in]  p_buffer frame, modified by decoding
+ * @param [in]  length frame length
+ * @return 0 on success, or negative error code
+ */
+int CODEC_Decode(const pb_msgdesc_t * fields, void * p_message,
+                 uint8_t * p_buffer, size_t length);
+
+/**
+ * @brief Remove in place the COBS framing of a frame (zero delimiter included)
+ * @param [in]  p_buffer frame, message bytes start at p_buffer + 1 once done
+ * @param [in]  length frame length
+ * @return message length, or negative error code
+ */
+int CODEC_Unframe(uint8_t * p_buffer, size_t length);
+
+/**
+ * @brief Decode a bare protobuf message, as written to the ECG service or unframed
+ * @param [in]  fields protobuf message descriptor
+ * @param [out] p_message decoded message
+ * @param [in]  p_buffer message bytes, without COBS framing
+ * @param [in]  length message length
+ * @return 0 on success, or negative error code
+ */
+int CODEC_DecodeMessage(const pb_msgdesc_t * fields, void * p_message,
+                        const uint8_t * p_buffer, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CODEC_H__ */
@@ -0,0 +1,134 @@
+/**
+ *******************************************************************************
+ * @file    decimator.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Polyphase FIR decimator module source file
+ *
+ * Anti-aliasing filters are Hamming windowed-sinc FIR designed for 512 Hz
+ * input. Only one output every factor inputs is computed, which is the
+ * polyphase form of the decimating filter: each input sample costs
+ * taps / factor multiply-accumulates.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <errno.h>
+#include <string.h>
+
+/* Application includes */
+#include "decimator.h"
+
+/*******************************************************************************
+ * EXTERN VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+/* 512 -> 256 Hz, cut-off 84 Hz, -50 dB at 128 Hz */
+static const int16_t coeffs_2[24] = {
+    -48, -95, -58, 171, 455, 291, -626, -1609, -1082, 2008, 6708, 10270,
+    10268, 6708, 2008, -1082, -1609, -626, 291, 455, 171, -58, -95, -48
+};
+
+/* 512 -> 128 Hz, cut-off 48 Hz, -21 dB at 64 Hz, -65 dB above 100 Hz */
+static const int16_t coeffs_4[32] = {
+    16, 50, 90, 119, 95, -29, -264, -551, -748, -666, -138, 896, 2332, 3904, 5251, 6028,
+    6026, 5251, 3904, 2332, 896, -138, -666, -748, -551, -264, -29, 95, 119, 90, 50, 16
+};
+
+/*******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTIONS
+ ******************************************************************************/
+
+int DECIM_Init(decimator_t * p_decim, uint8_t factor)
+{
+    switch (factor)
+    {
+        case 1:
+            p_decim->p_coeffs = NULL;
+            p_decim->taps = 0;
+            break;
+        case 2:
+            p_decim->p_coeffs = coeffs_2;
+            p_decim->taps = sizeof(coeffs_2) / sizeof(coeffs_2[0]);
+            break;
+        case 4:
+            p_decim->p_coeffs = coeffs_4;
+            p_decim->taps = sizeof(coeffs_4) / sizeof(coeffs_4[0]);
+            break;
+        default:
+            return -EINVAL;
+    }
+    p_decim->factor = factor;
+    DECIM_Reset(p_decim);
+    return 0;
+}
+
+void DECIM_Reset(decimator_t * p_decim)
+{
+    p_decim->phase = 0;
+    p_decim->pos = 0;
+    memset(p_decim->history, 0, sizeof(p_decim->history));
+}
+
+size_t DECIM_Process(decimator_t * p_decim, const int16_t * p_in, size_t count, int16_t * p_out)
+{
+    size_t num_out = 0;
+
+    if (p_decim->factor == 1)
+    {
+        memcpy(p_out, p_in, count * sizeof(int16_t));
+        return count;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        /* History is duplicated so that the latest taps are always contiguous */
+        p_decim->pos = (p_decim->pos == 0) ? (p_decim->taps - 1) : (p_decim->pos - 1);
+        p_decim->history[p_decim->pos] = p_in[i];
+        p_decim->history[p_decim->pos + p_decim->taps] = p_in[i];
+
+        if (++p_decim->phase < p_decim->factor) {
+            continue;
+        }
+        p_decim->phase = 0;
+
+        const int16_t * p_x = &p_decim->history[p_decim->pos];
+        int32_t acc = 1 << 14;
+        for (uint8_t k = 0; k < p_decim->taps; k++) {
+            acc += (int32_t)p_decim->p_coeffs[k] * p_x[k];
+        }
+        acc >>= 15;
+        p_out[num_out++] = (acc > INT16_MAX) ? INT16_MAX : ((acc < INT16_MIN) ? INT16_MIN : acc);
+    }
+
+    return num_out;
+}
+
+uint32_t DECIM_GetDelay2(const decimator_t * p_decim)
+{
+    return (p_decim->taps == 0) ? 0 : (p_decim->taps - 1);
+}
+
+/*******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
@@ -0,0 +1,88 @@
+/**
+ *******************************************************************************
+ * @file    decimator.h
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Polyphase FIR decimator module header file
+ *******************************************************************************
+ */
+
+#ifndef __DECIMATOR_H__
+#define __DECIMATOR_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*******************************************************************************
+ * MACROS AND DEFINES
+ ******************************************************************************/
+
+#define DECIM_MAX_TAPS      32      /**< Longest anti-aliasing filter */
+
+/*******************************************************************************
+ * TYPEDEFS
+ ******************************************************************************/
+
+/* Decimator instance, one per output rate */
+typedef struct
+{
+    const int16_t * p_coeffs;               /**< Q15 anti-aliasing filter */
+    uint8_t         factor;                 /**< Decimation factor (1 is pass-through) */
+    uint8_t         taps;                   /**< Filter length */
+    uint8_t         phase;                  /**< Input samples since last output */
+    uint8_t         pos;                    /**< History write position */
+    int16_t         history[2 * DECIM_MAX_TAPS];
+} decimator_t;
+
+/*******************************************************************************
+ * EXPORTED VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/**
+ * @brief Initialize a decimator for a given factor
+ * @param [out] p_decim decimator instance
+ * @param [in]  factor decimation factor (1, 2 or 4)
+ * @return 0 on success, -EINVAL if factor is not supported
+ */
+int DECIM_Init(decimator_t * p_decim, uint8_t factor);
+
+/**
+ * @brief Clear filter history, next output is computed after factor inputs
+ * @param [in] p_decim decimator instance
+ */
+void DECIM_Reset(decimator_t * p_decim);
+
+/**
+ * @brief Filter and decimate consecutive samples
+ * @param [in]  p_decim decimator instance
+ * @param [in]  p_in input samples
+ * @param [in]  count number of input samples
+ * @param [out] p_out output samples, room for (count / factor + 1) samples
+ * @return number of output samples
+ */
+size_t DECIM_Process(decimator_t * p_decim, const int16_t * p_in, size_t count, int16_t * p_out);
+
+/**
+ * @brief Filter group delay
+ * @param [in] p_decim decimator instance
+ * @return delay in half input samples (filters are symmetric with any length)
+ */
+uint32_t DECIM_GetDelay2(const decimator_t * p_decim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DECIMATOR_H__ */
@@ -0,0 +1,96 @@
+/**
+ *******************************************************************************
+ * @file    leads.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Lead status changes module source file
+ *
+ * Lead-off comparators interrupt at any time. Changes are located at the
+ * first sample acquired after them, then coded in each output frame as
+ * (samples since previous change or frame start, new status) pairs.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <stdint.h>
+#include <stddef.h>
+
+/* Application includes */
+#include "leads.h"
+
+/*******************************************************************************
+ * EXTERN VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTIONS
+ ******************************************************************************/
+
+size_t LEADS_Locate(const leads_event_t * p_events, size_t event_count, int64_t start_ticks,
+                    uint32_t interval, uint16_t samples, uint16_t lodpn, leads_change_t * p_changes)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < event_count; i++)
+    {
+        int64_t elapsed = p_events[i].ticks - start_ticks;
+        uint32_t index = (elapsed <= 0) ? 0 : (elapsed + interval - 1) / interval;
+        if (index >= samples) {
+            break;
+        }
+        if (p_events[i].lodpn == lodpn) {
+            continue;
+        }
+        lodpn = p_events[i].lodpn;
+        p_changes[count].index = index;
+        p_changes[count].lodpn = lodpn;
+        count++;
+    }
+    return count;
+}
+
+void LEADS_Begin(leads_runs_t * p_runs, uint32_t * p_storage, size_t size)
+{
+    p_runs->p_runs = p_storage;
+    p_runs->size = size;
+    p_runs->count = 0;
+    p_runs->last_change = 0;
+}
+
+void LEADS_Add(leads_runs_t * p_runs, uint16_t index, uint16_t lodpn)
+{
+    if (p_runs->count + 2 <= p_runs->size)
+    {
+        p_runs->p_runs[p_runs->count++] = index - p_runs->last_change;
+        p_runs->p_runs[p_runs->count++] = lodpn;
+        p_runs->last_change = index;
+    }
+    else if (p_runs->count > 0) {
+        /* Too many changes, last run is considered off until end of frame */
+        p_runs->p_runs[p_runs->count - 1] |= lodpn;
+    }
+}
+
+/*******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
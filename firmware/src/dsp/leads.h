@@ -0,0 +1,100 @@
+/**
+ *******************************************************************************
+ * @file    leads.h
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Lead status changes module header file
+ *******************************************************************************
+ */
+
+#ifndef __LEADS_H__
+#define __LEADS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*******************************************************************************
+ * MACROS AND DEFINES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * TYPEDEFS
+ ******************************************************************************/
+
+/* Lead status change, as timed by the lead-off interrupt */
+typedef struct
+{
+    int64_t  ticks;         /**< Uptime of the change */
+    uint16_t lodpn;         /**< New status */
+} leads_event_t;
+
+/* Lead status change within an acquisition buffer */
+typedef struct
+{
+    uint16_t index;         /**< First sample with new status */
+    uint16_t lodpn;         /**< New status */
+} leads_change_t;
+
+/* Run-length coded changes of a frame, as (run length, new status) pairs */
+typedef struct
+{
+    uint32_t * p_runs;      /**< Pairs storage */
+    size_t     size;        /**< Room in p_runs (values) */
+    size_t     count;       /**< Values in p_runs */
+    uint16_t   last_change; /**< Sample index where current run started */
+} leads_runs_t;
+
+/*******************************************************************************
+ * EXPORTED VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/**
+ * @brief Locate timed status changes at samples of a buffer, a change applies
+ * from the next sample
+ * @param [in]  p_events changes in time order
+ * @param [in]  event_count number of changes
+ * @param [in]  start_ticks uptime of the first sample of the buffer
+ * @param [in]  interval sample interval (ticks)
+ * @param [in]  samples buffer length
+ * @param [in]  lodpn status at first sample
+ * @param [out] p_changes changes within the buffer, room for event_count
+ * @return number of changes, changes to the current status are skipped and
+ * changes after the buffer are left to the status of the next one
+ */
+size_t LEADS_Locate(const leads_event_t * p_events, size_t event_count, int64_t start_ticks,
+                    uint32_t interval, uint16_t samples, uint16_t lodpn, leads_change_t * p_changes);
+
+/**
+ * @brief Start coding the changes of a new frame
+ * @param [out] p_runs frame changes
+ * @param [in]  p_storage pairs storage
+ * @param [in]  size room in p_storage (values, even)
+ */
+void LEADS_Begin(leads_runs_t * p_runs, uint32_t * p_storage, size_t size);
+
+/**
+ * @brief Append a status change to the changes of a frame, once they are full
+ * the last run is considered off with every status seen until frame end
+ * @param [in] p_runs frame changes
+ * @param [in] index sample index of new status in frame
+ * @param [in] lodpn new status
+ */
+void LEADS_Add(leads_runs_t * p_runs, uint16_t index, uint16_t lodpn);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LEADS_H__ */
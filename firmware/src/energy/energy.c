@@ -0,0 +1,150 @@
+/**
+ *******************************************************************************
+ * @file    energy.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Energy accounting module source file
+ *
+ * Battery charge is integrated from fuel gauge average current between two
+ * readings, and divided by the samples transmitted meanwhile. Subsystems add
+ * their active time, which gives the share of that charge they draw from
+ * typical currents, the rest being the idle floor (sleep, analog front end,
+ * LEDs). Both figures per sample let firmware changes be compared whatever
+ * the sample rate.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+
+/* Application includes */
+#include "energy.h"
+
+/*******************************************************************************
+ * EXTERN VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+/* Typical currents while active, nRF52840 datasheet at 3 V with DC/DC (uA) */
+#define ENERGY_ADC_CURRENT_UA       700     /**< SAADC converting */
+#define ENERGY_CPU_CURRENT_UA       3300    /**< CPU running from flash at 64 MHz */
+#define ENERGY_RADIO_TX_CURRENT_UA  4800    /**< Radio transmitting at 0 dBm */
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+static const uint32_t active_current_ua[NUM_OF_ENERGY_DOMAINS] = {
+    [ENERGY_ADC]      = ENERGY_ADC_CURRENT_UA,
+    [ENERGY_CPU]      = ENERGY_CPU_CURRENT_UA,
+    [ENERGY_RADIO_TX] = ENERGY_RADIO_TX_CURRENT_UA,
+};
+
+static atomic_t active_us[NUM_OF_ENERGY_DOMAINS];
+static atomic_t samples;
+
+/* Previous fuel gauge reading, period starts there */
+static int64_t last_update_ms;
+static int32_t last_current_ua;
+
+/* Last report, written from fuel gauge work and read from send and Bluetooth threads */
+static struct k_spinlock report_lock;
+static Energy report;
+
+/*******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTIONS
+ ******************************************************************************/
+
+void ENERGY_AddActive(energy_domain_t domain, uint32_t time_us)
+{
+    if (domain < NUM_OF_ENERGY_DOMAINS && time_us != 0) {
+        atomic_add(&active_us[domain], time_us);
+    }
+}
+
+void ENERGY_AddSamples(uint32_t count)
+{
+    if (count != 0) {
+        atomic_add(&samples, count);
+    }
+}
+
+void ENERGY_Update(int32_t avg_current_ua)
+{
+    int64_t now = k_uptime_get();
+    Energy energy = Energy_init_zero;
+    uint32_t time_us[NUM_OF_ENERGY_DOMAINS];
+    uint64_t active_uc = 0;
+
+    /* Counters restart with the period, whatever happens to this one */
+    for (uint8_t i = 0; i < NUM_OF_ENERGY_DOMAINS; i++) {
+        time_us[i] = atomic_clear(&active_us[i]);
+        active_uc += ((uint64_t)time_us[i] * active_current_ua[i]) / USEC_PER_SEC;
+    }
+    uint32_t count = atomic_clear(&samples);
+
+    bool first = (last_update_ms == 0);
+    int64_t period_ms = now - last_update_ms;
+    int32_t previous_ua = last_current_ua;
+    last_update_ms = now;
+    last_current_ua = avg_current_ua;
+    if (first || period_ms <= 0) {
+        return;
+    }
+
+    /* Average current is sampled once per period, trapezoid between readings,
+     * charging periods count as no consumption */
+    int64_t drawn_ua = -((int64_t)avg_current_ua + previous_ua) / 2;
+    drawn_ua = MAX(drawn_ua, 0);
+
+    energy.period_ms = period_ms;
+    energy.current_ua = drawn_ua;
+    energy.charge_uc = (drawn_ua * period_ms) / MSEC_PER_SEC;
+    energy.samples_sent = count;
+    energy.adc_active_us = time_us[ENERGY_ADC];
+    energy.cpu_active_us = time_us[ENERGY_CPU];
+    energy.radio_tx_us = time_us[ENERGY_RADIO_TX];
+    energy.active_uc = active_uc;
+    if (count > 0)
+    {
+        energy.uc_per_sample = (float)energy.charge_uc / count;
+        energy.active_uc_per_sample = (float)active_uc / count;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&report_lock);
+    energy.sequence = report.sequence + 1;
+    report = energy;
+    k_spin_unlock(&report_lock, key);
+}
+
+bool ENERGY_Get(Energy * p_energy)
+{
+    k_spinlock_key_t key = k_spin_lock(&report_lock);
+    *p_energy = report;
+    k_spin_unlock(&report_lock, key);
+
+    return (p_energy->sequence != 0);
+}
+
+/*******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
@@ -0,0 +1,82 @@
+/**
+ *******************************************************************************
+ * @file    energy.h
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Energy accounting module header file
+ *******************************************************************************
+ */
+
+#ifndef __ENERGY_H__
+#define __ENERGY_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "protocol/protocol.pb.h"
+
+/*******************************************************************************
+ * MACROS AND DEFINES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * TYPEDEFS
+ ******************************************************************************/
+
+/* Subsystems whose active time is accounted */
+typedef enum
+{
+    ENERGY_ADC = 0,         /**< SAADC conversions, acquisition time included */
+    ENERGY_CPU,             /**< Processing pipeline (beat detection, decimation, encoding) */
+    ENERGY_RADIO_TX,        /**< Notifications air time, link layer overhead included */
+    NUM_OF_ENERGY_DOMAINS,
+} energy_domain_t;
+
+/*******************************************************************************
+ * EXPORTED VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/**
+ * @brief Add active time of a subsystem, can be called from any context
+ * @param [in] domain subsystem
+ * @param [in] time_us active time in microseconds
+ */
+void ENERGY_AddActive(energy_domain_t domain, uint32_t time_us);
+
+/**
+ * @brief Add samples transmitted, can be called from any context
+ * @param [in] count samples in frames accepted by Bluetooth module
+ */
+void ENERGY_AddSamples(uint32_t count);
+
+/**
+ * @brief Close accounting period on a fuel gauge reading, next report covers
+ * time since previous reading. First call only starts the period.
+ * @param [in] avg_current_ua fuel gauge average current, negative when discharging
+ */
+void ENERGY_Update(int32_t avg_current_ua);
+
+/**
+ * @brief Get last report
+ * @param [out] p_energy report, sequence tells a new one from previous one
+ * @return false if no period was closed yet
+ */
+bool ENERGY_Get(Energy * p_energy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ENERGY_H__ */
@@ -0,0 +1,212 @@
+/**
+ *******************************************************************************
+ * @file    history.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Sent frames history module source file
+ *
+ * Encoded frames are written one after the other in a byte ring, and indexed
+ * by sequence number. An index entry is valid as long as its bytes were not
+ * overwritten, which is checked from the total number of bytes written.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+/* Application includes */
+#include "stats/stats.h"
+#include "history.h"
+
+/*******************************************************************************
+ * EXTERN VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define LOG_MODULE_NAME history
+LOG_MODULE_REGISTER(LOG_MODULE_NAME);
+
+#define HIST_MAX_RANGES     8       /**< Pending retransmission requests */
+
+BUILD_ASSERT((HIST_MAX_FRAMES & (HIST_MAX_FRAMES - 1)) == 0, "Index size must be a power of 2");
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+/* Stored frame */
+typedef struct
+{
+    uint32_t sequence;
+    uint32_t position;      /**< Bytes written before this frame */
+    uint16_t length;        /**< 0 if entry is unused */
+} hist_entry_t;
+
+/* Requested frames */
+typedef struct
+{
+    uint32_t first;
+    uint32_t count;
+} hist_range_t;
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+static uint8_t buffer[HIST_BUFFER_SIZE];
+static uint32_t written;
+static hist_entry_t entries[HIST_MAX_FRAMES];
+
+/* Requests come from any context, frames are stored and copied from the send workqueue */
+static hist_range_t ranges[HIST_MAX_RANGES];
+static uint8_t range_count;
+static bool deferred;               /**< Next frame did not fit in previous call */
+static uint32_t deferred_sequence;
+static struct k_spinlock range_lock;
+
+/*******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+static const hist_entry_t * find_frame(uint32_t sequence);
+
+/*******************************************************************************
+ * GLOBAL FUNCTIONS
+ ******************************************************************************/
+
+void HIST_Reset(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&range_lock);
+    range_count = 0;
+    deferred = false;
+    k_spin_unlock(&range_lock, key);
+
+    memset(entries, 0, sizeof(entries));
+    written = 0;
+}
+
+void HIST_Store(uint32_t sequence, const uint8_t * p_frame, uint16_t length)
+{
+    if (length == 0 || length > HIST_BUFFER_SIZE) {
+        return;
+    }
+
+    hist_entry_t * p_entry = &entries[sequence & (HIST_MAX_FRAMES - 1)];
+    p_entry->sequence = sequence;
+    p_entry->position = written;
+    p_entry->length = length;
+
+    /* Frame may wrap around end of buffer */
+    size_t offset = written % HIST_BUFFER_SIZE;
+    size_t first_part = MIN(length, HIST_BUFFER_SIZE - offset);
+    memcpy(&buffer[offset], p_frame, first_part);
+    memcpy(buffer, p_frame + first_part, length - first_part);
+    written += length;
+}
+
+int HIST_Request(uint32_t first, uint32_t count)
+{
+    int err = 0;
+
+    if (count == 0) {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&range_lock);
+    if (range_count < HIST_MAX_RANGES)
+    {
+        ranges[range_count].first = first;
+        ranges[range_count].count = MIN(count, HIST_MAX_FRAMES);
+        range_count++;
+    }
+    else {
+        err = -ENOMEM;
+    }
+    k_spin_unlock(&range_lock, key);
+
+    if (err != 0) {
+        LOG_ERR("Too many retransmissions pending, frames %u to %u ignored", first, first + count - 1);
+    }
+    return err;
+}
+
+int HIST_Next(uint8_t * p_buffer, size_t size)
+{
+    const hist_entry_t * p_found = NULL;
+    uint32_t missed = 0;
+
+    k_spinlock_key_t key = k_spin_lock(&range_lock);
+    while (range_count > 0 && p_found == NULL)
+    {
+        uint32_t sequence = ranges[0].first;
+        const hist_entry_t * p_entry = find_frame(sequence);
+        if (p_entry != NULL && p_entry->length > size)
+        {
+            /* Kept for one transfer with more room, then given up */
+            if (!deferred || deferred_sequence != sequence)
+            {
+                deferred = true;
+                deferred_sequence = sequence;
+                break;
+            }
+            LOG_WRN("Frame %u of %u bytes too long to resend", sequence, p_entry->length);
+            p_entry = NULL;
+        }
+        deferred = false;
+
+        if (p_entry == NULL) {
+            missed++;
+        } else {
+            p_found = p_entry;
+        }
+
+        ranges[0].first++;
+        if (--ranges[0].count == 0)
+        {
+            range_count--;
+            memmove(&ranges[0], &ranges[1], range_count * sizeof(hist_range_t));
+        }
+    }
+    k_spin_unlock(&range_lock, key);
+
+    STATS_Add(STATS_RESEND_MISSED, missed);
+    if (p_found == NULL) {
+        return 0;
+    }
+
+    /* Frames are stored from the same thread, entry is not overwritten meanwhile */
+    size_t offset = p_found->position % HIST_BUFFER_SIZE;
+    size_t first_part = MIN(p_found->length, HIST_BUFFER_SIZE - offset);
+    memcpy(p_buffer, &buffer[offset], first_part);
+    memcpy(p_buffer + first_part, buffer, p_found->length - first_part);
+    return p_found->length;
+}
+
+/*******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
+
+/* Stored frame with this sequence, NULL if it was never stored or was overwritten */
+static const hist_entry_t * find_frame(uint32_t sequence)
+{
+    const hist_entry_t * p_entry = &entries[sequence & (HIST_MAX_FRAMES - 1)];
+
+    if (p_entry->length == 0 || p_entry->sequence != sequence ||
+        written - p_entry->position > HIST_BUFFER_SIZE) {
+        return NULL;
+    }
+    return p_entry;
+}
@@ -0,0 +1,79 @@
+/**
+ *******************************************************************************
+ * @file    history.h
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Sent frames history module header file
+ *******************************************************************************
+ */
+
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*******************************************************************************
+ * MACROS AND DEFINES
+ ******************************************************************************/
+
+#define HIST_BUFFER_SIZE    CONFIG_APP_HISTORY_SIZE /**< Encoded frames memory */
+#define HIST_MAX_FRAMES     512     /**< Frames indexed, power of 2 */
+
+/*******************************************************************************
+ * TYPEDEFS
+ ******************************************************************************/
+
+/*******************************************************************************
+ * EXPORTED VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/**
+ * @brief Forget stored frames and pending requests, when sequence restarts
+ */
+void HIST_Reset(void);
+
+/**
+ * @brief Keep an encoded frame, overwriting oldest ones, from the thread
+ * calling HIST_Next()
+ * @param [in] sequence frame sequence number
+ * @param [in] p_frame complete COBS frame
+ * @param [in] length frame length
+ */
+void HIST_Store(uint32_t sequence, const uint8_t * p_frame, uint16_t length);
+
+/**
+ * @brief Queue a range of frames to resend, can be called from any context
+ * @param [in] first sequence of first frame
+ * @param [in] count number of consecutive frames
+ * @return 0 on success, -EINVAL on empty range, -ENOMEM if too many ranges are pending
+ */
+int HIST_Request(uint32_t first, uint32_t count);
+
+/**
+ * @brief Copy next requested frame still in history, frames already
+ * overwritten are skipped and counted in stats
+ * @param [out] p_buffer destination
+ * @param [in] size space left in destination, a frame that does not fit is
+ * kept for next call once, then skipped and counted in stats
+ * @return frame length, 0 if no frame is pending or next one does not fit
+ */
+int HIST_Next(uint8_t * p_buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HISTORY_H__ */
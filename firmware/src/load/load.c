@@ -0,0 +1,203 @@
+/**
+ *******************************************************************************
+ * @file    load.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   CPU load and stacks module source file
+ *
+ * Thread CPU time comes from kernel runtime statistics, counted with the
+ * system clock (RTC, ~30 us steps), which averages out over a report period.
+ * Interrupt handlers are too short for it and are timed with the CPU cycle
+ * counter instead, through user tracing hooks (overlay-trace.conf, figures
+ * stay 0 otherwise). Controller zero latency
+ * interrupts bypass these hooks and are not counted. Stack high-water marks
+ * are found from the unused part of each stack, filled with a pattern at
+ * thread start (CONFIG_INIT_STACKS).
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <stdint.h>
+#include <string.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+#include <cmsis_core.h>
+#if defined(CONFIG_TRACING_USER)
+#include <tracing_user.h>
+#endif
+
+/* Application includes */
+#include "load.h"
+
+/*******************************************************************************
+ * EXTERN VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define LOAD_MAX_THREADS    ARRAY_SIZE(((SystemLoad *)0)->threads)
+#define LOAD_PERMILLE       1000
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+/* Thread execution time at previous report */
+typedef struct
+{
+    const struct k_thread * thread;
+    uint64_t cycles;
+} load_thread_t;
+
+/* Report being built while walking the threads */
+typedef struct
+{
+    SystemLoad *  p_load;
+    load_thread_t current[LOAD_MAX_THREADS];
+    uint64_t      period_ns;
+} load_walk_t;
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+static load_thread_t previous[LOAD_MAX_THREADS];
+static int64_t  last_ticks;
+static uint64_t last_total_cycles;
+
+/* Interrupt handlers time, in CPU cycles */
+static uint8_t  isr_depth;
+static uint32_t isr_start;
+static atomic_t isr_cycles;
+static atomic_t isr_count;
+static atomic_t isr_max_cycles;
+
+static load_walk_t walk;
+
+/*******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+static void thread_add(const struct k_thread * thread, void * user_data);
+static uint32_t permille(uint64_t part_ns, uint64_t period_ns);
+
+/*******************************************************************************
+ * GLOBAL FUNCTIONS
+ ******************************************************************************/
+
+void LOAD_Init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void LOAD_Get(SystemLoad * p_load)
+{
+    k_thread_runtime_stats_t all;
+    int64_t now = k_uptime_ticks();
+
+    memset(p_load, 0, sizeof(*p_load));
+    walk.p_load = p_load;
+    walk.period_ns = k_ticks_to_ns_floor64(now - last_ticks);
+    p_load->period_ms = k_ticks_to_ms_floor64(now - last_ticks);
+    last_ticks = now;
+
+    /* All threads but idle */
+    k_thread_runtime_stats_all_get(&all);
+    p_load->cpu_permille = permille(k_cyc_to_ns_floor64(all.total_cycles - last_total_cycles), walk.period_ns);
+    last_total_cycles = all.total_cycles;
+
+    uint32_t cycles = atomic_clear(&isr_cycles);
+    p_load->isr_permille = permille(((uint64_t)cycles * NSEC_PER_SEC) / SystemCoreClock, walk.period_ns);
+    p_load->isr_count = atomic_clear(&isr_count);
+    p_load->isr_max_us = ((uint64_t)atomic_clear(&isr_max_cycles) * USEC_PER_SEC) / SystemCoreClock;
+
+    /* Stacks are scanned, threads are not locked meanwhile */
+    memset(walk.current, 0, sizeof(walk.current));
+    k_thread_foreach_unlocked(thread_add, &walk);
+    memcpy(previous, walk.current, sizeof(previous));
+}
+
+#if defined(CONFIG_TRACING_USER)
+/* Nested interrupts are counted in the outer one */
+void sys_trace_isr_enter_user(int nested_interrupts)
+{
+    if (isr_depth++ == 0) {
+        isr_start = DWT->CYCCNT;
+    }
+}
+
+void sys_trace_isr_exit_user(int nested_interrupts)
+{
+    if (isr_depth == 0 || --isr_depth != 0) {
+        return;
+    }
+
+    uint32_t cycles = DWT->CYCCNT - isr_start;
+    atomic_add(&isr_cycles, cycles);
+    atomic_inc(&isr_count);
+    if (cycles > (uint32_t)atomic_get(&isr_max_cycles)) {
+        atomic_set(&isr_max_cycles, cycles);
+    }
+}
+#endif
+
+/*******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
+
+static void thread_add(const struct k_thread * thread, void * user_data)
+{
+    load_walk_t * p_walk = user_data;
+    SystemLoad * p_load = p_walk->p_load;
+    k_thread_runtime_stats_t stats;
+    uint64_t last = 0;
+
+    if (p_load->threads_count >= LOAD_MAX_THREADS) {
+        return;
+    }
+    ThreadLoad * p_thread = &p_load->threads[p_load->threads_count];
+    load_thread_t * p_current = &p_walk->current[p_load->threads_count];
+    p_load->threads_count++;
+
+    const char * name = k_thread_name_get((k_tid_t)thread);
+    strncpy(p_thread->name, (name != NULL) ? name : "", sizeof(p_thread->name) - 1);
+
+    /* Thread started since previous report counts from its start */
+    k_thread_runtime_stats_get((k_tid_t)thread, &stats);
+    for (uint8_t i = 0; i < LOAD_MAX_THREADS; i++)
+    {
+        if (previous[i].thread == thread) {
+            last = previous[i].cycles;
+            break;
+        }
+    }
+    p_current->thread = thread;
+    p_current->cycles = stats.execution_cycles;
+    p_thread->cpu_permille = permille(k_cyc_to_ns_floor64(stats.execution_cycles - last), p_walk->period_ns);
+
+#if defined(CONFIG_INIT_STACKS) && defined(CONFIG_THREAD_STACK_INFO)
+    size_t unused;
+    if (k_thread_stack_space_get(thread, &unused) == 0)
+    {
+        p_thread->stack_size = thread->stack_info.size;
+        p_thread->stack_used = thread->stack_info.size - unused;
+    }
+#endif
+}
+
+static uint32_t permille(uint64_t part_ns, uint64_t period_ns)
+{
+    if (period_ns == 0) {
+        return 0;
+    }
+    return MIN((part_ns * LOAD_PERMILLE) / period_ns, LOAD_PERMILLE);
+}
@@ -0,0 +1,57 @@
+/**
+ *******************************************************************************
+ * @file    load.h
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   CPU load and stacks module header file
+ *******************************************************************************
+ */
+
+#ifndef __LOAD_H__
+#define __LOAD_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+#include <stdint.h>
+
+#include "protocol/protocol.pb.h"
+
+/*******************************************************************************
+ * MACROS AND DEFINES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * TYPEDEFS
+ ******************************************************************************/
+
+/*******************************************************************************
+ * EXPORTED VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/**
+ * @brief Start the CPU cycle counter timing interrupt handlers
+ */
+void LOAD_Init(void);
+
+/**
+ * @brief Get CPU shares of threads and interrupts since previous call (or
+ * boot), and stack high-water marks, then start a new period
+ * @param [out] p_load report, threads beyond its capacity are left out
+ */
+void LOAD_Get(SystemLoad * p_load);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOAD_H__ */
@@ -20,14 +20,23 @@
 #include <zephyr/settings/settings.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/sensor.h>
+#include <zephyr/pm/device_runtime.h>
 #include <zephyr/bluetooth/services/bas.h>
-#include <pb_decode.h>
 
 /* Application includes */
 #include "bluetooth/bluetooth.h"
 #include "calendar/calendar.h"
 #include "measurement.h"
-#include "nanocobs/cobs.h"
+#include "codec/codec.h"
+#include "timesync/timesync.h"
+#include "stats/stats.h"
+#include "history/history.h"
+#include "recorder/recorder.h"
+#include "broadcast/broadcast.h"
+#include "scheduler/scheduler.h"
+#include "energy/energy.h"
+#include "load/load.h"
+#include "profile/profile.h"
 
 /* Generated headers */
 #include "protocol/protocol.pb.h"
@@ -44,10 +53,12 @@
 #define LOG_MODULE_NAME main
 LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 
-#define MEASUREMENT_THREAD_PRIORITY	    -1
+#define MEASUREMENT_THREAD_PRIORITY	    -3      /**< Above send workqueue, ADC is restarted at once */
+#define RECORDER_THREAD_PRIORITY        7
 
 #define RGB_LED_BLINK_PERIOD            500     // ms
 #define RUN_SLEEP_INTERVAL              60000   // ms
+#define RX_REQUEST_COUNT                4       /**< Requests waiting for the workqueue */
 
 /*******************************************************************************
  * PRIVATE TYPEDEFS
@@ -56,6 +67,7 @@ LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 /* Application states enumeration */
 typedef enum
 {
+    APP_STATE_IDLE,
     APP_STATE_MEASURING,
     NUM_OF_APP_STATES,
 } app_state_t;
@@ -69,14 +81,27 @@ typedef enum
     NUM_OF_USB_STATES,
 } usb_state_t;
 
+/* Request received from a central, decoded in place on the workqueue */
+typedef struct
+{
+    uint64_t rx_ticks;      /**< Reception time, for time synchronization requests */
+    uint16_t length;
+    uint8_t  link;
+    bool     framed;        /**< COBS frame from NUS, bare message from ECG service */
+    uint8_t  data[CODEC_BUFFER_SIZE(MAX(Command_size, Timestamp_size))];
+} rx_request_t;
+
 /*******************************************************************************
  * GLOBAL VARIABLES
  ******************************************************************************/
 
-K_THREAD_STACK_DEFINE(measurement_stack_area, 512);
+K_THREAD_STACK_DEFINE(measurement_stack_area, CONFIG_APP_MEAS_THREAD_STACK_SIZE);
 struct k_thread measurement_thread;
 k_tid_t measurement_thread_tid;
 
+K_THREAD_STACK_DEFINE(recorder_stack_area, 1024);
+struct k_thread recorder_thread;
+
 K_THREAD_STACK_DEFINE(status_stack_area, 512);
 struct k_thread status_thread;
 
@@ -84,17 +109,24 @@ struct k_thread status_thread;
  * STATIC FUNCTION PROTOTYPES
  ******************************************************************************/
 
-/* Measurement thread control function (called async in working queue)*/
+/* Measurement thread control function (called async in send workqueue)*/
 static void measurement_start(struct k_work * work);
 static void measurement_stop (struct k_work * work);
+static void measurement_release(struct k_work * work);
 
 /* BLE connection events */
 static void ble_evt_callback(ble_event_type_t event);
-/* BLE NUS data events */
-static void ble_rx_callback(const uint8_t *const p_data, uint16_t length);
+static void ble_link_callback(uint8_t link, bool connected);
+static void link_work_handler(struct k_work * work);
+/* BLE NUS and ECG service data events */
+static void ble_rx_callback(uint8_t link, const uint8_t *const p_data, uint16_t length, bool framed);
+static void rx_work_handler(struct k_work * work);
+static void rx_handle_request(rx_request_t * p_request);
 
 /* Fuel gauge helper */
 static int32_t get_state_of_charge(const struct device *dev);
+static void battery_work_handler(struct k_work * work);
+static void energy_publish(void);
 
 /* RGB LEd helpers */
 static void rgb_led_init(void);
@@ -106,9 +138,22 @@ static void rgb_led_timer_handler(struct k_timer *timer);
  * STATIC VARIABLES
  ******************************************************************************/
 
-/* Start and stop work tasks */
+/* Start and stop work tasks, acquisition follows subscriptions */
 K_WORK_DEFINE(start_measure, measurement_start);
-K_WORK_DEFINE(stop_measure,  measurement_stop);
+K_WORK_DEFINE(stop_measure,  measurement_release);
+
+/* Received requests, copied once out of the stack buffers then handled in order on send workqueue */
+K_MEM_SLAB_DEFINE_STATIC(rx_slab, sizeof(rx_request_t), RX_REQUEST_COUNT, 4);
+K_MSGQ_DEFINE(rx_queue, sizeof(rx_request_t *), RX_REQUEST_COUNT, 4);
+K_WORK_DEFINE(rx_work, rx_work_handler);
+
+/* Per central state restarted on send workqueue, which handles its requests */
+K_WORK_DEFINE(link_work, link_work_handler);
+static atomic_t m_links_up;
+static atomic_t m_links_down;
+
+/* Fuel gauge reading, on system workqueue */
+K_WORK_DEFINE(battery_work, battery_work_handler);
 
 /* RGB led timer for blinking */
 K_TIMER_DEFINE(rgb_led_timer, rgb_led_timer_handler, NULL);
@@ -118,15 +163,23 @@ static const struct gpio_dt_spec led_red_pin    = GPIO_DT_SPEC_GET_BY_IDX(DT_PAT
 static const struct gpio_dt_spec led_green_pin  = GPIO_DT_SPEC_GET_BY_IDX(DT_PATH(zephyr_user), led_rgb_gpios, 1);
 static const struct gpio_dt_spec led_blue_pin   = GPIO_DT_SPEC_GET_BY_IDX(DT_PATH(zephyr_user), led_rgb_gpios, 2);
 
-/* Fuel gauge device */
+/* Fuel gauge device, its I2C bus is only resumed while reading it */
 static const struct device *fuel_gauge = DEVICE_DT_GET(DT_NODELABEL(bq27441));
+static const struct device *fuel_gauge_bus = DEVICE_DT_GET(DT_BUS(DT_NODELABEL(bq27441)));
 
 /* Store global application state */
 static app_state_t m_app_state;
+/* Links whose central sent a start command, acquisition then goes on without
+ * subscription until each of them sent stop or disconnected */
+static atomic_t m_start_requested;
+/* Last fuel gauge average current (uA, negative while discharging) */
+static int32_t m_avg_current_ua;
 
-/* Message reception buffers */
-static uint8_t message[Timestamp_size + 1];
+/* Message reception buffers, and replies sent from the send workqueue */
 static Timestamp timestamp;
+static Command command;
+static Packet reply = { .which_payload = Packet_time_sync_tag };
+static uint8_t reply_buffer[CODEC_BUFFER_SIZE(Packet_size)];
 
 /*******************************************************************************
  * GLOBAL FUNCTIONS
@@ -142,10 +195,17 @@ int main(void)
 
     CAL_Init();
 
+    /* Fuel gauge is initialized, bus is suspended between readings */
+    pm_device_runtime_enable(fuel_gauge_bus);
+
 	/* Start Bluetooth stack */
 	BLE_Init();
     BLE_SetEventCallback(ble_evt_callback);
+    BLE_SetLinkCallback(ble_link_callback);
     BLE_SetReceiveCallback(ble_rx_callback);
+    BCAST_Init();
+    SCHED_Init();
+    LOAD_Init();
 
     /* Initialize and set frontend in shutdown */
     MEAS_Init();
@@ -156,6 +216,13 @@ int main(void)
 									MEASUREMENT_THREAD_PRIORITY, 0, K_NO_WAIT);
 	k_thread_name_set(measurement_thread_tid, "Measurement");
 
+    /* Flash recordings are written in background of acquisition */
+    REC_Init();
+    MEAS_AttachBufferSink(REC_Append);
+    k_thread_create(&recorder_thread, recorder_stack_area, K_THREAD_STACK_SIZEOF(recorder_stack_area),
+                    REC_Thread, NULL, NULL, NULL, RECORDER_THREAD_PRIORITY, 0, K_NO_WAIT);
+    k_thread_name_set(&recorder_thread, "Recorder");
+
     /* Start advertising */
 	BLE_StartAdvertising();
     rgb_led_blink_blue();
@@ -164,13 +231,8 @@ int main(void)
 
 	for (;;) {
 
-        /* Periodically retrieve battery state */
-        int battery = get_state_of_charge(fuel_gauge);
-        bt_bas_set_battery_level(battery);  
-        if (battery < 20) {
-            rgb_led_set(true, false, false);
-        }
-        
+        /* Periodically retrieve battery state, along radio activity */
+        SCHED_Submit(&k_sys_work_q, &battery_work);
         k_sleep(K_MSEC(RUN_SLEEP_INTERVAL));
 
 	}
@@ -185,6 +247,9 @@ int main(void)
 /* Start impedance measurement using current profile */
 void measurement_start(struct k_work * work)
 {
+    if (m_app_state == APP_STATE_MEASURING) {
+        return;
+    }
     LOG_INF("%s", "Start measurement thread");
     m_app_state = APP_STATE_MEASURING;
     MEAS_Enable(true);
@@ -194,9 +259,65 @@ void measurement_start(struct k_work * work)
 /* Stop immediateley any measurement in progress */
 void measurement_stop(struct k_work * work)
 {
+    /* Recording and broadcast go on without connection, until stopped by host */
+    if (REC_IsRecording() || BCAST_IsEnabled()) {
+        LOG_INF("%s", "Recording or broadcasting, measurement goes on");
+        return;
+    }
+    if (m_app_state != APP_STATE_MEASURING) {
+        return;
+    }
     LOG_INF("%s", "Abort measurement thread");
 	k_thread_suspend(measurement_thread_tid);
     MEAS_Enable(false);
+    m_app_state = APP_STATE_IDLE;
+}
+
+/* Read fuel gauge and update Battery Service */
+static void battery_work_handler(struct k_work * work)
+{
+    pm_device_runtime_get(fuel_gauge_bus);
+    int battery = get_state_of_charge(fuel_gauge);
+    pm_device_runtime_put(fuel_gauge_bus);
+    bt_bas_set_battery_level(battery);  
+
+    /* Device current between sessions, charger current is not relevant */
+    if (battery >= 0 && m_app_state == APP_STATE_IDLE && m_avg_current_ua < 0) {
+        STATS_Set(STATS_IDLE_CURRENT, -m_avg_current_ua);
+    }
+    if (battery >= 0) {
+        energy_publish();
+    }
+    if (battery < 20) {
+        rgb_led_set(true, false, false);
+    }
+}
+
+/* Close energy accounting period, report is read from ECG service and sent along the stream */
+static void energy_publish(void)
+{
+    Energy energy;
+    uint8_t value[Energy_size];
+
+    ENERGY_Update(m_avg_current_ua);
+    if (!ENERGY_Get(&energy)) {
+        return;
+    }
+
+    int length = CODEC_EncodeMessage(Energy_fields, &energy, value, sizeof(value));
+    if (length >= 0) {
+        BLE_SetEnergy(value, length);
+    }
+    LOG_INF("Energy: %u uC over %u ms, %u samples sent", energy.charge_uc, energy.period_ms, energy.samples_sent);
+}
+
+/* Stop measurement once no central needs it anymore */
+static void measurement_release(struct k_work * work)
+{
+    if (atomic_get(&m_start_requested) || BLE_IsSendEnabled() || BLE_IsHeartRateEnabled()) {
+        return;
+    }
+    measurement_stop(work);
 }
 
 static int32_t get_state_of_charge(const struct device *dev) {
@@ -239,6 +360,7 @@ static int32_t get_state_of_charge(const struct device *dev) {
         return -1;
     }
 
+    m_avg_current_ua = avg_current.val1 * 1000000 + avg_current.val2;
     LOG_INF("State of charge: %d%%, current: %d mA, voltage: %d mV", state_of_charge.val1, avg_current.val1 * 1000 + avg_current.val2 / 1000, voltage.val1 * 1000 + voltage.val2 / 1000);
 
     return state_of_charge.val1;
@@ -250,51 +372,230 @@ void ble_evt_callback(ble_event_type_t event)
     switch(event)
     {
         case BLE_EVT_CONNECTED:
-            k_work_submit(&start_measure);
+            /* Acquisition waits for a subscription or a start command */
             rgb_led_set(false, false, true);
             LOG_INF("BLE connected");
             break;
         case BLE_EVT_DISCONNECTED:
-            k_work_submit(&stop_measure);
+            k_work_submit_to_queue(MEAS_GetWorkQueue(), &stop_measure);
             rgb_led_blink_blue();
             LOG_INF("BLE disconnected");
             break;
         case BLE_EVT_NUS_ENABLED:
+            k_work_submit_to_queue(MEAS_GetWorkQueue(), &start_measure);
             rgb_led_set(false, true, false);
             LOG_INF("BLE NUS notifications enabled");
             break;
         case BLE_EVT_NUS_DISABLED:
+            k_work_submit_to_queue(MEAS_GetWorkQueue(), &stop_measure);
             rgb_led_set(false, false, true);
             LOG_INF("BLE NUS notifications disabled");
             break;
+        case BLE_EVT_HRS_ENABLED:
+            k_work_submit_to_queue(MEAS_GetWorkQueue(), &start_measure);
+            break;
+        case BLE_EVT_HRS_DISABLED:
+            k_work_submit_to_queue(MEAS_GetWorkQueue(), &stop_measure);
+            break;
     }
 }
 
-/* BLE NUS data received */
-static void ble_rx_callback(const uint8_t *const p_data, uint16_t length)
+/* Central connected or gone, its time sync and stats are restarted */
+static void ble_link_callback(uint8_t link, bool connected)
 {
-    if (length > sizeof(message))
+    if (!connected) {
+        /* Before the disconnected event releases acquisition */
+        atomic_and(&m_start_requested, ~BIT(link));
+    }
+    atomic_or(connected ? &m_links_up : &m_links_down, BIT(link));
+    k_work_submit_to_queue(MEAS_GetWorkQueue(), &link_work);
+}
+
+static void link_work_handler(struct k_work * work)
+{
+    uint32_t up = atomic_clear(&m_links_up);
+    uint32_t down = atomic_clear(&m_links_down);
+
+    /* Central leaving a link before another one takes it */
+    for (uint8_t i = 0; i < CONFIG_BT_MAX_CONN; i++)
+    {
+        if (down & BIT(i)) {
+            TSYNC_Release(i);
+        }
+        if (up & BIT(i))
+        {
+            TSYNC_Reset(i);
+            STATS_Reset(i);
+        }
+    }
+}
+
+/* BLE NUS or ECG service data received, handled on the workqueue */
+static void ble_rx_callback(uint8_t link, const uint8_t *const p_data, uint16_t length, bool framed)
+{
+    rx_request_t * p_request;
+
+    /* Reception time of time synchronization requests */
+    uint64_t rx_ticks = CAL_GetTicks64();
+
+    if (length > sizeof(p_request->data))
     {
-        LOG_ERR("Size of message is %u but max is %u", length, Timestamp_size + 1);
+        LOG_ERR("Size of message is %u but max is %u", length, sizeof(p_request->data));
         return;
     }
-    memcpy(message, p_data, length);
-    cobs_ret_t cobs_ret = cobs_decode_inplace(message, length);
-    if (cobs_ret != COBS_RET_SUCCESS)
+    if (k_mem_slab_alloc(&rx_slab, (void **)&p_request, K_NO_WAIT) != 0)
     {
-        LOG_ERR("error %d while decoding cobs", cobs_ret);
+        LOG_ERR("%s", "Request dropped, previous ones not handled yet");
         return;
     }
 
+    /* Only copy, stack buffer is released on return */
+    p_request->rx_ticks = rx_ticks;
+    p_request->length = length;
+    p_request->link = link;
+    p_request->framed = framed;
+    memcpy(p_request->data, p_data, length);
+
+    /* Queue holds as many requests as the slab, never full here */
+    k_msgq_put(&rx_queue, &p_request, K_NO_WAIT);
+    k_work_submit_to_queue(MEAS_GetWorkQueue(), &rx_work);
+}
+
+static void rx_work_handler(struct k_work * work)
+{
+    rx_request_t * p_request;
+
+    while (k_msgq_get(&rx_queue, &p_request, K_NO_WAIT) == 0)
+    {
+        rx_handle_request(p_request);
+        k_mem_slab_free(&rx_slab, p_request);
+    }
+}
+
+/* Decode and execute a request, from the workqueue building measurement transfers */
+static void rx_handle_request(rx_request_t * p_request)
+{
+    const uint8_t * p_message = p_request->data;
+    int length = p_request->length;
+    uint8_t link = p_request->link;
+
+    /* NUS frame is unframed in place, both decodings then read the same bytes */
+    if (p_request->framed)
+    {
+        length = CODEC_Unframe(p_request->data, length);
+        if (length < 0) {
+            return;
+        }
+        p_message = &p_request->data[1];
+    }
+
     /* Decode protobuf message (should be a request) */
-    pb_istream_t istream = pb_istream_from_buffer(message + 1, length - 2);
-    bool status = pb_decode(&istream, Timestamp_fields, &timestamp);
-    if (!status) {
-        LOG_ERR("protobuf decoding failed: %s\n", PB_GET_ERROR(&istream));
+    if (CODEC_DecodeMessage(Command_fields, &command, p_message, length) != 0) {
         return;
     }
 
-    CAL_SetTime(timestamp.time, timestamp.us);
+    switch (command.which_request)
+    {
+        case Command_start_tag:
+            atomic_or(&m_start_requested, BIT(link));
+            measurement_start(NULL);
+            break;
+
+        case Command_stop_tag:
+            /* Other centrals may still have started or subscribed */
+            atomic_and(&m_start_requested, ~BIT(link));
+            measurement_release(NULL);
+            break;
+
+        case Command_config_tag:
+            MEAS_Configure(command.request.config.rate, command.request.config.frame_ms,
+                           command.request.config.anchor_ms);
+            break;
+
+        case Command_anchor_tag:
+            MEAS_RequestAnchor();
+            break;
+
+        case Command_output_tag:
+        {
+            const OutputRequest * p_output = &command.request.output;
+            uint8_t sinks = (p_output->nus ? MEAS_SINK_NUS : 0) | (p_output->broadcast ? MEAS_SINK_BROADCAST : 0);
+            MEAS_SetOutput(MIN(p_output->output, UINT8_MAX), MAX(p_output->factor, 1), sinks);
+            break;
+        }
+
+        case Command_link_profile_tag:
+            BLE_SetLinkProfile(link, (ble_link_profile_t)command.request.link_profile);
+            break;
+
+        case Command_stats_tag:
+            MEAS_RequestStats(link);
+            break;
+
+        case Command_record_tag:
+            REC_Request(&command.request.record, link);
+            break;
+
+        case Command_broadcast_tag:
+            BCAST_Configure(command.request.broadcast.enable, command.request.broadcast.interval_ms);
+            if (command.request.broadcast.transfer) {
+                BCAST_TransferSync(link);
+            }
+            break;
+
+        case Command_retransmit_tag:
+            HIST_Request(command.request.retransmit.first, MAX(command.request.retransmit.count, 1));
+            break;
+
+        case Command_burst_tag:
+            MEAS_RequestBurst(command.request.burst.rate, command.request.burst.duration_ms,
+                              command.request.burst.trigger);
+            break;
+
+        case Command_load_tag:
+        {
+            reply.which_payload = Packet_load_tag;
+            LOAD_Get(&reply.payload.load);
+            int ret = CODEC_Encode(Packet_fields, &reply, reply_buffer, sizeof(reply_buffer));
+            if (ret > 0) {
+                BLE_SendTo(link, reply_buffer, ret);
+            }
+            break;
+        }
+
+        case Command_profile_tag:
+            /* Nothing is sent without CONFIG_APP_PROFILING */
+            reply.which_payload = Packet_profile_tag;
+            for (uint8_t i = 0; PROF_Get(i, &reply.payload.profile); i++)
+            {
+                int ret = CODEC_Encode(Packet_fields, &reply, reply_buffer, sizeof(reply_buffer));
+                if (ret > 0) {
+                    BLE_SendTo(link, reply_buffer, ret);
+                }
+            }
+            PROF_Reset();
+            break;
+
+        case Command_time_sync_tag:
+        {
+            reply.which_payload = Packet_time_sync_tag;
+            TSYNC_HandleRequest(link, &command.request.time_sync, p_request->rx_ticks, &reply.payload.time_sync);
+            int ret = CODEC_Encode(Packet_fields, &reply, reply_buffer, sizeof(reply_buffer));
+            if (ret > 0) {
+                BLE_SendTo(link, reply_buffer, ret);
+            }
+            break;
+        }
+
+        default:
+            /* No request: legacy Timestamp message, decoded again from the same bytes */
+            if (CODEC_DecodeMessage(Timestamp_fields, &timestamp, p_message, length) != 0) {
+                return;
+            }
+            CAL_SetTime(timestamp.time, timestamp.us);
+            MEAS_RequestAnchor();
+            break;
+    }
 }
 
 /* Init RGB gpios */
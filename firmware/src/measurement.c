@@ -19,17 +19,29 @@
 
 /* Zephyr Projet includes */
 #include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/adc.h>
+#include <zephyr/pm/device_runtime.h>
+#include <hal/nrf_saadc.h>
 #include <bluetooth/services/nus.h>
-#include <pb_encode.h>
 
 /* Application includes */
 #include "bluetooth/bluetooth.h"
 #include "calendar/calendar.h"
 #include "protocol/protocol.pb.h"
-#include "nanocobs/cobs.h"
+#include "codec/codec.h"
+#include "dsp/decimator.h"
+#include "dsp/leads.h"
+#include "qrs/qrs.h"
+#include "stats/stats.h"
+#include "history/history.h"
+#include "broadcast/broadcast.h"
+#include "pipeline/pipeline.h"
+#include "scheduler/scheduler.h"
+#include "energy/energy.h"
+#include "profile/profile.h"
 #include "measurement.h"
 
 
@@ -44,14 +56,141 @@
 #define LOG_MODULE_NAME measurement
 LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 
-#define ADC_SAMPLE_NUM (sizeof(((EcgBuffer *)0)->data))/2 /**< Number of samples acquired per buffer */
-#define ADC_SAMPLE_INTERVAL     1953  /**< microseconds (= 1/512) */
+#define ADC_MAX_SAMPLE_NUM      (sizeof(((EcgBuffer *)0)->data.bytes) / 2) /**< Largest buffer (1 s at 1 kHz) */
+#define ADC_DEFAULT_RATE        512   /**< Hz */
+#define ADC_DEFAULT_SAMPLE_NUM  100   /**< Number of samples acquired per buffer by default (~195 ms) */
+#define ADC_MIN_FRAME_MS        50
+#define ADC_MAX_FRAME_MS        1000
+#define ADC_MIN_ANCHOR_MS       1000  /**< Compact mode timestamps period limits */
+#define ADC_MAX_ANCHOR_MS       60000
 /* The following value was experimentally adjusted */
-#define ADC_BUFF_INTERVAL       (ADC_SAMPLE_INTERVAL - 368) /**< wait the necessary time (should be one sampling interval) before re-starting buffer acquisition */
+#define ADC_BUFF_SETUP_TIME     368   /**< microseconds, sampling interval minus this is waited before re-starting buffer acquisition */
+#define ADC_ACQ_TIME_US         40    /**< microseconds, SAADC acquisition time of each conversion */
+#define ADC_CONV_TIME_US        2     /**< microseconds, SAADC conversion time */
+#define ADC_DONE_DELAY          (ADC_ACQ_TIME_US + ADC_CONV_TIME_US) /**< microseconds, before first DONE event */
+
+#define BURST_MAX_SAMPLES       CONFIG_APP_BURST_MAX_SAMPLES /**< Burst memory */
+#define BURST_MAX_SEGMENTS      32    /**< Maximum acquisition buffers in one burst */
+#define BURST_MAX_RATE          4096  /**< Hz */
+#define BURST_UPLOAD_SAMPLES    (sizeof(((BurstBuffer *)0)->data.bytes) / 2) /**< Burst samples sent along each NUS transfer */
+
+#define LEADOFF_HEARTBEAT_MS    1000  /**< Lead status period while leads are off */
+#define LEADOFF_PROBE_SETTLE_US 500   /**< Lead-off comparators settling time after AD8232 power up */
+
+#define LEAD_MAX_CHANGES        (sizeof(((EcgBuffer *)0)->lodpn_changes) / sizeof(uint32_t) / 2) /**< Lead status changes per frame */
+
+#define STATS_PERIOD_MS         5000  /**< Stats packet period */
+#define RESEND_MAX_BYTES        512   /**< Retransmitted bytes per transfer, beyond first frame */
+
+#define QRS_MAX_BEATS           4     /**< Maximum beats reported per buffer */
+#define RR_UNITS_PER_SEC        1024  /**< RR intervals resolution, as in BLE Heart Rate Service */
+
+#define PIPE_BLOCK_COUNT        10    /**< Acquisition buffers and output frames in flight (~21 kB) */
+#define DSP_STAGE_DEPTH         4     /**< Acquisition buffers waiting for processing, held until next connection event or one slot is left */
+#define ENCODE_STAGE_DEPTH      (2 * (MEAS_NUM_OUTPUTS + 1)) /**< Frames and closing buffers of two transfers */
+#define MEAS_MAX_BUFFER_SINKS   4
+
+BUILD_ASSERT(ADC_MAX_SAMPLE_NUM >= ADC_MAX_FRAME_MS, "Buffers must hold longest frame at 1 kHz");
+
 /*******************************************************************************
  * PRIVATE TYPEDEFS
  ******************************************************************************/
 
+/* Acquisition settings, generation changes each time acquisition restarts */
+typedef struct
+{
+    uint16_t rate;          /**< Nominal rate (Hz) */
+    uint16_t samples;       /**< Samples per buffer */
+    uint16_t anchor_ms;     /**< Compact mode timestamps period, 0 if disabled */
+    uint32_t ticks;         /**< Sample interval, SAADC is paced by a kernel timer in whole ticks */
+    uint32_t period_ns;     /**< Actual sample period, from ticks */
+    uint32_t generation;
+} meas_config_t;
+
+/* Burst capture steps */
+typedef enum
+{
+    BURST_IDLE = 0,
+    BURST_SETUP,        /**< Request being stored */
+    BURST_ARMED,        /**< Waiting for trigger */
+    BURST_CAPTURE,      /**< Next acquisition buffers are sampled at burst rate */
+    BURST_UPLOAD,       /**< Captured, sent in background */
+} burst_state_t;
+
+/* High rate burst, captured as one segment per acquisition buffer. SAADC is
+ * re-armed between segments, so (factor - 1) burst samples are missing there */
+typedef struct
+{
+    atomic_t  state;
+    uint32_t  id;                           /**< Burst number since boot */
+    uint16_t  factor;                       /**< Burst rate over acquisition rate */
+    uint16_t  trigger;                      /**< Step starting capture (ADC LSB), 0 for immediate */
+    uint16_t  samples;                      /**< Acquisition buffer samples when requested */
+    uint16_t  segment_len;                  /**< Burst samples per segment */
+    uint8_t   segments;                     /**< Segments to capture */
+    uint8_t   captured;                     /**< Segments captured so far */
+    uint32_t  interval_us;                  /**< SAADC interval, a whole number of ticks */
+    uint32_t  period_ns;                    /**< Exact burst sample period */
+    size_t    sent;                         /**< Samples already uploaded */
+    Timestamp start[BURST_MAX_SEGMENTS];    /**< Time of first sample of each segment */
+} burst_t;
+
+/* Pipeline blocks contents */
+typedef enum
+{
+    BLOCK_BUFFER = 0,   /**< Acquisition buffer, closes the transfer of its frames on encode stage */
+    BLOCK_FRAME,        /**< Output frame */
+} block_type_t;
+
+/* Block passed between pipeline stages without copy */
+typedef struct
+{
+    void *          fifo_reserved;      /**< Used by stage FIFO */
+    block_type_t    type;
+    uint16_t        count;              /**< Samples in data */
+    uint16_t        lodpn;              /**< Lead off status at first sample */
+    Timestamp       start;              /**< Time of first sample */
+    union
+    {
+        struct
+        {
+            meas_config_t config;       /**< Settings it was acquired with */
+            uint32_t      index;        /**< First sample since acquisition restart */
+            uint32_t      ready;        /**< Cycle counter at ADC completion, for send latency */
+            bool          contiguous;   /**< false if previous buffer was lost */
+            uint8_t       change_count;
+            leads_change_t changes[LEAD_MAX_CHANGES];
+            HeartRate     heart_rate;   /**< Beats found in buffer, sent along its frames */
+        } buffer;
+        struct
+        {
+            uint8_t       sinks;        /**< meas_sink_t flags */
+            uint16_t      rate;         /**< Output nominal rate */
+            uint32_t      period_ns;    /**< Output actual sample period */
+            uint32_t      index;        /**< Output index of first sample, compact mode only */
+            bool          anchor;       /**< Frame carries a timestamp */
+            uint32_t      sequence;     /**< NUS frames only */
+            pb_size_t     change_count;
+            uint32_t      changes[2 * LEAD_MAX_CHANGES]; /**< (run length, new status) pairs */
+        } frame;
+    };
+    int16_t         data[ADC_MAX_SAMPLE_NUM];
+} meas_block_t;
+
+/* Decimated output, frames have the same number of samples whatever the rate */
+typedef struct
+{
+    decimator_t    decim;
+    uint8_t        sinks;               /**< meas_sink_t flags, 0 if output is disabled */
+    meas_block_t * p_frame;             /**< Current frame, NULL if dropped as no block was free */
+    size_t         count;               /**< Samples already in current frame */
+    uint32_t       index;               /**< Output samples since stream start */
+    uint32_t       anchor_index;        /**< Index of first sample of last frame with timestamp */
+    int64_t        anchor_us;           /**< Time of that sample */
+    uint16_t       status;              /**< Lead off status at last sample */
+    leads_runs_t   runs;                /**< Status changes of current frame */
+} meas_output_t;
+
 /*******************************************************************************
  * STATIC VARIABLES
  ******************************************************************************/
@@ -60,16 +199,72 @@ LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 static uint64_t timestamp;
 static uint32_t us;
 
-/* Protobuf stream buffer */
-static pb_byte_t proto_buffer[EcgBuffer_size + 2]; // COBS needs one byte at start and one byte at end to store zero positions
+/* Acquisition settings, pending ones are applied by measurement thread between buffers */
+static const uint16_t supported_rates[] = { 250, 256, 500, 512, 1000 };
+static meas_config_t config = {
+    .rate = ADC_DEFAULT_RATE,
+    .samples = ADC_DEFAULT_SAMPLE_NUM,
+    .generation = 0,
+};
+static meas_config_t pending_config;
+static bool config_pending;
+static struct k_spinlock config_lock;
+static uint32_t processed_generation = UINT32_MAX;
+/* Processing stage position: index expected for next buffer, and samples fed
+ * to QRS detector since its reset (lost buffers are not) */
+static uint32_t next_buffer_index;
+static uint32_t qrs_samples;
+/* Set when an acquisition buffer was lost, next one does not follow previous one */
+static bool buffer_skipped;
+/* Outputs whose next frame carries a timestamp in compact mode (one bit per output) */
+static atomic_t anchor_request;
+
+/* NUS stream buffer, at most one ECG frame per output followed by heart rate, burst and stats
+ * frames, then retransmitted frames */
+static uint8_t proto_buffer[(MEAS_NUM_OUTPUTS + 1) * CODEC_BUFFER_SIZE(EcgBuffer_size) + 3 * CODEC_BUFFER_SIZE(Packet_size)];
+/* NUS transfer state, proto_buffer must not be written while previous transfer is in progress */
+static bool nus_enabled;
+static bool nus_busy;
+static uint32_t nus_sequence;
+static uint8_t nus_frames;
+static uint32_t nus_samples;    /**< Samples in NUS frames of the transfer */
+/* Transfer being built from encode stage blocks, until its acquisition buffer comes */
+static bool transfer_open;
+static size_t transfer_length;
+static int64_t next_stats;
+static atomic_t stats_links;    /**< Centrals that asked for a stats packet */
+static bool acquiring;
+/* Stats packets, one per central */
+static uint8_t stats_buffer[CODEC_BUFFER_SIZE(Packet_size)];
+/* Frame buffer for history and other sinks */
+static uint8_t frame_buffer[CODEC_BUFFER_SIZE(EcgBuffer_size)];
+/* Decimation output, too large for workqueue stack */
+static int16_t decimated[ADC_MAX_SAMPLE_NUM];
 
-/* ECG Data double buffering */
-static int16_t buffer_1[ADC_SAMPLE_NUM];
-static int16_t buffer_2[ADC_SAMPLE_NUM];
-static int16_t * buffer_to_send = buffer_2;
+/* Outputs, default is legacy full rate stream on NUS and broadcast, and 128 Hz
+ * preview left unrouted */
+static const struct { uint8_t factor; uint8_t sinks; } output_defaults[MEAS_NUM_OUTPUTS] = {
+    { .factor = 1, .sinks = MEAS_SINK_NUS | MEAS_SINK_BROADCAST },
+    { .factor = 4, .sinks = 0 },
+};
+static meas_output_t outputs[MEAS_NUM_OUTPUTS];
+/* Raw acquisition buffers destinations, e.g. recorder */
+static atomic_ptr_t buffer_sinks[MEAS_MAX_BUFFER_SINKS];
+
+/* Pipeline: ADC writes samples straight into blocks, which go through stages
+ * on send workqueue. Processing stage turns buffers into frames, encode stage
+ * sends them. */
+K_MEM_SLAB_DEFINE_STATIC(block_slab, sizeof(meas_block_t), PIPE_BLOCK_COUNT, 4);
+static pipe_stage_t dsp_stage;
+static pipe_stage_t encode_stage;
+static meas_block_t * p_acquiring;
+/* Acquired into while no block is free, samples are then lost */
+static meas_block_t scratch_block;
+static uint32_t sample_index;
 static EcgBuffer ecgBuffer = {
     .data = {0},
     .lodpn = 0UL,
+    .rate = ADC_DEFAULT_RATE,
     .has_timestamp = true,
     .timestamp = {
         .time = 0ULL,
@@ -77,8 +272,59 @@ static EcgBuffer ecgBuffer = {
     }
 };
 
-/* Lead off detection status variable */
-static uint16_t lodpn;
+static Packet heartRatePacket = {
+    .which_payload = Packet_heart_rate_tag,
+    .payload.heart_rate = {
+        .bpm = 0UL,
+        .rr_count = 0,
+        .has_timestamp = true,
+    }
+};
+
+/* High rate burst */
+static int16_t burst_samples[BURST_MAX_SAMPLES];
+static burst_t burst;
+
+/* Largest application buffers, half of RAM is left to Bluetooth stack,
+ * thread stacks, kernel and smaller buffers */
+#define APP_LARGE_BUFFERS_SIZE  (CONFIG_APP_NUS_RING_SIZE + CONFIG_APP_HISTORY_SIZE + sizeof(burst_samples) + \
+                                 PIPE_BLOCK_COUNT * sizeof(meas_block_t) + sizeof(proto_buffer))
+BUILD_ASSERT(APP_LARGE_BUFFERS_SIZE <= DT_REG_SIZE(DT_CHOSEN(zephyr_sram)) / 2,
+             "Transfers ring, history, burst and pipeline buffers overcommit RAM");
+static Packet burstPacket = {
+    .which_payload = Packet_burst_tag,
+    .payload.burst = {
+        .has_timestamp = true,
+    }
+};
+
+static Packet leadStatusPacket = {
+    .which_payload = Packet_lead_status_tag,
+    .payload.lead_status = {
+        .has_timestamp = true,
+    }
+};
+static uint8_t lead_status_buffer[CODEC_BUFFER_SIZE(Packet_size)];
+
+static Packet statsPacket = {
+    .which_payload = Packet_stats_tag,
+};
+
+static Packet energyPacket = {
+    .which_payload = Packet_energy_tag,
+};
+static uint32_t energy_sequence;    /**< Last energy report sent */
+
+/* Lead status changes from pins interrupts, converted to sample indices of each buffer */
+static leads_event_t lead_events[LEAD_MAX_CHANGES];
+static uint8_t lead_event_count;
+static struct k_spinlock lead_lock;
+static int64_t buffer_start_ticks;
+/* Lead off status updated from pins interrupts, wakes up paused acquisition */
+static atomic_t lead_status;
+static struct gpio_callback lodp_cb;
+static struct gpio_callback lodn_cb;
+K_SEM_DEFINE(lead_sem, 0, 1);
 
 /* AD8232 I/O pins */
 const static struct gpio_dt_spec ad8232_pwr_pin_dt   = GPIO_DT_SPEC_GET(DT_PATH(zephyr_user), ad8232_pwr_gpios);
@@ -91,7 +337,7 @@ const static uint8_t ad8232_out_ch = DT_IO_CHANNELS_INPUT_BY_NAME(DT_PATH(zephyr
 const static uint8_t ad8232_ref_ch = DT_IO_CHANNELS_INPUT_BY_NAME(DT_PATH(zephyr_user), ad8232_ref);
 
 const struct adc_channel_cfg channel_cfg = {
-    .acquisition_time = ADC_ACQ_TIME(ADC_ACQ_TIME_MICROSECONDS, 40),
+    .acquisition_time = ADC_ACQ_TIME(ADC_ACQ_TIME_MICROSECONDS, ADC_ACQ_TIME_US),
     .differential = true,
     .gain = ADC_GAIN_1,
     .reference = ADC_REF_VDD_1_4,
@@ -102,14 +348,14 @@ const struct adc_channel_cfg channel_cfg = {
 
 struct adc_sequence_options sequence_options = {
     .callback = NULL,
-    .extra_samplings = ADC_SAMPLE_NUM - 1,
-    .interval_us = ADC_SAMPLE_INTERVAL,
+    .extra_samplings = ADC_DEFAULT_SAMPLE_NUM - 1,
+    .interval_us = USEC_PER_SEC / ADC_DEFAULT_RATE,
     .user_data = NULL,
 };
 
 struct adc_sequence sequence = {
-    .buffer = buffer_1,
-    .buffer_size = sizeof(buffer_1),
+    .buffer = NULL,
+    .buffer_size = ADC_DEFAULT_SAMPLE_NUM * sizeof(int16_t),
     .calibrate = false,
     .channels = BIT(0),
     .oversampling = 2,
@@ -121,9 +367,47 @@ struct adc_sequence sequence = {
  * STATIC FUNCTION PROTOTYPES
  ******************************************************************************/
 
-/* Wake up system from sleep state */
-void send_buffer(struct k_work *work);
-K_WORK_DEFINE(ble_send, send_buffer);
+/* Encode and transmit path, on its own workqueue so that buffers never wait behind system workqueue items */
+K_THREAD_STACK_DEFINE(send_stack_area, CONFIG_APP_SEND_WORKQ_STACK_SIZE);
+static struct k_work_q send_work_q;
+
+static void send_lead_status(struct k_work *work);
+K_WORK_DEFINE(lead_status_send, send_lead_status);
+
+static void apply_config(void);
+static void config_timing(meas_config_t * p_config);
+static void restart_processing(void);
+static void reset_processing(const meas_block_t * p_block);
+static void skip_processing(const meas_block_t * p_block);
+static meas_block_t * block_alloc(void);
+static void block_free(meas_block_t * p_block);
+static void dsp_handle(void * p_block);
+static void encode_handle(void * p_block);
+static void ad8232_power(bool on);
+static void peripherals_power(bool on);
+static uint16_t read_lead_status(void);
+static void lead_off_isr(const struct device * port, struct gpio_callback * cb, gpio_port_pins_t pins);
+static void wait_for_contact(void);
+static void collect_lead_changes(meas_block_t * p_block);
+static enum adc_action sample_done(const struct device * dev, const struct adc_sequence * p_sequence,
+                                   uint16_t sampling_index);
+static void add_lead_change(meas_output_t * p_output, uint16_t status);
+static bool burst_read_setup(void);
+static void burst_read_done(int16_t * p_buffer);
+static void burst_check_trigger(const meas_block_t * p_block);
+static int  burst_upload(uint8_t * p_nus_buffer, size_t size);
+static void stats_send(bool periodic);
+static int  energy_upload(uint8_t * p_nus_buffer, size_t size);
+static void adc_count_active(void);
+static void send_latency_update(const meas_block_t * p_block);
+static int  resend_frames(uint8_t * p_nus_buffer, size_t size);
+static bool anchor_due(meas_output_t * p_output, const meas_config_t * p_config, uint32_t start_index,
+                       const Timestamp * p_start);
+static void detect_beats(meas_block_t * p_block);
+static void process_output(meas_output_t * p_output, const meas_block_t * p_block);
+static void encode_frame(const meas_block_t * p_frame);
+static void send_transfer(const meas_block_t * p_block);
+static void buffer_time(const meas_block_t * p_block, int64_t half_offset, Timestamp * p_time);
 
 /*******************************************************************************
  * GLOBAL FUNCTIONS
@@ -133,6 +417,12 @@ void MEAS_Init(void)
 {
 	int err;
 
+    for (uint8_t i = 0; i < MEAS_NUM_OUTPUTS; i++) {
+        MEAS_SetOutput(i, output_defaults[i].factor, output_defaults[i].sinks);
+    }
+    config_timing(&config);
+    sequence_options.interval_us = k_ticks_to_us_floor32(config.ticks);
+
     /* Configure shutdown pin */
 	err = gpio_pin_configure_dt(&ad8232_pwr_pin_dt, GPIO_OUTPUT_INACTIVE);
     if (err != 0) {
@@ -150,37 +440,93 @@ void MEAS_Init(void)
         LOG_ERR("failed configure ad8232 LOD- pin (code %d)", err);
     }
 
+    /* Lead-off changes wake up acquisition paused while leads are off,
+     * interrupts are enabled while measuring only */
+    gpio_init_callback(&lodp_cb, lead_off_isr, BIT(ad8232_lodp_pin_dt.pin));
+    gpio_init_callback(&lodn_cb, lead_off_isr, BIT(ad8232_lodn_pin_dt.pin));
+    err = gpio_add_callback(ad8232_lodp_pin_dt.port, &lodp_cb);
+    err |= gpio_add_callback(ad8232_lodn_pin_dt.port, &lodn_cb);
+    if (err != 0) {
+        LOG_ERR("failed configure ad8232 lead-off interrupts (code %d)", err);
+    }
+
 	if (!device_is_ready(adc_dev)) {
 		LOG_ERR("ADC device is not ready %s", adc_dev->name);
 	}
+    /* ADC is suspended between sessions */
+    pm_device_runtime_enable(adc_dev);
+
+    /* Buffers are timestamped from first conversion by hardware */
+    err = CAL_CaptureInit(nrf_saadc_event_address_get(NRF_SAADC, NRF_SAADC_EVENT_DONE));
+    if (err != 0) {
+        LOG_ERR("buffers timestamps will include software latency (code %d)", err);
+    }
+    sequence_options.callback = sample_done;
+
+    const struct k_work_queue_config send_cfg = { .name = "Send" };
+    k_work_queue_start(&send_work_q, send_stack_area, K_THREAD_STACK_SIZEOF(send_stack_area),
+                       CONFIG_APP_SEND_WORKQ_PRIORITY, &send_cfg);
+
+    PIPE_Init(&dsp_stage, "dsp", dsp_handle, DSP_STAGE_DEPTH, &send_work_q);
+    PIPE_Init(&encode_stage, "encode", encode_handle, ENCODE_STAGE_DEPTH, &send_work_q);
+    /* Buffers are processed and sent along radio activity, encode stage follows at once */
+    PIPE_SetSubmit(&dsp_stage, SCHED_Submit);
+}
+
+
+struct k_work_q * MEAS_GetWorkQueue(void)
+{
+    return &send_work_q;
 }
 
 
 void MEAS_Enable(bool enable)
 {
-    int err;
     if (enable)
     {
-        /* Power up AD8232 */
-        err = gpio_pin_set_dt(&ad8232_pwr_pin_dt, 1);
-        if (err != 0) {
-        LOG_ERR("failed to set ad5940 power pin (code %d)", err);
+        /* Restart processing (beat detection learning phase, filters) on next buffer */
+        restart_processing();
+        atomic_set(&lead_status, 0);
+        for (uint8_t i = 0; i < MEAS_NUM_OUTPUTS; i++) {
+            outputs[i].index = 0;
         }
+        nus_sequence = 0;
+        HIST_Reset();
+        PIPE_ResetStats(&dsp_stage);
+        PIPE_ResetStats(&encode_stage);
+        next_stats = k_uptime_get() + STATS_PERIOD_MS;
     }
     else {
-        /* Power down AD8232 */
-        err = gpio_pin_set_dt(&ad8232_pwr_pin_dt, 0);
-        if (err != 0) {
-         LOG_ERR("failed to clear ad5940 power pin (code %d)", err);
+        /* Next session starts with default settings, without pending burst */
+        MEAS_Configure(ADC_DEFAULT_RATE, 0, 0);
+        for (uint8_t i = 0; i < MEAS_NUM_OUTPUTS; i++) {
+            MEAS_SetOutput(i, output_defaults[i].factor, output_defaults[i].sinks);
         }
+        atomic_set(&burst.state, BURST_IDLE);
     }
+    acquiring = enable;
+    ad8232_power(enable);
+    peripherals_power(enable);
 }
 
 void MEAS_Read(void)
 {
 	int err;
-    lodpn =  gpio_pin_get_dt(&ad8232_lodn_pin_dt) << 1; // RA (0 or 2)
-    lodpn += gpio_pin_get_dt(&ad8232_lodp_pin_dt);      // LA (0 or 1)
+
+    PROF_START(PROF_READ_SETUP);
+    /* Samples are acquired straight into a pipeline block */
+    if (p_acquiring == NULL) {
+        p_acquiring = block_alloc();
+    }
+    meas_block_t * p_block = (p_acquiring != NULL) ? p_acquiring : &scratch_block;
+    sequence.buffer = p_block->data;
+
+    /* Status at first sample, then changes are timestamped by interrupts */
+    k_spinlock_key_t key = k_spin_lock(&lead_lock);
+    lead_event_count = 0;
+    k_spin_unlock(&lead_lock, key);
+    p_block->lodpn = read_lead_status();
+    atomic_set(&lead_status, p_block->lodpn);
 
     /* Set up ADC readings */
     err = adc_channel_setup(adc_dev, &channel_cfg);
@@ -188,29 +534,208 @@ void MEAS_Read(void)
        LOG_ERR("failed to configure adc channel (code %d)", err);
     }
 
+    /* Burst segment is acquired instead of buffer, which is filled from it */
+    bool burst_segment = burst_read_setup();
+
     /* Start acquisition */
+    CAL_CaptureArm();
+    buffer_start_ticks = k_uptime_ticks();
+    PROF_STOP(PROF_READ_SETUP);
     err = adc_read(adc_dev, &sequence);
 	if (err != 0) {
 		LOG_ERR("failed to acquire adc channel (code %d)", err);
 	}
+    p_block->buffer.ready = k_cycle_get_32();
+    PROF_START(PROF_READ_DONE);
+    adc_count_active();
 
-    /* Swap buffers */
-    if (sequence.buffer == buffer_1)
+    if (burst_segment) {
+        burst_read_done(p_block->data);
+    }
+    collect_lead_changes(p_block);
+
+    p_block->type = BLOCK_BUFFER;
+    p_block->count = config.samples;
+    p_block->start.time = timestamp;
+    p_block->start.us = us;
+    p_block->buffer.config = config;
+    p_block->buffer.index = sample_index;
+    p_block->buffer.contiguous = !buffer_skipped;
+    sample_index += config.samples;
+
+    burst_check_trigger(p_block);
+
+    /* Hand buffer over to processing, next one is acquired into another block */
+    if (p_block == &scratch_block || PIPE_Put(&dsp_stage, p_block) != 0)
     {
-        sequence.buffer = buffer_2;
-        buffer_to_send = buffer_1;
+        /* Pipeline is full, buffer is lost and time jumps */
+        STATS_Add(STATS_BUFFERS_OVERRUN, 1);
+        buffer_skipped = true;
+        MEAS_RequestAnchor();
+        PROF_STOP(PROF_READ_DONE);
+        return;
     }
-    else
+    p_acquiring = NULL;
+    buffer_skipped = false;
+    PROF_STOP(PROF_READ_DONE);
+}
+
+int MEAS_Configure(uint16_t rate, uint16_t frame_ms, uint16_t anchor_ms)
+{
+    bool supported = false;
+    uint16_t samples = ADC_DEFAULT_SAMPLE_NUM;
+
+    for (size_t i = 0; i < ARRAY_SIZE(supported_rates); i++) {
+        supported |= (rate == supported_rates[i]);
+    }
+    if (!supported) {
+        LOG_ERR("unsupported sample rate %u Hz", rate);
+        return -EINVAL;
+    }
+
+    if (frame_ms != 0)
     {
-        sequence.buffer = buffer_1;
-        buffer_to_send = buffer_2;
+        if (frame_ms < ADC_MIN_FRAME_MS || frame_ms > ADC_MAX_FRAME_MS) {
+            LOG_ERR("unsupported frame duration %u ms", frame_ms);
+            return -EINVAL;
+        }
+        samples = ((uint32_t)rate * frame_ms) / MSEC_PER_SEC;
     }
 
-    /* Launch sending task */
-    err = k_work_submit(&ble_send);
-	if (err < 0) {
-		LOG_ERR("failed to launch aync ble sending (code %d)", err);
-	}
+    if (anchor_ms != 0 && (anchor_ms < ADC_MIN_ANCHOR_MS || anchor_ms > ADC_MAX_ANCHOR_MS)) {
+        LOG_ERR("unsupported timestamps period %u ms", anchor_ms);
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&config_lock);
+    pending_config.rate = rate;
+    pending_config.samples = samples;
+    pending_config.anchor_ms = anchor_ms;
+    config_pending = true;
+    k_spin_unlock(&config_lock, key);
+
+    LOG_INF("Acquisition set to %u Hz, %u samples per frame", rate, samples);
+    if (anchor_ms != 0) {
+        LOG_INF("Compact frames, timestamp every %u ms", anchor_ms);
+    }
+    return 0;
+}
+
+void MEAS_RequestAnchor(void)
+{
+    atomic_set(&anchor_request, BIT_MASK(MEAS_NUM_OUTPUTS));
+}
+
+void MEAS_RequestStats(uint8_t link)
+{
+    atomic_or(&stats_links, BIT(link));
+
+    /* No transfer being built, all frames are already counted */
+    if (!acquiring) {
+        stats_send(false);
+    }
+}
+
+int MEAS_RequestBurst(uint16_t rate, uint16_t duration_ms, uint16_t trigger)
+{
+    /* Burst is set up under the lock, so that settings applied meanwhile cancel it */
+    k_spinlock_key_t key = k_spin_lock(&config_lock);
+    uint16_t base_rate = config.rate;
+    uint16_t samples = config.samples;
+    uint32_t base_ticks = config.ticks;
+
+    if (rate > BURST_MAX_RATE || rate % base_rate != 0 || rate / base_rate < 2)
+    {
+        k_spin_unlock(&config_lock, key);
+        LOG_ERR("burst rate %u Hz must be a multiple of %u Hz up to %u Hz", rate, base_rate, BURST_MAX_RATE);
+        return -EINVAL;
+    }
+
+    /* SAADC is paced by a kernel timer in whole ticks: every factor-th burst
+     * sample is on the acquisition grid only if factor splits its interval */
+    uint16_t factor = rate / base_rate;
+    if (base_ticks % factor != 0)
+    {
+        k_spin_unlock(&config_lock, key);
+        LOG_ERR("burst rate %u Hz does not split %u Hz sampling interval (%u ticks)", rate, base_rate, base_ticks);
+        return -EINVAL;
+    }
+    uint32_t ticks = base_ticks / factor;
+
+    uint16_t segment_len = (samples - 1) * factor + 1;
+    uint32_t segments = DIV_ROUND_UP((uint32_t)duration_ms * base_rate, MSEC_PER_SEC * samples);
+    segments = MAX(segments, 1);
+    if (segments > BURST_MAX_SEGMENTS || segments * segment_len > BURST_MAX_SAMPLES)
+    {
+        k_spin_unlock(&config_lock, key);
+        LOG_ERR("burst of %u ms at %u Hz does not fit in memory", duration_ms, rate);
+        return -EINVAL;
+    }
+
+    if (!atomic_cas(&burst.state, BURST_IDLE, BURST_SETUP))
+    {
+        k_spin_unlock(&config_lock, key);
+        LOG_ERR("previous burst not uploaded yet");
+        return -EBUSY;
+    }
+
+    burst.id++;
+    burst.factor = factor;
+    burst.trigger = trigger;
+    burst.samples = samples;
+    burst.segment_len = segment_len;
+    burst.segments = segments;
+    burst.captured = 0;
+    burst.sent = 0;
+    burst.interval_us = k_ticks_to_us_floor32(ticks);
+    burst.period_ns = k_ticks_to_ns_floor64(ticks);
+    atomic_set(&burst.state, (trigger != 0) ? BURST_ARMED : BURST_CAPTURE);
+    k_spin_unlock(&config_lock, key);
+
+    LOG_INF("Burst %u: %u x %u samples at %u Hz", burst.id, segments, segment_len, rate);
+    return 0;
+}
+
+int MEAS_SetOutput(uint8_t output, uint8_t factor, uint8_t sinks)
+{
+    if (output >= MEAS_NUM_OUTPUTS || (sinks & ~(MEAS_SINK_NUS | MEAS_SINK_BROADCAST)) != 0) {
+        LOG_ERR("unsupported output %u", output);
+        return -EINVAL;
+    }
+
+    int err = DECIM_Init(&outputs[output].decim, factor);
+    if (err != 0) {
+        LOG_ERR("unsupported decimation factor %u", factor);
+        return err;
+    }
+    /* Frame being filled is sent at its new rate, samples so far are dropped */
+    outputs[output].count = 0;
+    outputs[output].sinks = sinks;
+    return 0;
+}
+
+int MEAS_AttachBufferSink(MEAS_BufferCallback_t callback)
+{
+    for (uint8_t i = 0; i < MEAS_MAX_BUFFER_SINKS; i++)
+    {
+        if (atomic_ptr_get(&buffer_sinks[i]) == (void *)callback) {
+            return -EALREADY;
+        }
+    }
+    for (uint8_t i = 0; i < MEAS_MAX_BUFFER_SINKS; i++)
+    {
+        if (atomic_ptr_cas(&buffer_sinks[i], NULL, (void *)callback)) {
+            return 0;
+        }
+    }
+    return -ENOMEM;
+}
+
+void MEAS_DetachBufferSink(MEAS_BufferCallback_t callback)
+{
+    for (uint8_t i = 0; i < MEAS_MAX_BUFFER_SINKS; i++) {
+        atomic_ptr_cas(&buffer_sinks[i], (void *)callback, NULL);
+    }
 }
 
 void MEAS_Thread(void *p1, void *p2, void *p3)
@@ -219,42 +744,766 @@ void MEAS_Thread(void *p1, void *p2, void *p3)
     k_thread_suspend(k_current_get());
     while (1)
     {
+        apply_config();
+        /* No waveform frames while electrodes are loose, only lead status */
+        if (atomic_get(&lead_status) != 0) {
+            wait_for_contact();
+        }
         CAL_GetTime(&timestamp, &us);
         MEAS_Read();
         /* Add one delay between last sample and first sample of next buffer */
-        //k_usleep(ADC_BUFF_INTERVAL);
-        k_usleep(ADC_BUFF_INTERVAL);
+        k_usleep(sequence_options.interval_us - ADC_BUFF_SETUP_TIME);
     }
 }
 
 /*******************************************************************************
  * STATIC FUNCTIONS
  ******************************************************************************/
-enum bt_nus_send_status status=1;
-void send_buffer(struct k_work *work)
+/* Update ADC sequence with pending settings, called from measurement thread between buffers */
+static void apply_config(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&config_lock);
+    if (!config_pending)
+    {
+        k_spin_unlock(&config_lock, key);
+        return;
+    }
+    config.rate = pending_config.rate;
+    config.samples = pending_config.samples;
+    config.anchor_ms = pending_config.anchor_ms;
+    config_timing(&config);
+    config_pending = false;
+    k_spin_unlock(&config_lock, key);
+
+    restart_processing();
+    /* Burst was sized for previous settings */
+    atomic_cas(&burst.state, BURST_ARMED, BURST_IDLE);
+    atomic_cas(&burst.state, BURST_CAPTURE, BURST_IDLE);
+    sequence_options.interval_us = k_ticks_to_us_floor32(config.ticks);
+    sequence_options.extra_samplings = config.samples - 1;
+    sequence.buffer_size = config.samples * sizeof(int16_t);
+}
+
+/* Sample interval in whole ticks, as the kernel timer pacing SAADC rounds it
+ * up: nominal rates are slightly slower unless they divide the tick rate, so
+ * timing uses the actual period. Interval is passed back to the ADC driver in
+ * microseconds rounded down, which it rounds up to the same ticks. */
+static void config_timing(meas_config_t * p_config)
+{
+    p_config->ticks = k_us_to_ticks_ceil32(USEC_PER_SEC / p_config->rate);
+    p_config->period_ns = k_ticks_to_ns_floor32(p_config->ticks);
+}
+
+/* Start a new generation of buffers, processing is reset when processing stage reaches it */
+static void restart_processing(void)
+{
+    config.generation++;
+    sample_index = 0;
+}
+
+/* Restart beat detection and decimation, as samples are not contiguous anymore */
+static void reset_processing(const meas_block_t * p_block)
+{
+    QRS_Reset(p_block->buffer.config.rate);
+    qrs_samples = 0;
+    for (uint8_t i = 0; i < MEAS_NUM_OUTPUTS; i++)
+    {
+        DECIM_Reset(&outputs[i].decim);
+        outputs[i].count = 0;
+    }
+    /* Index goes on, but frames are not contiguous with previous ones */
+    MEAS_RequestAnchor();
+    processed_generation = p_block->buffer.config.generation;
+}
+
+/* Buffers were lost before this one: filters restart without mixing both
+ * sides of the gap, frames being filled are dropped and output indices skip
+ * the lost samples, beat detection keeps its thresholds but no RR interval
+ * spans the gap */
+static void skip_processing(const meas_block_t * p_block)
+{
+    uint32_t lost = p_block->buffer.index - next_buffer_index;
+
+    QRS_Skip();
+    for (uint8_t i = 0; i < MEAS_NUM_OUTPUTS; i++)
+    {
+        DECIM_Reset(&outputs[i].decim);
+        outputs[i].count = 0;
+        outputs[i].index += lost / outputs[i].decim.factor;
+    }
+    MEAS_RequestAnchor();
+}
+
+/* Pipeline block from slab, NULL if all of them are in flight */
+static meas_block_t * block_alloc(void)
+{
+    meas_block_t * p_block;
+
+    if (k_mem_slab_alloc(&block_slab, (void **)&p_block, K_NO_WAIT) != 0) {
+        return NULL;
+    }
+    return p_block;
+}
+
+static void block_free(meas_block_t * p_block)
+{
+    k_mem_slab_free(&block_slab, p_block);
+}
+
+/* Processing stage: buffer sinks, beat detection and output frames, then
+ * buffer is forwarded after its frames to close their transfer */
+static void dsp_handle(void * p)
+{
+    meas_block_t * p_block = p;
+    bool contiguous = p_block->buffer.contiguous;
+
+    if (p_block->buffer.config.generation != processed_generation) {
+        reset_processing(p_block);
+        contiguous = false;
+    }
+    else if (!contiguous) {
+        skip_processing(p_block);
+    }
+    next_buffer_index = p_block->buffer.index + p_block->count;
+
+    /* Buffer sinks (e.g. recording) are fed whatever the connection state */
+    uint64_t time_us = (uint64_t)p_block->start.time * USEC_PER_SEC + p_block->start.us;
+    for (uint8_t i = 0; i < MEAS_MAX_BUFFER_SINKS; i++)
+    {
+        MEAS_BufferCallback_t callback = (MEAS_BufferCallback_t)atomic_ptr_get(&buffer_sinks[i]);
+        if (callback != NULL) {
+            callback(p_block->data, p_block->count, p_block->buffer.config.rate,
+                     p_block->buffer.config.period_ns, time_us, p_block->lodpn, contiguous);
+        }
+    }
+
+    /* Beats are detected even when NUS is disabled, to feed Heart Rate Service */
+    detect_beats(p_block);
+
+    for (uint8_t i = 0; i < MEAS_NUM_OUTPUTS; i++) {
+        process_output(&outputs[i], p_block);
+    }
+
+    /* Refused buffer leaves its frames to next transfer */
+    if (PIPE_Put(&encode_stage, p_block) != 0) {
+        block_free(p_block);
+    }
+}
+
+/* Encode stage: frames go to their sinks, NUS ones are gathered in one
+ * transfer sent along other packets when their buffer comes */
+static void encode_handle(void * p)
+{
+    meas_block_t * p_block = p;
+
+    /* NUS state is sampled once per transfer */
+    if (!transfer_open)
+    {
+        nus_enabled = BLE_IsSendEnabled();
+        nus_busy = BLE_IsSendBusy();
+        nus_frames = 0;
+        nus_samples = 0;
+        transfer_length = 0;
+        transfer_open = true;
+    }
+
+    if (p_block->type == BLOCK_FRAME) {
+        encode_frame(p_block);
+    }
+    else
+    {
+        send_transfer(p_block);
+        transfer_open = false;
+    }
+    block_free(p_block);
+}
+
+/* Power AD8232 up or down */
+static void ad8232_power(bool on)
+{
+    int err = gpio_pin_set_dt(&ad8232_pwr_pin_dt, on);
+    if (err != 0) {
+        LOG_ERR("failed to %s ad8232 power pin (code %d)", on ? "set" : "clear", err);
+    }
+}
+
+/* Resume or suspend what acquisition needs besides AD8232: ADC and lead-off
+ * interrupts, whose GPIOTE channels keep drawing current while idle */
+static void peripherals_power(bool on)
 {
-    if (BLE_IsSendEnabled())
+    gpio_flags_t flags = on ? GPIO_INT_EDGE_BOTH : GPIO_INT_DISABLE;
+
+    int err = on ? pm_device_runtime_get(adc_dev) : pm_device_runtime_put(adc_dev);
+    if (err != 0) {
+        LOG_ERR("failed to %s ADC (code %d)", on ? "resume" : "suspend", err);
+    }
+
+    err = gpio_pin_interrupt_configure_dt(&ad8232_lodp_pin_dt, flags);
+    err |= gpio_pin_interrupt_configure_dt(&ad8232_lodn_pin_dt, flags);
+    if (err != 0) {
+        LOG_ERR("failed to %s ad8232 lead-off interrupts (code %d)", on ? "enable" : "disable", err);
+    }
+}
+
+/* Lead off status, bit 0 is LA and bit 1 is RA */
+static uint16_t read_lead_status(void)
+{
+    uint16_t status = gpio_pin_get_dt(&ad8232_lodn_pin_dt) << 1; // RA (0 or 2)
+    status += gpio_pin_get_dt(&ad8232_lodp_pin_dt);             // LA (0 or 1)
+    return status;
+}
+
+static void lead_off_isr(const struct device * port, struct gpio_callback * cb, gpio_port_pins_t pins)
+{
+    uint16_t status = read_lead_status();
+
+    k_spinlock_key_t key = k_spin_lock(&lead_lock);
+    if (lead_event_count < LEAD_MAX_CHANGES)
     {
-        memcpy(ecgBuffer.data, buffer_to_send, 2 * ADC_SAMPLE_NUM);
-        ecgBuffer.lodpn = lodpn;
-        ecgBuffer.timestamp.time = timestamp;
-        ecgBuffer.timestamp.us = us;
-        pb_ostream_t ostream = pb_ostream_from_buffer(proto_buffer + 1, EcgBuffer_size);
-
-        bool pb_ret = pb_encode(&ostream, EcgBuffer_fields, &ecgBuffer);
-        if (pb_ret == false) {
-            LOG_ERR("Error while encoding protobuf : %s", ostream.errmsg);
-             return;
-        }
-        proto_buffer[0] = COBS_INPLACE_SENTINEL_VALUE;
-        proto_buffer[ostream.bytes_written + 1] = COBS_INPLACE_SENTINEL_VALUE;
-        //ostream.bytes_written + 2 <= COBS_INPLACE_SAFE_BUFFER_SIZE ?
-        cobs_ret_t cobs_ret = cobs_encode_inplace(proto_buffer, ostream.bytes_written + 2);
-        // check for cobs_ret value
-        if (cobs_ret != COBS_RET_SUCCESS) {
-            LOG_ERR("Error while encoding COBS message (err %u)", cobs_ret);
-             return;
-        }
-        BLE_Send((uint8_t *)proto_buffer, ostream.bytes_written + 2);
-    }
-}
\ No newline at end of file
+        lead_events[lead_event_count].ticks = k_uptime_ticks();
+        lead_events[lead_event_count].lodpn = status;
+        lead_event_count++;
+    }
+    else {
+        /* Leads are bouncing, keep them off until end of buffer */
+        lead_events[LEAD_MAX_CHANGES - 1].lodpn |= status;
+    }
+    k_spin_unlock(&lead_lock, key);
+
+    atomic_set(&lead_status, status);
+    k_sem_give(&lead_sem);
+}
+
+/* SAADC interrupt, software time of buffer is replaced by first conversion time */
+static enum adc_action sample_done(const struct device * dev, const struct adc_sequence * p_sequence,
+                                   uint16_t sampling_index)
+{
+    if (sampling_index == 0) {
+        CAL_CaptureGet(ADC_DONE_DELAY, &timestamp, &us);
+    }
+    return ADC_ACTION_CONTINUE;
+}
+
+/* Convert lead status changes during last acquisition into sample indices of its block */
+static void collect_lead_changes(meas_block_t * p_block)
+{
+    k_spinlock_key_t key = k_spin_lock(&lead_lock);
+    p_block->buffer.change_count = LEADS_Locate(lead_events, lead_event_count, buffer_start_ticks,
+                                                config.ticks, config.samples, p_block->lodpn,
+                                                p_block->buffer.changes);
+    lead_event_count = 0;
+    k_spin_unlock(&lead_lock, key);
+}
+
+/* Append a status change at current sample of output frame as (run length, status) */
+static void add_lead_change(meas_output_t * p_output, uint16_t status)
+{
+    p_output->status = status;
+    /* Frame is dropped, only status is tracked */
+    if (p_output->p_frame != NULL) {
+        LEADS_Add(&p_output->runs, p_output->count, status);
+    }
+}
+
+/* Pause acquisition until both electrodes are in contact, with lead status heartbeats */
+static void wait_for_contact(void)
+{
+    int64_t next_heartbeat = k_uptime_get();
+
+    LOG_INF("Leads off, waveform paused");
+    k_sem_reset(&lead_sem);
+#if defined(CONFIG_APP_LEADOFF_POWER_DOWN)
+    ad8232_power(false);
+#endif
+
+    while (1)
+    {
+        int64_t now = k_uptime_get();
+        if (now >= next_heartbeat)
+        {
+            SCHED_Submit(&send_work_q, &lead_status_send);
+            next_heartbeat = now + LEADOFF_HEARTBEAT_MS;
+        }
+
+#if defined(CONFIG_APP_LEADOFF_POWER_DOWN)
+        /* Comparators are off too, probe contact once per buffer */
+        k_usleep(config.samples * sequence_options.interval_us);
+        ad8232_power(true);
+        k_usleep(LEADOFF_PROBE_SETTLE_US);
+        atomic_set(&lead_status, read_lead_status());
+        if (atomic_get(&lead_status) == 0) {
+            break;
+        }
+        ad8232_power(false);
+#else
+        /* Woken up by lead-off pins interrupts */
+        k_sem_take(&lead_sem, K_MSEC(next_heartbeat - now));
+        if (atomic_get(&lead_status) == 0) {
+            break;
+        }
+#endif
+    }
+
+    /* Samples are not contiguous with previous buffers */
+    restart_processing();
+    LOG_INF("Leads on, waveform resumed");
+}
+
+static void send_lead_status(struct k_work *work)
+{
+    LeadStatus * p_status = &leadStatusPacket.payload.lead_status;
+    uint64_t time;
+    uint32_t time_us;
+
+    if (!BLE_IsSendEnabled()) {
+        return;
+    }
+
+    CAL_GetTime(&time, &time_us);
+    p_status->timestamp.time = time;
+    p_status->timestamp.us = time_us;
+    p_status->lodpn = atomic_get(&lead_status);
+    p_status->powered = !IS_ENABLED(CONFIG_APP_LEADOFF_POWER_DOWN);
+
+    int ret = CODEC_Encode(Packet_fields, &leadStatusPacket, lead_status_buffer, sizeof(lead_status_buffer));
+    if (ret > 0) {
+        BLE_Send(lead_status_buffer, ret);
+    }
+}
+
+/* Point ADC sequence to next burst segment, return false if no segment is due */
+static bool burst_read_setup(void)
+{
+    if (atomic_get(&burst.state) != BURST_CAPTURE) {
+        return false;
+    }
+    sequence.buffer = &burst_samples[burst.captured * burst.segment_len];
+    sequence.buffer_size = burst.segment_len * sizeof(int16_t);
+    sequence_options.extra_samplings = burst.segment_len - 1;
+    sequence_options.interval_us = burst.interval_us;
+    return true;
+}
+
+/* Fill acquisition buffer from burst segment and restore ADC sequence */
+static void burst_read_done(int16_t * p_buffer)
+{
+    const int16_t * p_segment = sequence.buffer;
+
+    for (uint16_t i = 0; i < config.samples; i++) {
+        p_buffer[i] = p_segment[i * burst.factor];
+    }
+    burst.start[burst.captured].time = timestamp;
+    burst.start[burst.captured].us = us;
+
+    sequence.buffer = p_buffer;
+    sequence.buffer_size = config.samples * sizeof(int16_t);
+    sequence_options.extra_samplings = config.samples - 1;
+    sequence_options.interval_us = k_ticks_to_us_floor32(config.ticks);
+
+    if (++burst.captured == burst.segments) {
+        atomic_set(&burst.state, BURST_UPLOAD);
+    }
+}
+
+/* Start armed burst on next buffer once a sample step exceeds trigger level */
+static void burst_check_trigger(const meas_block_t * p_block)
+{
+    if (atomic_get(&burst.state) != BURST_ARMED) {
+        return;
+    }
+    for (uint16_t i = 1; i < p_block->count; i++)
+    {
+        if (abs(p_block->data[i] - p_block->data[i - 1]) >= burst.trigger)
+        {
+            atomic_cas(&burst.state, BURST_ARMED, BURST_CAPTURE);
+            return;
+        }
+    }
+}
+
+/* Encode next part of captured burst, never across segments, return bytes added to NUS buffer */
+static int burst_upload(uint8_t * p_nus_buffer, size_t size)
+{
+    if (atomic_get(&burst.state) != BURST_UPLOAD) {
+        return 0;
+    }
+
+    BurstBuffer * p_burst = &burstPacket.payload.burst;
+    size_t segment = burst.sent / burst.segment_len;
+    size_t offset = burst.sent % burst.segment_len;
+    size_t count = MIN(BURST_UPLOAD_SAMPLES, burst.segment_len - offset);
+
+    int64_t time_ns = (int64_t)burst.start[segment].time * NSEC_PER_SEC
+                    + (int64_t)burst.start[segment].us * NSEC_PER_USEC
+                    + (int64_t)offset * burst.period_ns;
+    p_burst->timestamp.time = time_ns / NSEC_PER_SEC;
+    p_burst->timestamp.us = (time_ns % NSEC_PER_SEC) / NSEC_PER_USEC;
+    p_burst->id = burst.id;
+    /* Segments start on acquisition buffers boundaries */
+    p_burst->index = segment * burst.samples * burst.factor + offset;
+    p_burst->period_ns = burst.period_ns;
+    p_burst->data.size = count * sizeof(int16_t);
+    memcpy(p_burst->data.bytes, &burst_samples[burst.sent], p_burst->data.size);
+    p_burst->last = (burst.sent + count == burst.segments * burst.segment_len);
+
+    int ret = CODEC_Encode(Packet_fields, &burstPacket, p_nus_buffer, size);
+    if (ret < 0) {
+        return 0;
+    }
+
+    burst.sent += count;
+    if (p_burst->last) {
+        atomic_set(&burst.state, BURST_IDLE);
+    }
+    return ret;
+}
+
+/* Send frames gathered since last transfer along heart rate, burst, energy and
+ * retransmitted packets, then stats, called when the buffer they come from reaches encode stage */
+static void send_transfer(const meas_block_t * p_block)
+{
+    size_t length = transfer_length;
+
+    if (!nus_enabled || nus_busy) {
+        return;
+    }
+
+    if (p_block->buffer.heart_rate.rr_count > 0)
+    {
+        heartRatePacket.payload.heart_rate = p_block->buffer.heart_rate;
+        int hr_ret = CODEC_Encode(Packet_fields, &heartRatePacket, proto_buffer + length,
+                                  sizeof(proto_buffer) - length);
+        if (hr_ret > 0) {
+            length += hr_ret;
+        }
+    }
+    /* Captured burst is sent little by little along the stream */
+    length += burst_upload(proto_buffer + length, sizeof(proto_buffer) - length);
+    length += energy_upload(proto_buffer + length, sizeof(proto_buffer) - length);
+    /* Lost frames go last, so that they never delay live ones */
+    length += resend_frames(proto_buffer + length, sizeof(proto_buffer) - length);
+    if (length > 0)
+    {
+        PROF_START(PROF_BLE_SEND);
+        int err = BLE_Send((uint8_t *)proto_buffer, length);
+        PROF_STOP(PROF_BLE_SEND);
+        if (err == 0) {
+            STATS_Add(STATS_FRAMES_SENT, nus_frames);
+            ENERGY_AddSamples(nus_samples);
+            send_latency_update(p_block);
+        }
+        else {
+            STATS_Add((err == -EBUSY) ? STATS_DROPPED_BUSY : STATS_DROPPED_DISABLED, nus_frames);
+        }
+    }
+    stats_send(true);
+}
+
+/* Time from ADC buffer completion to its transfer being queued (first notification
+ * is sent from there when a central is idle), next buffer is the deadline */
+static void send_latency_update(const meas_block_t * p_block)
+{
+    uint32_t latency_us = k_cyc_to_us_floor32(k_cycle_get_32() - p_block->buffer.ready);
+    uint32_t frame_us = ((uint64_t)p_block->count * p_block->buffer.config.period_ns) / NSEC_PER_USEC;
+
+    STATS_Max(STATS_SEND_LATENCY_MAX, latency_us);
+    if (latency_us > frame_us) {
+        STATS_Add(STATS_SEND_LATE, 1);
+    }
+}
+
+/* Send stats packets once per period to every central, or to the ones that
+ * asked for them, each with its own counters, after the transfer they count */
+static void stats_send(bool periodic)
+{
+    uint32_t links = atomic_clear(&stats_links);
+    int64_t now = k_uptime_get();
+
+    if (periodic && now >= next_stats)
+    {
+        next_stats = now + STATS_PERIOD_MS;
+        links = BIT_MASK(CONFIG_BT_MAX_CONN);
+    }
+    if (links == 0) {
+        return;
+    }
+
+    statsPacket.payload.stats.next_sequence = nus_sequence;
+    PIPE_GetStats(&dsp_stage, &statsPacket.payload.stats.dsp);
+    PIPE_GetStats(&encode_stage, &statsPacket.payload.stats.encode);
+    statsPacket.payload.stats.wakeups_per_sec = SCHED_GetWakeupRate();
+    statsPacket.payload.stats.has_dsp = true;
+    statsPacket.payload.stats.has_encode = true;
+
+    for (uint8_t i = 0; i < CONFIG_BT_MAX_CONN; i++)
+    {
+        if (!(links & BIT(i)) || !BLE_IsLinkSendEnabled(i)) {
+            continue;
+        }
+        STATS_Get(i, &statsPacket.payload.stats);
+        int ret = CODEC_Encode(Packet_fields, &statsPacket, stats_buffer, sizeof(stats_buffer));
+        if (ret > 0) {
+            BLE_SendTo(i, stats_buffer, ret);
+        }
+    }
+}
+
+/* Encode energy report once per fuel gauge reading, return bytes added to NUS buffer */
+static int energy_upload(uint8_t * p_nus_buffer, size_t size)
+{
+    if (!ENERGY_Get(&energyPacket.payload.energy) ||
+        energyPacket.payload.energy.sequence == energy_sequence) {
+        return 0;
+    }
+
+    int ret = CODEC_Encode(Packet_fields, &energyPacket, p_nus_buffer, size);
+    if (ret <= 0) {
+        return 0;
+    }
+    energy_sequence = energyPacket.payload.energy.sequence;
+    return ret;
+}
+
+/* Account SAADC time of last sequence, each sample averages 2^oversampling conversions */
+static void adc_count_active(void)
+{
+    uint32_t conversions = (sequence_options.extra_samplings + 1) << sequence.oversampling;
+
+    ENERGY_AddActive(ENERGY_ADC, conversions * (ADC_ACQ_TIME_US + ADC_CONV_TIME_US));
+}
+
+/* Append requested frames from history, return bytes added to NUS buffer */
+static int resend_frames(uint8_t * p_nus_buffer, size_t size)
+{
+    size_t length = 0;
+    size_t limit = size;
+    int ret;
+
+    /* First frame is always allowed, whatever its size, then budget applies */
+    while ((ret = HIST_Next(p_nus_buffer + length, limit - length)) > 0)
+    {
+        length += ret;
+        STATS_Add(STATS_FRAMES_RESENT, 1);
+        limit = MIN(size, MAX(RESEND_MAX_BYTES, length));
+    }
+    return length;
+}
+
+/* Decimate buffer into output frame, complete frame is forwarded to encode stage */
+static void process_output(meas_output_t * p_output, const meas_block_t * p_block)
+{
+    const meas_config_t * p_config = &p_block->buffer.config;
+
+    if (p_output->sinks == 0) {
+        return;
+    }
+
+    /* Input offset of first output sample in this buffer */
+    uint32_t first = p_output->decim.factor - 1 - p_output->decim.phase;
+    size_t count = DECIM_Process(&p_output->decim, p_block->data, p_block->count, decimated);
+    uint16_t status = p_block->lodpn;
+    uint8_t change = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t offset = first + i * p_output->decim.factor;
+        while (change < p_block->buffer.change_count && p_block->buffer.changes[change].index <= offset) {
+            status = p_block->buffer.changes[change++].lodpn;
+        }
+
+        if (p_output->count == 0)
+        {
+            /* Without a free block, samples of this frame are dropped */
+            if (p_output->p_frame == NULL) {
+                p_output->p_frame = block_alloc();
+            }
+            if (p_output->p_frame != NULL)
+            {
+                meas_block_t * p_frame = p_output->p_frame;
+                p_frame->type = BLOCK_FRAME;
+                buffer_time(p_block, 2 * (int64_t)offset - DECIM_GetDelay2(&p_output->decim), &p_frame->start);
+                p_frame->lodpn = status;
+                p_frame->frame.index = p_output->index;
+                LEADS_Begin(&p_output->runs, p_frame->frame.changes, ARRAY_SIZE(p_frame->frame.changes));
+            }
+            p_output->status = status;
+        }
+        else if (status != p_output->status) {
+            add_lead_change(p_output, status);
+        }
+        if (p_output->p_frame != NULL) {
+            p_output->p_frame->data[p_output->count] = decimated[i];
+        }
+        p_output->count++;
+        p_output->index++;
+
+        if (p_output->count < p_config->samples) {
+            continue;
+        }
+        p_output->count = 0;
+
+        meas_block_t * p_frame = p_output->p_frame;
+        p_output->p_frame = NULL;
+        uint32_t sequence = 0;
+        if (p_output->sinks & MEAS_SINK_NUS)
+        {
+            sequence = nus_sequence++;
+            STATS_Add(STATS_FRAMES_PRODUCED, 1);
+        }
+        if (p_frame == NULL)
+        {
+            if (p_output->sinks & MEAS_SINK_NUS) {
+                STATS_Add(STATS_DROPPED_BUSY, 1);
+            }
+            continue;
+        }
+
+        p_frame->count = p_config->samples;
+        p_frame->frame.change_count = p_output->runs.count;
+        p_frame->frame.sinks = p_output->sinks;
+        p_frame->frame.rate = p_config->rate / p_output->decim.factor;
+        p_frame->frame.period_ns = p_config->period_ns * p_output->decim.factor;
+        p_frame->frame.sequence = sequence;
+        p_frame->frame.anchor = true;
+        if (p_config->anchor_ms != 0) {
+            p_frame->frame.anchor = anchor_due(p_output, p_config, p_frame->frame.index, &p_frame->start);
+        }
+        else {
+            p_frame->frame.index = 0;
+        }
+
+        /* Encode stage full, frame is missing from the stream */
+        if (PIPE_Put(&encode_stage, p_frame) != 0)
+        {
+            if (p_output->sinks & MEAS_SINK_NUS) {
+                STATS_Add(STATS_DROPPED_BUSY, 1);
+            }
+            block_free(p_frame);
+        }
+    }
+}
+
+/* Encode a frame to its sinks, NUS frames are added to the transfer being built */
+static void encode_frame(const meas_block_t * p_frame)
+{
+    uint8_t sinks = p_frame->frame.sinks;
+
+    PROF_START(PROF_FRAME_COPY);
+    ecgBuffer.data.size = p_frame->count * sizeof(int16_t);
+    memcpy(ecgBuffer.data.bytes, p_frame->data, ecgBuffer.data.size);
+    ecgBuffer.lodpn = p_frame->lodpn;
+    ecgBuffer.lodpn_changes_count = p_frame->frame.change_count;
+    memcpy(ecgBuffer.lodpn_changes, p_frame->frame.changes, p_frame->frame.change_count * sizeof(uint32_t));
+    ecgBuffer.rate = p_frame->frame.rate;
+    ecgBuffer.period_ns = p_frame->frame.period_ns;
+    ecgBuffer.timestamp = p_frame->start;
+    ecgBuffer.has_timestamp = p_frame->frame.anchor;
+    ecgBuffer.index = p_frame->frame.index;
+    ecgBuffer.sequence = p_frame->frame.sequence;
+    PROF_STOP(PROF_FRAME_COPY);
+
+    /* Encoded once for all sinks */
+    int ret = CODEC_Encode(EcgBuffer_fields, &ecgBuffer, frame_buffer, sizeof(frame_buffer));
+    if (ret > 0 && (sinks & MEAS_SINK_BROADCAST)) {
+        BCAST_Push(frame_buffer, ret);
+    }
+
+    if (sinks & MEAS_SINK_NUS)
+    {
+        /* Every frame is kept for retransmission, even if it cannot be sent now */
+        if (ret > 0) {
+            HIST_Store(ecgBuffer.sequence, frame_buffer, ret);
+        }
+
+        if (ret <= 0 || ret > sizeof(proto_buffer) - transfer_length) {
+            STATS_Add(STATS_DROPPED_ENCODE, 1);
+        }
+        else if (!nus_enabled) {
+            STATS_Add(STATS_DROPPED_DISABLED, 1);
+        }
+        else if (nus_busy) {
+            STATS_Add(STATS_DROPPED_BUSY, 1);
+        }
+        else
+        {
+            PROF_START(PROF_TRANSFER_COPY);
+            memcpy(proto_buffer + transfer_length, frame_buffer, ret);
+            PROF_STOP(PROF_TRANSFER_COPY);
+            transfer_length += ret;
+            nus_frames++;
+            nus_samples += p_frame->count;
+            STATS_Add(STATS_FRAMES_ENCODED, 1);
+        }
+    }
+}
+
+/* Compact mode: tell if a frame of an output carries a timestamp. Each buffer
+ * is a new ADC sequence restarted by software, so buffer starts are not on the
+ * sample grid: a frame whose captured start is more than one sample away from
+ * the time hosts predict from last anchor carries one too. */
+static bool anchor_due(meas_output_t * p_output, const meas_config_t * p_config, uint32_t start_index,
+                       const Timestamp * p_start)
+{
+    uint8_t output = p_output - outputs;
+    uint64_t period_ns = (uint64_t)p_config->period_ns * p_output->decim.factor;
+    uint32_t elapsed = start_index - p_output->anchor_index;
+    int64_t start_us = (int64_t)p_start->time * USEC_PER_SEC + p_start->us;
+    int64_t predicted_us = p_output->anchor_us + (int64_t)((elapsed * period_ns) / NSEC_PER_USEC);
+
+    if (!atomic_test_and_clear_bit(&anchor_request, output) &&
+        elapsed * period_ns < (uint64_t)p_config->anchor_ms * NSEC_PER_MSEC &&
+        (uint64_t)llabs(start_us - predicted_us) * NSEC_PER_USEC <= period_ns) {
+        return false;
+    }
+    p_output->anchor_index = start_index;
+    p_output->anchor_us = start_us;
+    return true;
+}
+
+/* Time of a sample from its offset, in half samples, to the first sample of a buffer */
+static void buffer_time(const meas_block_t * p_block, int64_t half_offset, Timestamp * p_time)
+{
+    int64_t time_us = (int64_t)p_block->start.time * USEC_PER_SEC + p_block->start.us
+                    + (half_offset * p_block->buffer.config.period_ns) / (2 * NSEC_PER_USEC);
+    p_time->time = time_us / USEC_PER_SEC;
+    p_time->us = time_us % USEC_PER_SEC;
+}
+
+/* Run QRS detector on a buffer, notify HRS and keep RR intervals found in buffer block */
+static void detect_beats(meas_block_t * p_block)
+{
+    qrs_beat_t beats[QRS_MAX_BEATS];
+    uint16_t rr[QRS_MAX_BEATS];
+    HeartRate * p_hr = &p_block->buffer.heart_rate;
+    uint64_t period_ns = p_block->buffer.config.period_ns;
+
+    size_t count = QRS_Process(p_block->data, p_block->count, beats, QRS_MAX_BEATS);
+    /* Beat indices count processed samples only, not buffer indices */
+    uint32_t first = qrs_samples;
+    qrs_samples += p_block->count;
+
+    p_hr->rr_count = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        /* First beat after reset has no previous R-peak */
+        if (beats[i].rr == 0) {
+            continue;
+        }
+        uint64_t rr_ns = beats[i].rr * period_ns;
+        rr[p_hr->rr_count] = (rr_ns * RR_UNITS_PER_SEC) / NSEC_PER_SEC;
+        p_hr->rr[p_hr->rr_count] = rr[p_hr->rr_count];
+        p_hr->bpm = (60 * (uint64_t)NSEC_PER_SEC) / rr_ns;
+        p_hr->rr_count++;
+    }
+
+    if (p_hr->rr_count == 0) {
+        return;
+    }
+
+    /* R-peak is usually located in a previous buffer, as detection is delayed */
+    int32_t offset = (int32_t)(beats[count - 1].index - first);
+    p_hr->has_timestamp = true;
+    buffer_time(p_block, 2 * (int64_t)offset, &p_hr->timestamp);
+
+    BLE_SendHeartRate(p_hr->bpm, rr, p_hr->rr_count, atomic_get(&lead_status) == 0);
+}
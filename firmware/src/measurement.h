@@ -18,14 +18,35 @@ extern "C" {
  * INCLUDES
  ******************************************************************************/
 
+#include <stdint.h>
+#include <stdbool.h>
+
+struct k_work_q;
+
 /*******************************************************************************
  * MACROS AND DEFINES
  ******************************************************************************/
 
+#define MEAS_NUM_OUTPUTS    2   /**< Number of simultaneous output rates */
+
 /*******************************************************************************
  * TYPEDEFS
  ******************************************************************************/
 
+/* Output frames destinations, an output can feed several of them */
+typedef enum
+{
+    MEAS_SINK_NUS       = 0x01, /**< Transfers to subscribed centrals, kept for retransmission */
+    MEAS_SINK_BROADCAST = 0x02, /**< Periodic advertising, while broadcasting */
+} meas_sink_t;
+
+/* Buffer sink callback, receives raw samples of each acquisition buffer to be
+ * copied before returning, e.g. REC_Append(). Rate is nominal, samples are
+ * period_ns apart. */
+typedef void (*MEAS_BufferCallback_t)(const int16_t * p_samples, uint16_t count, uint16_t rate,
+                                      uint32_t period_ns, uint64_t time_us, uint16_t lodpn,
+                                      bool contiguous);
+
 /*******************************************************************************
  * EXPORTED VARIABLES
  ******************************************************************************/
@@ -40,6 +61,78 @@ void MEAS_Enable(bool enable);
 
 void MEAS_Read(void);
 
+/**
+ * @brief Select sample rate and frame duration, applied from next buffer
+ * @param [in] rate sample rate (250, 256, 500, 512 or 1000 Hz)
+ * @param [in] frame_ms frame duration (50 to 1000 ms), 0 for default 100 samples per frame
+ * @param [in] anchor_ms compact mode, frames carry a sample index and a
+ * timestamp only every anchor_ms (1000 to 60000 ms), 0 for timestamp in every frame
+ * @return 0 on success, -EINVAL on unsupported setting
+ */
+int MEAS_Configure(uint16_t rate, uint16_t frame_ms, uint16_t anchor_ms);
+
+/**
+ * @brief Send a timestamp with next frame of each output in compact mode,
+ * e.g. after the clock was set
+ */
+void MEAS_RequestAnchor(void);
+
+/**
+ * @brief Workqueue building and sending transfers, where requests changing
+ * acquisition state are run too so that they never interleave with a transfer
+ * @return send pipeline workqueue, started by MEAS_Init()
+ */
+struct k_work_q * MEAS_GetWorkQueue(void);
+
+/**
+ * @brief Send a Stats packet to a central, after next transfer while
+ * acquiring so that counters match the frames before it, at once otherwise.
+ * Called from MEAS_GetWorkQueue(), where transfers are built.
+ * @param [in] link central index
+ */
+void MEAS_RequestStats(uint8_t link);
+
+/**
+ * @brief Capture a high rate burst, uploaded in background as BurstBuffer
+ * packets along the regular stream which goes on during capture
+ * @param [in] rate burst sample rate, multiple of acquisition rate up to 4096 Hz,
+ * whose factor divides the acquisition interval in kernel ticks (e.g. 2, 4 or
+ * 8 at 512 Hz, 2, 3, 4, 6, 11 or 12 at 250 Hz)
+ * @param [in] duration_ms capture window, rounded up to whole acquisition buffers
+ * @param [in] trigger step between consecutive samples (ADC LSB) starting
+ * capture on next buffer, 0 to start on next buffer
+ * @return 0 on success, -EINVAL on unsupported setting, -EBUSY if previous
+ * burst is not uploaded yet
+ */
+int MEAS_RequestBurst(uint16_t rate, uint16_t duration_ms, uint16_t trigger);
+
+/**
+ * @brief Set decimation factor and destinations of an output, each output
+ * frame is tagged with its own sample rate. Outputs are back to defaults
+ * (full rate to NUS and broadcast, 128 Hz unrouted) when acquisition stops.
+ * Called from MEAS_GetWorkQueue(), where frames are produced.
+ * @param [in] output output index (0 to MEAS_NUM_OUTPUTS - 1)
+ * @param [in] factor decimation factor from acquisition rate (1, 2 or 4)
+ * @param [in] sinks frames destinations (meas_sink_t flags), 0 disables output
+ * @return 0 on success, -EINVAL on wrong parameter
+ */
+int MEAS_SetOutput(uint8_t output, uint8_t factor, uint8_t sinks);
+
+/**
+ * @brief Attach a function receiving every acquisition buffer before
+ * decimation, whatever the connection state
+ * @param [in] callback function called from MEAS_GetWorkQueue()
+ * @return 0 on success, -EALREADY if already attached, -ENOMEM if all sink
+ * slots are used
+ */
+int MEAS_AttachBufferSink(MEAS_BufferCallback_t callback);
+
+/**
+ * @brief Detach a buffer sink, does nothing if not attached
+ * @param [in] callback function given to MEAS_AttachBufferSink()
+ */
+void MEAS_DetachBufferSink(MEAS_BufferCallback_t callback);
+
 /**
  * @brief Thread to execute impedance measurement into a separate thread
  * which can be controlled / monitored
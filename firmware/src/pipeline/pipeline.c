@@ -0,0 +1,150 @@
+/**
+ *******************************************************************************
+ * @file    pipeline.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Processing pipeline stages module source file
+ *
+ * Stages are connected by FIFOs of blocks taken from memory slabs by their
+ * producer, so samples are never copied from one stage to the next. Each
+ * stage bounds the blocks waiting for it: a full stage refuses new blocks,
+ * which its producer drops and counts, instead of exhausting the slab shared
+ * with the stages upstream. Handling time of each block is measured with the
+ * kernel cycle counter, and accounted as CPU active time.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <errno.h>
+#include <stdint.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+
+/* Application includes */
+#include "pipeline.h"
+#include "energy/energy.h"
+
+/*******************************************************************************
+ * EXTERN VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define PIPE_AVG_SHIFT      4   /**< Handling time average weight of new block (1/16) */
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+static void stage_work_handler(struct k_work * work);
+
+/*******************************************************************************
+ * GLOBAL FUNCTIONS
+ ******************************************************************************/
+
+void PIPE_Init(pipe_stage_t * p_stage, const char * name, PIPE_Handler_t handler,
+               uint8_t depth, struct k_work_q * p_queue)
+{
+    p_stage->name = name;
+    p_stage->handler = handler;
+    p_stage->depth = depth;
+    p_stage->p_queue = p_queue;
+    p_stage->submit = NULL;
+    k_fifo_init(&p_stage->fifo);
+    k_work_init(&p_stage->work, stage_work_handler);
+    atomic_clear(&p_stage->queued);
+    PIPE_ResetStats(p_stage);
+}
+
+void PIPE_SetSubmit(pipe_stage_t * p_stage, PIPE_Submit_t submit)
+{
+    p_stage->submit = submit;
+}
+
+int PIPE_Put(pipe_stage_t * p_stage, void * p_block)
+{
+    atomic_val_t queued = atomic_inc(&p_stage->queued) + 1;
+
+    if (queued > p_stage->depth)
+    {
+        atomic_dec(&p_stage->queued);
+        atomic_inc(&p_stage->dropped);
+        return -ENOBUFS;
+    }
+    if (queued > atomic_get(&p_stage->queued_max)) {
+        atomic_set(&p_stage->queued_max, queued);
+    }
+
+    k_fifo_put(&p_stage->fifo, p_block);
+    /* Last free slot is kept for the block coming while work runs, so the
+     * stage is never held longer than it can absorb */
+    if (p_stage->submit != NULL && queued < p_stage->depth - 1) {
+        p_stage->submit(p_stage->p_queue, &p_stage->work);
+    }
+    else {
+        k_work_submit_to_queue(p_stage->p_queue, &p_stage->work);
+    }
+    return 0;
+}
+
+void PIPE_ResetStats(pipe_stage_t * p_stage)
+{
+    atomic_set(&p_stage->queued_max, atomic_get(&p_stage->queued));
+    atomic_clear(&p_stage->processed);
+    atomic_clear(&p_stage->dropped);
+    atomic_clear(&p_stage->cycles_max);
+    atomic_clear(&p_stage->cycles_avg);
+}
+
+void PIPE_GetStats(pipe_stage_t * p_stage, StageStats * p_stats)
+{
+    p_stats->processed = atomic_get(&p_stage->processed);
+    p_stats->dropped = atomic_get(&p_stage->dropped);
+    p_stats->queued_max = atomic_get(&p_stage->queued_max);
+    p_stats->time_max_us = k_cyc_to_us_floor32(atomic_get(&p_stage->cycles_max));
+    p_stats->time_avg_us = k_cyc_to_us_floor32(atomic_get(&p_stage->cycles_avg));
+}
+
+/*******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
+
+/* Handle all waiting blocks, blocks forwarded meanwhile run next stage right after */
+static void stage_work_handler(struct k_work * work)
+{
+    pipe_stage_t * p_stage = CONTAINER_OF(work, pipe_stage_t, work);
+    void * p_block;
+
+    while ((p_block = k_fifo_get(&p_stage->fifo, K_NO_WAIT)) != NULL)
+    {
+        atomic_dec(&p_stage->queued);
+
+        uint32_t start = k_cycle_get_32();
+        p_stage->handler(p_block);
+        uint32_t cycles = k_cycle_get_32() - start;
+
+        /* Handler runs from one workqueue only, so counters have a single writer */
+        atomic_val_t avg = atomic_get(&p_stage->cycles_avg);
+        atomic_set(&p_stage->cycles_avg, avg + (((int32_t)cycles - (int32_t)avg) >> PIPE_AVG_SHIFT));
+        if (cycles > (uint32_t)atomic_get(&p_stage->cycles_max)) {
+            atomic_set(&p_stage->cycles_max, cycles);
+        }
+        atomic_inc(&p_stage->processed);
+        ENERGY_AddActive(ENERGY_CPU, k_cyc_to_us_floor32(cycles));
+    }
+}
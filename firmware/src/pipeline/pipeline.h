@@ -0,0 +1,114 @@
+/**
+ *******************************************************************************
+ * @file    pipeline.h
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Processing pipeline stages module header file
+ *******************************************************************************
+ */
+
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+
+#include "protocol/protocol.pb.h"
+
+/*******************************************************************************
+ * MACROS AND DEFINES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * TYPEDEFS
+ ******************************************************************************/
+
+/* Block handler, owns the block from then on (forward it to next stage or free it) */
+typedef void (*PIPE_Handler_t)(void * p_block);
+
+/* Stage work submission, e.g. to run it along other work */
+typedef void (*PIPE_Submit_t)(struct k_work_q * p_queue, struct k_work * p_work);
+
+/* Stage of the pipeline, blocks are passed by pointer in its FIFO and handled
+ * one by one from a workqueue. Blocks must start with a pointer sized field
+ * reserved for the FIFO. */
+typedef struct
+{
+    const char *      name;
+    PIPE_Handler_t    handler;
+    struct k_work_q * p_queue;
+    PIPE_Submit_t     submit;
+    struct k_fifo     fifo;
+    struct k_work     work;
+    uint8_t           depth;        /**< Waiting blocks beyond which new ones are refused */
+    atomic_t          queued;       /**< Blocks waiting */
+    atomic_t          queued_max;
+    atomic_t          processed;
+    atomic_t          dropped;      /**< Blocks refused as stage was full */
+    atomic_t          cycles_max;   /**< Longest handling of one block */
+    atomic_t          cycles_avg;   /**< Exponential average (1/16) of block handling */
+} pipe_stage_t;
+
+/*******************************************************************************
+ * EXPORTED VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/**
+ * @brief Initialize a stage, empty and with counters cleared
+ * @param [in] p_stage stage to initialize
+ * @param [in] name stage name, for logs
+ * @param [in] handler function called for each block
+ * @param [in] depth waiting blocks beyond which PIPE_Put() refuses new ones
+ * @param [in] p_queue workqueue running the handler
+ */
+void PIPE_Init(pipe_stage_t * p_stage, const char * name, PIPE_Handler_t handler,
+               uint8_t depth, struct k_work_q * p_queue);
+
+/**
+ * @brief Replace immediate submission of stage work, blocks then wait in
+ * stage FIFO until the function submits it. Work is still submitted at once
+ * when a block leaves only one free slot, whatever the function holds back.
+ * @param [in] p_stage stage
+ * @param [in] submit submission function, NULL for immediate submission
+ */
+void PIPE_SetSubmit(pipe_stage_t * p_stage, PIPE_Submit_t submit);
+
+/**
+ * @brief Pass a block to a stage, without copy
+ * @param [in] p_stage destination stage
+ * @param [in] p_block block, owned by the stage on success
+ * @return 0 on success, -ENOBUFS if stage is full, caller then keeps the block
+ */
+int PIPE_Put(pipe_stage_t * p_stage, void * p_block);
+
+/**
+ * @brief Clear counters of a stage
+ * @param [in] p_stage stage
+ */
+void PIPE_ResetStats(pipe_stage_t * p_stage);
+
+/**
+ * @brief Get counters of a stage
+ * @param [in] p_stage stage
+ * @param [out] p_stats counters, handling times in microseconds
+ */
+void PIPE_GetStats(pipe_stage_t * p_stage, StageStats * p_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIPELINE_H__ */
@@ -0,0 +1,148 @@
+/**
+ *******************************************************************************
+ * @file    profile.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Hot path cycle profiling module source file
+ *
+ * Each section keeps a log2 histogram of its durations, so that rare slow
+ * runs show next to the typical ones at a fixed RAM cost: bucket 0 counts
+ * durations of 0 cycles, bucket i durations from 2^(i-1) to 2^i - 1 cycles,
+ * the last one all longer durations.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+
+/* Application includes */
+#include "profile.h"
+
+/*******************************************************************************
+ * EXTERN VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define PROF_BUCKETS        ARRAY_SIZE(((ProfilePoint *)0)->histogram)
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t histogram[PROF_BUCKETS];
+} prof_histogram_t;
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+#if defined(CONFIG_APP_PROFILING)
+static const char * const point_names[NUM_OF_PROF_POINTS] = {
+    [PROF_READ_SETUP]    = "read_setup",
+    [PROF_READ_DONE]     = "read_done",
+    [PROF_FRAME_COPY]    = "frame_copy",
+    [PROF_PB_ENCODE]     = "pb_encode",
+    [PROF_COBS]          = "cobs",
+    [PROF_TRANSFER_COPY] = "transfer_copy",
+    [PROF_BLE_SEND]      = "ble_send",
+};
+
+/* Sections run from several threads */
+static struct k_spinlock prof_lock;
+static prof_histogram_t histograms[NUM_OF_PROF_POINTS];
+#endif
+
+/*******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTIONS
+ ******************************************************************************/
+
+void PROF_Add(prof_point_t point, uint32_t cycles)
+{
+#if defined(CONFIG_APP_PROFILING)
+    if (point >= NUM_OF_PROF_POINTS) {
+        return;
+    }
+
+    uint32_t bucket = (cycles == 0) ? 0 : 32 - __builtin_clz(cycles);
+    bucket = MIN(bucket, PROF_BUCKETS - 1);
+
+    k_spinlock_key_t key = k_spin_lock(&prof_lock);
+    prof_histogram_t * p_histogram = &histograms[point];
+    if (p_histogram->count == 0 || cycles < p_histogram->min) {
+        p_histogram->min = cycles;
+    }
+    p_histogram->max = MAX(p_histogram->max, cycles);
+    p_histogram->total += cycles;
+    p_histogram->count++;
+    p_histogram->histogram[bucket]++;
+    k_spin_unlock(&prof_lock, key);
+#endif
+}
+
+bool PROF_Get(prof_point_t point, ProfilePoint * p_profile)
+{
+#if defined(CONFIG_APP_PROFILING)
+    if (point >= NUM_OF_PROF_POINTS) {
+        return false;
+    }
+
+    memset(p_profile, 0, sizeof(*p_profile));
+    strncpy(p_profile->name, point_names[point], sizeof(p_profile->name) - 1);
+    p_profile->cpu_hz = SystemCoreClock;
+
+    k_spinlock_key_t key = k_spin_lock(&prof_lock);
+    const prof_histogram_t * p_histogram = &histograms[point];
+    p_profile->count = p_histogram->count;
+    p_profile->min_cycles = p_histogram->min;
+    p_profile->max_cycles = p_histogram->max;
+    if (p_histogram->count > 0) {
+        p_profile->avg_cycles = p_histogram->total / p_histogram->count;
+    }
+    for (uint8_t i = 0; i < PROF_BUCKETS; i++)
+    {
+        p_profile->histogram[i] = p_histogram->histogram[i];
+        if (p_histogram->histogram[i] != 0) {
+            p_profile->histogram_count = i + 1;
+        }
+    }
+    k_spin_unlock(&prof_lock, key);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void PROF_Reset(void)
+{
+#if defined(CONFIG_APP_PROFILING)
+    k_spinlock_key_t key = k_spin_lock(&prof_lock);
+    memset(histograms, 0, sizeof(histograms));
+    k_spin_unlock(&prof_lock, key);
+#endif
+}
+
+/*******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
@@ -0,0 +1,102 @@
+/**
+ *******************************************************************************
+ * @file    profile.h
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Hot path cycle profiling module header file
+ *
+ * Built with CONFIG_APP_PROFILING only, macros compile to nothing otherwise.
+ * Durations are CPU cycles from the DWT cycle counter, started by LOAD_Init().
+ *******************************************************************************
+ */
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(CONFIG_APP_PROFILING)
+#include <cmsis_core.h>
+#endif
+
+#include "protocol/protocol.pb.h"
+
+/*******************************************************************************
+ * MACROS AND DEFINES
+ ******************************************************************************/
+
+#if defined(CONFIG_APP_PROFILING)
+#define PROF_CYCLES()               (DWT->CYCCNT)
+#define PROF_START(point)           uint32_t prof_start_##point = PROF_CYCLES()
+#define PROF_ELAPSED(point)         (PROF_CYCLES() - prof_start_##point)
+#define PROF_STOP(point)            PROF_Add(point, PROF_ELAPSED(point))
+#define PROF_ACCUMULATE(point, sum) ((sum) += PROF_ELAPSED(point))
+#define PROF_ADD(point, cycles)     PROF_Add(point, cycles)
+#else
+#define PROF_START(point)
+#define PROF_ELAPSED(point)
+#define PROF_STOP(point)
+#define PROF_ACCUMULATE(point, sum)
+#define PROF_ADD(point, cycles)
+#endif
+
+/*******************************************************************************
+ * TYPEDEFS
+ ******************************************************************************/
+
+/* Profiled sections */
+typedef enum
+{
+    PROF_READ_SETUP = 0,    /**< MEAS_Read() up to ADC start: block, lead status, channel setup */
+    PROF_READ_DONE,         /**< MEAS_Read() after ADC sequence: lead changes, block handover */
+    PROF_FRAME_COPY,        /**< Frame samples and lead changes copied into ecgBuffer */
+    PROF_PB_ENCODE,         /**< pb_encode() of a framed message, COBS excluded */
+    PROF_COBS,              /**< COBS encoding of a framed message */
+    PROF_TRANSFER_COPY,     /**< Encoded frame copied into NUS transfer */
+    PROF_BLE_SEND,          /**< BLE_Send() of a transfer */
+    NUM_OF_PROF_POINTS,
+} prof_point_t;
+
+/*******************************************************************************
+ * EXPORTED VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/**
+ * @brief Add a duration to the histogram of a section, use PROF_STOP() or
+ * PROF_ADD() instead so that it compiles to nothing when disabled
+ * @param [in] point profiled section
+ * @param [in] cycles duration in CPU cycles
+ */
+void PROF_Add(prof_point_t point, uint32_t cycles);
+
+/**
+ * @brief Get histogram of a section
+ * @param [in] point profiled section
+ * @param [out] p_profile histogram, trimmed after its last non empty bucket
+ * @return false if point does not exist or profiling is disabled
+ */
+bool PROF_Get(prof_point_t point, ProfilePoint * p_profile);
+
+/**
+ * @brief Clear all histograms
+ */
+void PROF_Reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PROFILE_H__ */
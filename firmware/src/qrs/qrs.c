@@ -0,0 +1,386 @@
+/**
+ *******************************************************************************
+ * @file    qrs.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Streaming QRS detector module source file
+ *
+ * Fixed point implementation of the Pan-Tompkins algorithm adapted to 250 Hz
+ * to 1 kHz sampling rates (window lengths are set from the rate on reset):
+ * band-pass (cascaded moving sums), five points derivative, squaring, moving
+ * window integration, then adaptive thresholds with refractory period, T-wave
+ * discrimination and search-back. R-peak is located as the maximum of the
+ * band-passed signal within the integration window of the detected QRS.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/sys/util.h>
+
+/* Application includes */
+#include "qrs.h"
+
+/*******************************************************************************
+ * EXTERN VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define MS_TO_SAMPLES(ms, rate)   (((ms) * (rate)) / 1000)
+
+#define LP_MAX_LEN          (QRS_MAX_SAMPLE_RATE / 32)          /**< Low-pass moving sum length (null at 32 Hz) */
+#define HP_MAX_LEN          (QRS_MAX_SAMPLE_RATE / 8)           /**< High-pass moving average length (125 ms) */
+#define MWI_MAX_LEN         MS_TO_SAMPLES(150, QRS_MAX_SAMPLE_RATE) /**< Moving window integration length */
+#define DERIV_DELAY         2                                   /**< Group delay of the five points derivative */
+#define HIST_LEN            4096                                /**< Band-passed signal history (power of 2) */
+
+#define LEARNING_PERIOD     MS_TO_SAMPLES(2000, s.rate) /**< Initial thresholds learning duration */
+#define REFRACTORY_PERIOD   MS_TO_SAMPLES(200, s.rate)  /**< No beat can occur closer than this */
+#define TWAVE_PERIOD        MS_TO_SAMPLES(360, s.rate)  /**< Candidates closer than this may be T-waves */
+#define RR_INIT             MS_TO_SAMPLES(1000, s.rate) /**< RR average until first beats are found */
+#define RR_MAX_MS           2000                        /**< Longest RR in average (30 bpm), pauses are not averaged */
+#define RR_MAX              MS_TO_SAMPLES(RR_MAX_MS, s.rate)
+#define SEARCHBACK_PERCENT  166                         /**< Missed beat looked for after this share of average RR */
+
+/* Search-back candidates are at most 166% of longest RR old, their integration window must still be in history */
+BUILD_ASSERT((HIST_LEN & (HIST_LEN - 1)) == 0, "History size must be a power of 2");
+BUILD_ASSERT(HIST_LEN > MS_TO_SAMPLES(RR_MAX_MS * SEARCHBACK_PERCENT / 100, QRS_MAX_SAMPLE_RATE)
+                        + MWI_MAX_LEN + DERIV_DELAY, "History must cover search-back at highest rate");
+
+#define SQUARE_SHIFT        8                   /**< Scaling applied after squaring to avoid overflow */
+#define DERIV_MAX           32767
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+typedef struct
+{
+    /* Sample counter (input time) */
+    uint32_t n;
+    uint32_t settled_n;         /**< No detection before this sample, filters restarted */
+
+    /* Windows lengths for current sampling rate */
+    uint16_t rate;
+    uint8_t  lp_len;
+    uint8_t  hp_len;
+    uint16_t mwi_len;
+    uint16_t bp_delay;
+
+    /* Band-pass filter */
+    int32_t  lp1_buf[LP_MAX_LEN];
+    int32_t  lp1_sum;
+    int32_t  lp2_buf[LP_MAX_LEN];
+    int32_t  lp2_sum;
+    uint8_t  lp_pos;
+    int32_t  hp_buf[HP_MAX_LEN];
+    int32_t  hp_sum;
+    uint8_t  hp_pos;
+
+    /* Derivative history */
+    int32_t  d_hist[4];
+
+    /* Moving window integration */
+    uint32_t mwi_buf[MWI_MAX_LEN];
+    uint32_t mwi_sum;
+    uint16_t mwi_pos;
+
+    /* Absolute band-passed signal history for R-peak location */
+    uint16_t hist[HIST_LEN];
+
+    /* Current peak candidate */
+    uint32_t peak;
+    uint32_t peak_n;
+    uint32_t peak_slope;
+
+    /* Adaptive thresholds */
+    uint32_t spki;
+    uint32_t npki;
+    uint32_t learn_max;
+    uint64_t learn_sum;
+
+    /* Last beat */
+    bool     has_beat;
+    uint32_t beat_n;            /**< MWI peak time of last beat */
+    uint32_t beat_r;            /**< R-peak time of last beat */
+    uint32_t beat_slope;
+    uint32_t rr_avg;
+
+    /* Best noise peak since last beat, used for search-back */
+    uint32_t sb_peak;
+    uint32_t sb_n;
+    uint32_t sb_slope;
+} qrs_state_t;
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+static qrs_state_t s;
+
+/*******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+static uint32_t filter_sample(int16_t x, uint32_t * p_slope);
+static bool classify_peak(uint32_t peak, uint32_t peak_n, uint32_t slope, qrs_beat_t * p_beat);
+static bool search_back(qrs_beat_t * p_beat);
+static bool is_twave(uint32_t peak_n, uint32_t slope);
+static bool accept_beat(uint32_t peak_n, uint32_t slope, qrs_beat_t * p_beat);
+
+/*******************************************************************************
+ * GLOBAL FUNCTIONS
+ ******************************************************************************/
+
+void QRS_Reset(uint16_t sample_rate)
+{
+    memset(&s, 0, sizeof(s));
+    s.rate     = MIN(sample_rate, QRS_MAX_SAMPLE_RATE);
+    s.lp_len   = s.rate / 32;
+    s.hp_len   = s.rate / 8;
+    s.mwi_len  = MS_TO_SAMPLES(150, s.rate);
+    /* Two cascaded moving sums then delayed sample of the high-pass filter */
+    s.bp_delay = (s.lp_len - 1) + (s.hp_len / 2);
+    s.rr_avg   = RR_INIT;
+}
+
+void QRS_Skip(void)
+{
+    /* Filters would mix both sides of the gap, they restart from rest */
+    memset(s.lp1_buf, 0, sizeof(s.lp1_buf));
+    memset(s.lp2_buf, 0, sizeof(s.lp2_buf));
+    memset(s.hp_buf, 0, sizeof(s.hp_buf));
+    memset(s.d_hist, 0, sizeof(s.d_hist));
+    memset(s.mwi_buf, 0, sizeof(s.mwi_buf));
+    s.lp1_sum = 0;
+    s.lp2_sum = 0;
+    s.hp_sum  = 0;
+    s.mwi_sum = 0;
+    s.settled_n = s.n + 2 * s.lp_len + s.hp_len + s.mwi_len + DERIV_DELAY;
+
+    /* Beats on both sides are not consecutive */
+    s.peak       = 0;
+    s.peak_slope = 0;
+    s.sb_peak    = 0;
+    s.has_beat   = false;
+}
+
+size_t QRS_Process(const int16_t * p_samples, size_t count,
+                   qrs_beat_t * p_beats, size_t max_beats)
+{
+    size_t num_beats = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t slope;
+        uint32_t mwi = filter_sample(p_samples[i], &slope);
+
+        if (s.n < LEARNING_PERIOD)
+        {
+            /* Gather statistics to initialize thresholds */
+            if (mwi > s.learn_max) {
+                s.learn_max = mwi;
+            }
+            s.learn_sum += mwi;
+            if (s.n == LEARNING_PERIOD - 1) {
+                s.spki = s.learn_max / 3;
+                s.npki = (uint32_t)(s.learn_sum / LEARNING_PERIOD) / 2;
+            }
+            s.n++;
+            continue;
+        }
+
+        /* Filters step response after a gap is not a beat */
+        if ((int32_t)(s.n - s.settled_n) < 0)
+        {
+            s.n++;
+            continue;
+        }
+
+        /* Follow rising edge of the integrated signal */
+        if (mwi > s.peak)
+        {
+            s.peak = mwi;
+            s.peak_n = s.n;
+        }
+        if (slope > s.peak_slope) {
+            s.peak_slope = slope;
+        }
+
+        /* A peak is complete once signal has fallen to half of its maximum */
+        if ((s.peak != 0) && (mwi < s.peak / 2))
+        {
+            if (num_beats < max_beats &&
+                classify_peak(s.peak, s.peak_n, s.peak_slope, &p_beats[num_beats])) {
+                num_beats++;
+            }
+            s.peak = 0;
+            s.peak_slope = 0;
+        }
+
+        /* Look back for a missed beat with lower threshold */
+        if (num_beats < max_beats && search_back(&p_beats[num_beats])) {
+            num_beats++;
+        }
+
+        s.n++;
+    }
+
+    return num_beats;
+}
+
+/*******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
+
+/* Run one sample through the filter chain, return integrated signal */
+static uint32_t filter_sample(int16_t x, uint32_t * p_slope)
+{
+    /* Low-pass: two cascaded moving sums (triangular impulse response) */
+    s.lp1_sum += x - s.lp1_buf[s.lp_pos];
+    s.lp1_buf[s.lp_pos] = x;
+    s.lp2_sum += s.lp1_sum - s.lp2_buf[s.lp_pos];
+    s.lp2_buf[s.lp_pos] = s.lp1_sum;
+    s.lp_pos = (s.lp_pos + 1) % s.lp_len;
+    int32_t lp = s.lp2_sum / s.lp_len;
+
+    /* High-pass: subtract moving average from delayed sample */
+    s.hp_sum += lp - s.hp_buf[s.hp_pos];
+    s.hp_buf[s.hp_pos] = lp;
+    int32_t bp = s.hp_buf[(s.hp_pos + s.hp_len - s.hp_len / 2) % s.hp_len] - (s.hp_sum / s.hp_len);
+    s.hp_pos = (s.hp_pos + 1) % s.hp_len;
+
+    /* Keep band-passed magnitude to locate R-peak afterwards */
+    uint32_t mag = (bp < 0) ? -bp : bp;
+    s.hist[s.n % HIST_LEN] = (mag > UINT16_MAX) ? UINT16_MAX : mag;
+
+    /* Derivative: (2x[n] + x[n-1] - x[n-3] - 2x[n-4]) / 8 */
+    int32_t d = (2 * bp + s.d_hist[0] - s.d_hist[2] - 2 * s.d_hist[3]) / 8;
+    s.d_hist[3] = s.d_hist[2];
+    s.d_hist[2] = s.d_hist[1];
+    s.d_hist[1] = s.d_hist[0];
+    s.d_hist[0] = bp;
+
+    /* Squaring */
+    uint32_t slope = (d < 0) ? -d : d;
+    if (slope > DERIV_MAX) {
+        slope = DERIV_MAX;
+    }
+    *p_slope = slope;
+    uint32_t sq = (slope * slope) >> SQUARE_SHIFT;
+
+    /* Moving window integration */
+    s.mwi_sum += sq - s.mwi_buf[s.mwi_pos];
+    s.mwi_buf[s.mwi_pos] = sq;
+    s.mwi_pos = (s.mwi_pos + 1) % s.mwi_len;
+
+    return s.mwi_sum / s.mwi_len;
+}
+
+/* Compare a complete peak with adaptive thresholds */
+static bool classify_peak(uint32_t peak, uint32_t peak_n, uint32_t slope, qrs_beat_t * p_beat)
+{
+    uint32_t threshold = s.npki + (s.spki - s.npki) / 4;
+    uint32_t elapsed = peak_n - s.beat_n;
+
+    if ((peak > threshold) && (!s.has_beat || elapsed > REFRACTORY_PERIOD))
+    {
+        if (is_twave(peak_n, slope))
+        {
+            s.npki = (peak + 7 * s.npki) / 8;
+            return false;
+        }
+        s.spki = (peak + 7 * s.spki) / 8;
+        return accept_beat(peak_n, slope, p_beat);
+    }
+
+    /* T-waves are never taken back as missed beats */
+    s.npki = (peak + 7 * s.npki) / 8;
+    if (peak > s.sb_peak && (!s.has_beat || elapsed > REFRACTORY_PERIOD) && !is_twave(peak_n, slope))
+    {
+        s.sb_peak  = peak;
+        s.sb_n     = peak_n;
+        s.sb_slope = slope;
+    }
+    return false;
+}
+
+/* No beat for 166% of average RR: take the best noise peak above half threshold */
+static bool search_back(qrs_beat_t * p_beat)
+{
+    if (!s.has_beat || (s.n - s.beat_n) < (s.rr_avg * SEARCHBACK_PERCENT) / 100) {
+        return false;
+    }
+
+    uint32_t threshold = s.npki + (s.spki - s.npki) / 4;
+    if (s.sb_peak > threshold / 2)
+    {
+        uint32_t sb_peak = s.sb_peak;
+        if (!accept_beat(s.sb_n, s.sb_slope, p_beat))
+        {
+            /* Candidate left the history during a long pause, look for a newer one */
+            s.sb_peak = 0;
+            return false;
+        }
+        s.spki = (sb_peak + 3 * s.spki) / 4;
+        return true;
+    }
+    return false;
+}
+
+/* A peak close to previous QRS with less than half of its slope is likely a T-wave */
+static bool is_twave(uint32_t peak_n, uint32_t slope)
+{
+    return s.has_beat && ((peak_n - s.beat_n) < TWAVE_PERIOD) && (slope < s.beat_slope / 2);
+}
+
+/* Locate R-peak in band-passed history and update RR statistics, return
+ * false if the peak is too old to be located */
+static bool accept_beat(uint32_t peak_n, uint32_t slope, qrs_beat_t * p_beat)
+{
+    /* Integration window of this peak, expressed in band-passed signal time */
+    uint32_t end = peak_n - DERIV_DELAY;
+    uint32_t start = end - (s.mwi_len - 1);
+    if (s.n - end >= HIST_LEN) {
+        return false;
+    }
+    if (s.n - start >= HIST_LEN) {
+        start = s.n - (HIST_LEN - 1);
+    }
+
+    uint32_t r = end;
+    uint16_t max = 0;
+    for (uint32_t i = start; i != end + 1; i++)
+    {
+        if (s.hist[i % HIST_LEN] >= max)
+        {
+            max = s.hist[i % HIST_LEN];
+            r = i;
+        }
+    }
+    r -= s.bp_delay;
+
+    p_beat->index = r;
+    p_beat->rr = s.has_beat ? (r - s.beat_r) : 0;
+
+    if (s.has_beat && p_beat->rr <= RR_MAX) {
+        s.rr_avg = (p_beat->rr + 7 * s.rr_avg) / 8;
+    }
+    s.has_beat   = true;
+    s.beat_n     = peak_n;
+    s.beat_r     = r;
+    s.beat_slope = slope;
+    s.sb_peak    = 0;
+    return true;
+}
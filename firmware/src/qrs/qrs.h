@@ -0,0 +1,80 @@
+/**
+ *******************************************************************************
+ * @file    qrs.h
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Streaming QRS detector module header file
+ *******************************************************************************
+ */
+
+#ifndef __QRS_H__
+#define __QRS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*******************************************************************************
+ * MACROS AND DEFINES
+ ******************************************************************************/
+
+#define QRS_MAX_SAMPLE_RATE     1000    /**< Highest supported input sampling rate (Hz) */
+
+/*******************************************************************************
+ * TYPEDEFS
+ ******************************************************************************/
+
+/* Detected beat */
+typedef struct
+{
+    uint32_t index;     /**< Sample index of the R-peak since last reset, lost samples excluded */
+    uint32_t rr;        /**< Number of samples since previous R-peak (0 for first beat) */
+} qrs_beat_t;
+
+/*******************************************************************************
+ * EXPORTED VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/**
+ * @brief Reset detector state, sample index restarts from 0 and a new
+ * learning phase of 2 seconds begins
+ * @param [in] sample_rate input sampling rate (Hz), up to QRS_MAX_SAMPLE_RATE
+ */
+void QRS_Reset(uint16_t sample_rate);
+
+/**
+ * @brief Tell the detector that samples were lost before the next ones:
+ * learned thresholds are kept, but no beat is reported until filters settle
+ * again, and the first beat after the gap has no RR interval. Sample index
+ * goes on from the last processed sample.
+ */
+void QRS_Skip(void);
+
+/**
+ * @brief Feed the detector with consecutive raw ECG samples
+ * @param [in]  p_samples samples acquired at the rate given on reset
+ * @param [in]  count number of samples
+ * @param [out] p_beats array to store detected beats, indices count the
+ * samples processed since reset
+ * @param [in]  max_beats size of the beats array
+ * @return number of beats detected in this call
+ */
+size_t QRS_Process(const int16_t * p_samples, size_t count,
+                   qrs_beat_t * p_beats, size_t max_beats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __QRS_H__ */
@@ -0,0 +1,775 @@
+/**
+ *******************************************************************************
+ * @file    recorder.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Flash recording module source file
+ *
+ * Samples are delta encoded into RecordData blocks of about 1 kB, which are
+ * appended as COBS framed packets to a flash circular buffer (FCB): entries
+ * are written once and checked by CRC, so a power failure loses at most the
+ * block being written, and oldest sectors are erased when flash is full.
+ * Blocks are sent back unchanged on download, one per NUS transfer, or
+ * batched into CRC checked segments of back to back notifications for bulk
+ * downloads. Flash is only written by the recorder thread, so that erasing
+ * never delays acquisition.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/fs/fcb.h>
+
+#if USE_PARTITION_MANAGER
+#include <pm_config.h>
+#endif
+
+/* Application includes */
+#include "bluetooth/bluetooth.h"
+#include "codec/codec.h"
+#include "recorder.h"
+
+/*******************************************************************************
+ * EXTERN VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define LOG_MODULE_NAME recorder
+LOG_MODULE_REGISTER(LOG_MODULE_NAME);
+
+#if defined(PM_RECORDING_ID)
+#define REC_AREA_ID             PM_RECORDING_ID
+#elif FIXED_PARTITION_EXISTS(recording_partition)
+#define REC_AREA_ID             FIXED_PARTITION_ID(recording_partition)
+#endif
+
+#define REC_FCB_MAGIC           0x52474345  /**< "ECGR" */
+#define REC_FCB_VERSION         2           /**< Entry header with session offset */
+#define REC_SECTOR_SIZE         0x8000      /**< Erased at once, whole flash pages */
+#define REC_MAX_SECTORS         255         /**< FCB limit */
+#define REC_QUEUE_BLOCKS        4           /**< Blocks waiting for flash (~7 s at 512 Hz) */
+#define REC_SAMPLES_SIZE        sizeof(((RecordData *)0)->samples.bytes)
+#define REC_SAMPLE_MAX_BYTES    3           /**< Zigzag varint of a 16 bits difference */
+#define REC_FRAME_SIZE          CODEC_BUFFER_SIZE(Packet_size)
+#define REC_ENTRY_SIZE          ROUND_UP(sizeof(rec_entry_header_t) + REC_FRAME_SIZE, 8)
+#define REC_SEND_POLL_MS        10          /**< Wait for NUS while previous transfer is in progress */
+#define REC_STATUS_TIMEOUT_MS   500
+#define REC_BULK_SEGMENT_SIZE   8192        /**< Frames batched under one BulkSegment header */
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+/* Header of flash entries, read alone to look for blocks */
+typedef struct __packed
+{
+    uint16_t session;
+    uint16_t length;        /**< COBS frame length, entry is padded to flash alignment */
+    uint32_t block;
+    uint32_t offset;        /**< Bytes of session frames stored before this one */
+} rec_entry_header_t;
+
+/* Requests to recorder thread */
+typedef enum
+{
+    REC_MSG_WRITE = 0,
+    REC_MSG_STATUS,
+    REC_MSG_DOWNLOAD,
+    REC_MSG_ERASE,
+    REC_MSG_BULK,
+} rec_msg_type_t;
+
+typedef struct
+{
+    uint8_t  type;
+    uint8_t  slot;          /**< Write: entry buffer */
+    uint16_t session;       /**< Download: session to send */
+    uint32_t block;         /**< Download: first block */
+    uint32_t offset;        /**< Download: first byte of session frames */
+    uint8_t  link;          /**< Bulk download: requesting central */
+} rec_msg_t;
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+#ifdef REC_AREA_ID
+static struct flash_sector sectors[REC_MAX_SECTORS];
+#endif
+static struct fcb fcb;
+static bool mounted;
+
+/* Session being recorded, block being filled by acquisition */
+static K_MUTEX_DEFINE(rec_lock);
+static atomic_t recording;
+static uint16_t session;
+static uint32_t next_block;
+static uint32_t next_index;
+static uint32_t next_offset;
+static bool block_open;
+static int16_t last_sample;
+static Packet block_packet = {
+    .which_payload = Packet_record_data_tag,
+    .payload.record_data = {
+        .has_timestamp = true,
+    }
+};
+static atomic_t dropped_blocks;
+
+/* Entries waiting for flash, one bit per slot in use */
+static uint8_t entries[REC_QUEUE_BLOCKS][REC_ENTRY_SIZE] __aligned(4);
+static atomic_t entries_used;
+K_MSGQ_DEFINE(rec_queue, sizeof(rec_msg_t), REC_QUEUE_BLOCKS + 4, 4);
+
+/* Download in progress, resumed from next block */
+static struct
+{
+    bool             active;
+    bool             bulk;
+    bool             started;       /**< Bulk: link is set up */
+    uint8_t          link;
+    uint16_t         session;
+    uint32_t         block;
+    uint32_t         offset;
+    uint32_t         bytes;         /**< Bulk: frames sent */
+    int64_t          start_ms;
+    struct fcb_entry loc;
+} download;
+static uint8_t send_buffer[REC_FRAME_SIZE];
+static uint8_t bulk_buffer[REC_BULK_SEGMENT_SIZE];
+static Packet bulk_packet;
+
+static Packet status_packet = {
+    .which_payload = Packet_record_status_tag,
+};
+/* First block of a session, decoded for status */
+static Packet first_packet;
+
+/*******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+static void open_block(uint16_t rate, uint32_t period_ns, uint64_t time_us, uint16_t lodpn);
+static void close_block(void);
+static void handle_message(const rec_msg_t * p_msg);
+static int  write_entry(const uint8_t * p_entry, size_t length);
+static int  read_header(const struct fcb_entry * p_loc, rec_entry_header_t * p_header);
+static int  read_frame(const struct fcb_entry * p_loc, const rec_entry_header_t * p_header);
+static bool download_ready(void);
+static void download_next(void);
+static void download_cancel(void);
+static void bulk_next(void);
+static void bulk_finish(bool complete);
+static void send_status(uint8_t link);
+
+/*******************************************************************************
+ * GLOBAL FUNCTIONS
+ ******************************************************************************/
+
+int REC_Init(void)
+{
+#ifdef REC_AREA_ID
+    uint32_t count = ARRAY_SIZE(sectors);
+    const struct flash_area * p_area;
+    struct flash_sector page;
+    uint32_t page_count = 1;
+
+    int err = flash_area_open(REC_AREA_ID, &p_area);
+    if (err != 0) {
+        LOG_ERR("failed to open recording partition (code %d)", err);
+        return err;
+    }
+
+    /* FCB sectors are made of whole erase pages, to stay within 255 sectors */
+    err = flash_area_get_sectors(REC_AREA_ID, &page_count, &page);
+    if ((err != 0 && err != -ENOMEM) || (REC_SECTOR_SIZE % page.fs_size) != 0) {
+        LOG_ERR("unsupported recording partition layout (code %d)", err);
+        flash_area_close(p_area);
+        return -EINVAL;
+    }
+    count = MIN(p_area->fa_size / REC_SECTOR_SIZE, count);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        sectors[i].fs_off = i * REC_SECTOR_SIZE;
+        sectors[i].fs_size = REC_SECTOR_SIZE;
+    }
+    fcb.f_magic = REC_FCB_MAGIC;
+    fcb.f_version = REC_FCB_VERSION;
+    fcb.f_sector_cnt = count;
+    fcb.f_scratch_cnt = 0;
+    fcb.f_sectors = sectors;
+
+    /* Entries torn by a power failure fail their CRC and are ignored */
+    err = fcb_init(REC_AREA_ID, &fcb);
+    if (err == -ENOMSG)
+    {
+        /* Entries of a previous format cannot be read back */
+        LOG_WRN("%s", "Recordings format changed, erasing them");
+        err = flash_area_erase(p_area, 0, count * REC_SECTOR_SIZE);
+        if (err == 0) {
+            err = fcb_init(REC_AREA_ID, &fcb);
+        }
+    }
+    flash_area_close(p_area);
+    if (err != 0) {
+        LOG_ERR("failed to mount recordings (code %d)", err);
+        return err;
+    }
+    mounted = true;
+
+    /* Next session follows the last one stored */
+    struct fcb_entry loc = { 0 };
+    rec_entry_header_t header;
+    while (fcb_getnext(&fcb, &loc) == 0)
+    {
+        if (read_header(&loc, &header) == 0) {
+            session = header.session;
+        }
+    }
+
+    LOG_INF("Recordings: %u kB, last session %u", (count * REC_SECTOR_SIZE) / 1024, session);
+    return 0;
+#else
+    LOG_WRN("%s", "No recording partition, recording disabled");
+    return -ENOTSUP;
+#endif
+}
+
+bool REC_IsRecording(void)
+{
+    return atomic_get(&recording);
+}
+
+int REC_Request(const RecordRequest * p_request, uint8_t link)
+{
+    rec_msg_t msg = { .type = REC_MSG_STATUS, .link = link };
+    int err = 0;
+
+    switch (p_request->action)
+    {
+        case RecordRequest_Action_START:
+            if (!mounted) {
+                err = -ENOTSUP;
+                break;
+            }
+            k_mutex_lock(&rec_lock, K_FOREVER);
+            if (!atomic_get(&recording))
+            {
+                session++;
+                next_block = 0;
+                next_index = 0;
+                next_offset = 0;
+                block_open = false;
+                atomic_set(&recording, true);
+                LOG_INF("Recording session %u", session);
+            }
+            k_mutex_unlock(&rec_lock);
+            break;
+
+        case RecordRequest_Action_STOP:
+            k_mutex_lock(&rec_lock, K_FOREVER);
+            if (atomic_get(&recording))
+            {
+                close_block();
+                atomic_set(&recording, false);
+                LOG_INF("Recording session %u stopped", session);
+            }
+            k_mutex_unlock(&rec_lock);
+            break;
+
+        case RecordRequest_Action_DOWNLOAD:
+        case RecordRequest_Action_BULK:
+            msg.type = (p_request->action == RecordRequest_Action_BULK) ? REC_MSG_BULK : REC_MSG_DOWNLOAD;
+            msg.session = p_request->session;
+            msg.block = p_request->block;
+            msg.offset = p_request->offset;
+            break;
+
+        case RecordRequest_Action_ERASE:
+            if (atomic_get(&recording)) {
+                err = -EBUSY;
+                break;
+            }
+            msg.type = REC_MSG_ERASE;
+            break;
+
+        default:
+            break;
+    }
+
+    /* Status is always sent back, host can tell if request failed from it */
+    k_msgq_put(&rec_queue, &msg, K_NO_WAIT);
+    return err;
+}
+
+void REC_Append(const int16_t * p_samples, uint16_t count, uint16_t rate, uint32_t period_ns,
+                uint64_t time_us, uint16_t lodpn, bool contiguous)
+{
+    RecordData * p_data = &block_packet.payload.record_data;
+
+    if (!atomic_get(&recording)) {
+        return;
+    }
+
+    k_mutex_lock(&rec_lock, K_FOREVER);
+    if (block_open && (!contiguous || rate != p_data->rate)) {
+        close_block();
+    }
+
+    for (uint16_t i = 0; i < count; i++)
+    {
+        if (!block_open) {
+            open_block(rate, period_ns, time_us + ((uint64_t)i * period_ns) / NSEC_PER_USEC, lodpn);
+        }
+
+        /* Zigzag varint of difference with previous sample */
+        int32_t delta = (int32_t)p_samples[i] - last_sample;
+        uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+        uint8_t * p_out = &p_data->samples.bytes[p_data->samples.size];
+        while (zigzag >= 0x80)
+        {
+            *p_out++ = (zigzag & 0x7F) | 0x80;
+            zigzag >>= 7;
+        }
+        *p_out++ = zigzag;
+        p_data->samples.size = p_out - p_data->samples.bytes;
+        last_sample = p_samples[i];
+        next_index++;
+
+        if (p_data->samples.size + REC_SAMPLE_MAX_BYTES > REC_SAMPLES_SIZE) {
+            close_block();
+        }
+    }
+    k_mutex_unlock(&rec_lock);
+}
+
+void REC_Thread(void * p1, void * p2, void * p3)
+{
+    rec_msg_t msg;
+
+    while (1)
+    {
+        /* Download goes on between writes, at the pace of NUS transfers */
+        bool ready = download.active && download_ready();
+        k_timeout_t timeout = K_FOREVER;
+        if (download.active) {
+            timeout = ready ? K_NO_WAIT : K_MSEC(REC_SEND_POLL_MS);
+        }
+
+        if (k_msgq_get(&rec_queue, &msg, timeout) == 0) {
+            handle_message(&msg);
+        }
+        else if (ready && download.bulk) {
+            bulk_next();
+        }
+        else if (ready) {
+            download_next();
+        }
+    }
+}
+
+/*******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
+
+/* Start a block at current sample, called with recording lock held */
+static void open_block(uint16_t rate, uint32_t period_ns, uint64_t time_us, uint16_t lodpn)
+{
+    RecordData * p_data = &block_packet.payload.record_data;
+
+    p_data->session = session;
+    p_data->block = next_block++;
+    p_data->timestamp.time = time_us / USEC_PER_SEC;
+    p_data->timestamp.us = time_us % USEC_PER_SEC;
+    p_data->rate = rate;
+    p_data->period_ns = period_ns;
+    p_data->index = next_index;
+    p_data->lodpn = lodpn;
+    p_data->samples.size = 0;
+    last_sample = 0;
+    block_open = true;
+}
+
+/* Encode current block and queue it for recorder thread, called with recording lock held */
+static void close_block(void)
+{
+    RecordData * p_data = &block_packet.payload.record_data;
+
+    if (!block_open) {
+        return;
+    }
+    block_open = false;
+    if (p_data->samples.size == 0) {
+        return;
+    }
+
+    /* Find a free entry buffer, flash writes may lag behind while a sector is erased */
+    uint8_t slot;
+    for (slot = 0; slot < REC_QUEUE_BLOCKS; slot++)
+    {
+        if (!atomic_test_and_set_bit(&entries_used, slot)) {
+            break;
+        }
+    }
+    if (slot == REC_QUEUE_BLOCKS)
+    {
+        atomic_inc(&dropped_blocks);
+        LOG_WRN("Flash busy, block %u dropped", p_data->block);
+        return;
+    }
+
+    rec_entry_header_t * p_header = (rec_entry_header_t *)entries[slot];
+    int ret = CODEC_Encode(Packet_fields, &block_packet, entries[slot] + sizeof(rec_entry_header_t),
+                           REC_FRAME_SIZE);
+    p_header->session = p_data->session;
+    p_header->length = ret;
+    p_header->block = p_data->block;
+    p_header->offset = next_offset;
+
+    rec_msg_t msg = { .type = REC_MSG_WRITE, .slot = slot };
+    if (ret < 0 || k_msgq_put(&rec_queue, &msg, K_NO_WAIT) != 0)
+    {
+        atomic_clear_bit(&entries_used, slot);
+        atomic_inc(&dropped_blocks);
+        return;
+    }
+    next_offset += ret;
+}
+
+static void handle_message(const rec_msg_t * p_msg)
+{
+    switch (p_msg->type)
+    {
+        case REC_MSG_WRITE:
+        {
+            const rec_entry_header_t * p_header = (const rec_entry_header_t *)entries[p_msg->slot];
+            int err = write_entry(entries[p_msg->slot], sizeof(rec_entry_header_t) + p_header->length);
+            if (err != 0)
+            {
+                atomic_inc(&dropped_blocks);
+                LOG_ERR("failed to write block %u (code %d)", p_header->block, err);
+            }
+            atomic_clear_bit(&entries_used, p_msg->slot);
+            break;
+        }
+
+        case REC_MSG_DOWNLOAD:
+        case REC_MSG_BULK:
+            download_cancel();
+            download.active = mounted;
+            download.bulk = (p_msg->type == REC_MSG_BULK);
+            download.link = p_msg->link;
+            download.session = p_msg->session;
+            download.block = p_msg->block;
+            download.offset = p_msg->offset;
+            download.bytes = 0;
+            memset(&download.loc, 0, sizeof(download.loc));
+            if (!download.active) {
+                send_status(p_msg->link);
+            }
+            break;
+
+        case REC_MSG_ERASE:
+            if (mounted && !atomic_get(&recording))
+            {
+                download_cancel();
+                int err = fcb_clear(&fcb);
+                if (err != 0) {
+                    LOG_ERR("failed to erase recordings (code %d)", err);
+                }
+            }
+            send_status(p_msg->link);
+            break;
+
+        default:
+            send_status(p_msg->link);
+            break;
+    }
+}
+
+/* Append an entry, erasing oldest sector when flash is full */
+static int write_entry(const uint8_t * p_entry, size_t length)
+{
+    struct fcb_entry loc;
+    /* Padding after COBS delimiter is left as is, as length is in header */
+    size_t padded = ROUND_UP(length, flash_area_align(fcb.fap));
+
+    int err = fcb_append(&fcb, padded, &loc);
+    if (err == -ENOSPC)
+    {
+        err = fcb_rotate(&fcb);
+        if (err != 0) {
+            return err;
+        }
+        /* Download may point to erased sector, it goes on from oldest entry */
+        memset(&download.loc, 0, sizeof(download.loc));
+        err = fcb_append(&fcb, padded, &loc);
+    }
+    if (err != 0) {
+        return err;
+    }
+
+    err = flash_area_write(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), p_entry, padded);
+    if (err != 0) {
+        return err;
+    }
+    return fcb_append_finish(&fcb, &loc);
+}
+
+static int read_header(const struct fcb_entry * p_loc, rec_entry_header_t * p_header)
+{
+    int err = flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF((*p_loc)), p_header, sizeof(*p_header));
+    if (err == 0 && (p_header->length > REC_FRAME_SIZE ||
+                     sizeof(*p_header) + p_header->length > p_loc->fe_data_len)) {
+        err = -EBADMSG;
+    }
+    return err;
+}
+
+/* Read COBS frame of an entry into send buffer */
+static int read_frame(const struct fcb_entry * p_loc, const rec_entry_header_t * p_header)
+{
+    return flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF((*p_loc)) + sizeof(*p_header),
+                           send_buffer, p_header->length);
+}
+
+/* Tell if next download step can be sent, setting up the link first for bulk downloads */
+static bool download_ready(void)
+{
+    if (!download.bulk) {
+        return !BLE_IsSendBusy();
+    }
+    if (download.started) {
+        return true;
+    }
+
+    /* Bulk transfer waits for the live frame being sent, not to interleave with it */
+    int err = BLE_BulkBegin(download.link);
+    if (err == -EBUSY) {
+        return false;
+    }
+    if (err != 0)
+    {
+        download.active = false;
+        send_status(download.link);
+        return false;
+    }
+    download.started = true;
+    download.start_ms = k_uptime_get();
+    return true;
+}
+
+/* Tell if an entry of the session is to be sent, from requested block and offset */
+static inline bool download_wanted(const rec_entry_header_t * p_header)
+{
+    return p_header->session == download.session && p_header->block >= download.block &&
+           p_header->offset + p_header->length > download.offset;
+}
+
+/* Send next block of session being downloaded, then status once all are sent */
+static void download_next(void)
+{
+    rec_entry_header_t header;
+
+    while (fcb_getnext(&fcb, &download.loc) == 0)
+    {
+        if (read_header(&download.loc, &header) != 0 || !download_wanted(&header)) {
+            continue;
+        }
+        if (read_frame(&download.loc, &header) != 0) {
+            continue;
+        }
+
+        /* Host resumes from last block received if link is lost */
+        if (BLE_SendTo(download.link, send_buffer, header.length) != 0) {
+            download.active = false;
+        }
+        download.block = header.block + 1;
+        return;
+    }
+
+    download.active = false;
+    send_status(download.link);
+}
+
+/* Stop download in progress, giving back NUS to live frames */
+static void download_cancel(void)
+{
+    if (download.started) {
+        BLE_BulkEnd();
+    }
+    download.started = false;
+    download.active = false;
+}
+
+/* Send next segment of session being downloaded in bulk, then summary and status once all are sent */
+static void bulk_next(void)
+{
+    BulkSegment * p_segment = &bulk_packet.payload.bulk_segment;
+    struct fcb_entry loc = download.loc;
+    rec_entry_header_t header;
+    uint32_t length = 0;
+
+    /* Whole frames are batched, next segment starts from the first one left out */
+    memset(p_segment, 0, sizeof(*p_segment));
+    while (fcb_getnext(&fcb, &loc) == 0)
+    {
+        if (read_header(&loc, &header) != 0 || !download_wanted(&header))
+        {
+            download.loc = loc;
+            continue;
+        }
+        if (length + header.length > sizeof(bulk_buffer)) {
+            break;
+        }
+        if (flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc) + sizeof(header),
+                            &bulk_buffer[length], header.length) != 0)
+        {
+            download.loc = loc;
+            continue;
+        }
+        if (length == 0)
+        {
+            p_segment->offset = header.offset;
+            p_segment->block = header.block;
+        }
+        length += header.length;
+        download.loc = loc;
+        download.block = header.block + 1;
+    }
+
+    if (length == 0)
+    {
+        bulk_finish(true);
+        return;
+    }
+
+    bulk_packet.which_payload = Packet_bulk_segment_tag;
+    p_segment->session = download.session;
+    p_segment->length = length;
+    p_segment->crc32 = crc32_ieee(bulk_buffer, length);
+    int ret = CODEC_Encode(Packet_fields, &bulk_packet, send_buffer, sizeof(send_buffer));
+    if (ret < 0 || BLE_SendBulk(send_buffer, ret) != 0 || BLE_SendBulk(bulk_buffer, length) != 0)
+    {
+        /* Host resumes from last segment received */
+        bulk_finish(false);
+        return;
+    }
+    download.bytes += length;
+}
+
+/* Report achieved throughput, give back NUS to live frames and send status */
+static void bulk_finish(bool complete)
+{
+    BulkSummary * p_summary = &bulk_packet.payload.bulk_summary;
+    ble_link_info_t link = { 0 };
+    uint32_t duration_ms = k_uptime_get() - download.start_ms;
+
+    BLE_GetLinkInfo(download.link, &link);
+    memset(p_summary, 0, sizeof(*p_summary));
+    bulk_packet.which_payload = Packet_bulk_summary_tag;
+    p_summary->session = download.session;
+    p_summary->complete = complete;
+    p_summary->bytes = download.bytes;
+    p_summary->duration_ms = duration_ms;
+    p_summary->throughput = (duration_ms > 0) ? ((uint64_t)download.bytes * MSEC_PER_SEC) / duration_ms : 0;
+    p_summary->phy = link.phy;
+    p_summary->interval_us = link.interval_us;
+    p_summary->data_length = link.data_length;
+    p_summary->mtu = link.mtu;
+    LOG_INF("Bulk download of session %u: %u bytes in %u ms (%u B/s)", download.session,
+            download.bytes, duration_ms, p_summary->throughput);
+
+    int ret = CODEC_Encode(Packet_fields, &bulk_packet, send_buffer, sizeof(send_buffer));
+    if (ret > 0) {
+        BLE_SendBulk(send_buffer, ret);
+    }
+    download_cancel();
+    send_status(download.link);
+}
+
+/* List stored sessions and send recorder state to a central */
+static void send_status(uint8_t link)
+{
+    RecordStatus * p_status = &status_packet.payload.record_status;
+    struct fcb_entry firsts[ARRAY_SIZE(p_status->sessions)];
+
+    memset(p_status, 0, sizeof(*p_status));
+    p_status->recording = atomic_get(&recording);
+    p_status->session = session;
+    p_status->dropped_blocks = atomic_get(&dropped_blocks);
+
+    if (mounted)
+    {
+        struct fcb_entry loc = { 0 };
+        rec_entry_header_t header;
+        RecordSession * p_last = NULL;
+
+        /* Sessions are stored in order, only most recent ones are kept in the list */
+        while (fcb_getnext(&fcb, &loc) == 0)
+        {
+            if (read_header(&loc, &header) != 0) {
+                continue;
+            }
+            if (p_last != NULL && p_last->session == header.session)
+            {
+                p_last->blocks++;
+                continue;
+            }
+            if (p_status->sessions_count == ARRAY_SIZE(p_status->sessions))
+            {
+                p_status->sessions_count--;
+                memmove(&p_status->sessions[0], &p_status->sessions[1],
+                        p_status->sessions_count * sizeof(RecordSession));
+                memmove(&firsts[0], &firsts[1], p_status->sessions_count * sizeof(struct fcb_entry));
+            }
+            p_last = &p_status->sessions[p_status->sessions_count];
+            firsts[p_status->sessions_count++] = loc;
+            memset(p_last, 0, sizeof(*p_last));
+            p_last->session = header.session;
+            p_last->first_block = header.block;
+            p_last->blocks = 1;
+        }
+
+        /* Start time and rate from first stored block of each session */
+        for (pb_size_t i = 0; i < p_status->sessions_count; i++)
+        {
+            if (read_header(&firsts[i], &header) != 0 || read_frame(&firsts[i], &header) != 0 ||
+                CODEC_Decode(Packet_fields, &first_packet, send_buffer, header.length) != 0) {
+                continue;
+            }
+            p_status->sessions[i].has_start = true;
+            p_status->sessions[i].start = first_packet.payload.record_data.timestamp;
+            p_status->sessions[i].rate = first_packet.payload.record_data.rate;
+        }
+
+        p_status->size_kb = (fcb.f_sector_cnt * REC_SECTOR_SIZE) / 1024;
+        p_status->used_kb = ((fcb.f_sector_cnt - fcb_free_sector_cnt(&fcb)) * REC_SECTOR_SIZE) / 1024;
+    }
+
+    int ret = CODEC_Encode(Packet_fields, &status_packet, send_buffer, sizeof(send_buffer));
+    if (ret < 0) {
+        return;
+    }
+    for (int waited = 0; BLE_IsSendBusy() && waited < REC_STATUS_TIMEOUT_MS; waited += REC_SEND_POLL_MS) {
+        k_msleep(REC_SEND_POLL_MS);
+    }
+    BLE_SendTo(link, send_buffer, ret);
+}
@@ -0,0 +1,91 @@
+/**
+ *******************************************************************************
+ * @file    recorder.h
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Flash recording module header file
+ *******************************************************************************
+ */
+
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "protocol/protocol.pb.h"
+
+/*******************************************************************************
+ * MACROS AND DEFINES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * TYPEDEFS
+ ******************************************************************************/
+
+/*******************************************************************************
+ * EXPORTED VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/**
+ * @brief Mount recordings log from "recording" partition (partition manager)
+ * or recording_partition (devicetree)
+ * @return 0 on success, -ENOTSUP if board has no recording partition, or
+ * negative error code from flash
+ */
+int REC_Init(void);
+
+/**
+ * @brief Tell if a session is being recorded, acquisition should then go on
+ * while disconnected
+ */
+bool REC_IsRecording(void);
+
+/**
+ * @brief Handle a host request, answered with a RecordStatus from recorder thread
+ * @param [in] p_request request from host
+ * @param [in] link central sending the request, bulk downloads are sent to it only
+ * @return 0 on success, -ENOTSUP if device cannot record, -EBUSY if
+ * request conflicts with current state
+ */
+int REC_Request(const RecordRequest * p_request, uint8_t link);
+
+/**
+ * @brief Record consecutive samples of an acquisition buffer
+ * @param [in] p_samples raw samples
+ * @param [in] count number of samples
+ * @param [in] rate nominal sample rate (Hz)
+ * @param [in] period_ns actual sample period
+ * @param [in] time_us calendar time of first sample (microseconds since epoch)
+ * @param [in] lodpn lead off status at first sample
+ * @param [in] contiguous false if samples do not follow previous buffer
+ */
+void REC_Append(const int16_t * p_samples, uint16_t count, uint16_t rate, uint32_t period_ns,
+                uint64_t time_us, uint16_t lodpn, bool contiguous);
+
+/**
+ * @brief Thread writing blocks to flash and sending status and downloads,
+ * in background of acquisition
+ * @param [in] p1 not used
+ * @param [in] p2 not used
+ * @param [in] p3 not used
+ */
+void REC_Thread(void * p1, void * p2, void * p3);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RECORDER_H__ */
@@ -0,0 +1,242 @@
+/**
+ *******************************************************************************
+ * @file    scheduler.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Radio aligned work scheduler module source file
+ *
+ * The controller reports the end of each connection event (SoftDevice
+ * Controller QoS reports). Work submitted in between is held and released
+ * together on next report, while the CPU is awake for the radio anyway, so
+ * that encoding and sending a buffer does not cost a wakeup of its own. Data
+ * queued then goes out on next connection event. Held work is released after
+ * SCHED_MAX_DEFER_MS if no report comes, and submitted at once when reports
+ * stopped (no central connected).
+ *
+ * Reports are a vendor command of the SoftDevice Controller, only reachable
+ * when it runs on the application core (CONFIG_BT_LL_SOFTDEVICE). With the
+ * controller on another core (nRF5340 network core), work is only batched on
+ * the SCHED_MAX_DEFER_MS timer while a central is connected.
+ *
+ * Wakeups are counted from idle thread entries, through user tracing hooks
+ * (overlay-trace.conf).
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <errno.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/bluetooth/hci.h>
+#if defined(CONFIG_BT_LL_SOFTDEVICE)
+#include <sdc_hci_vs.h>
+#endif
+#if defined(CONFIG_TRACING_USER)
+#include <tracing_user.h>
+#endif
+
+/* Application includes */
+#include "bluetooth/bluetooth.h"
+#include "scheduler.h"
+
+/*******************************************************************************
+ * EXTERN VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define LOG_MODULE_NAME scheduler
+LOG_MODULE_REGISTER(LOG_MODULE_NAME);
+
+#define SCHED_MAX_PENDING           4       /**< Work items held until next window */
+#define SCHED_MAX_DEFER_MS          250     /**< Longest hold, above low power connection interval */
+#define SCHED_REPORT_TIMEOUT_MS     1000    /**< Reports stopped, work is submitted at once */
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+typedef struct
+{
+    struct k_work_q * p_queue;
+    struct k_work *   p_work;
+} sched_item_t;
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+static struct k_spinlock pending_lock;
+static sched_item_t pending[SCHED_MAX_PENDING];
+static uint8_t pending_count;
+
+#if defined(CONFIG_BT_LL_SOFTDEVICE)
+/* Uptime of last connection event report, 0 until first one */
+static atomic_t last_report_ms;
+#endif
+
+/* Idle thread entries, and their count at previous rate request */
+static atomic_t idle_entries;
+static uint32_t last_entries;
+static int64_t last_rate_ms;
+
+/*******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+#if defined(CONFIG_BT_LL_SOFTDEVICE)
+static bool conn_event_report(struct net_buf_simple * buf);
+#endif
+static void release_pending(void);
+static void fallback_work_handler(struct k_work * work);
+
+static K_WORK_DELAYABLE_DEFINE(fallback_work, fallback_work_handler);
+
+/*******************************************************************************
+ * GLOBAL FUNCTIONS
+ ******************************************************************************/
+
+int SCHED_Init(void)
+{
+#if defined(CONFIG_BT_LL_SOFTDEVICE)
+    struct net_buf * buf;
+    sdc_hci_cmd_vs_qos_conn_event_report_enable_t * p_cmd;
+
+    int err = bt_hci_register_vnd_evt_cb(conn_event_report);
+    if (err) {
+        LOG_ERR("Failed to register vendor events callback (err %d)", err);
+        return err;
+    }
+
+    buf = bt_hci_cmd_create(SDC_HCI_OPCODE_CMD_VS_QOS_CONN_EVENT_REPORT_ENABLE, sizeof(*p_cmd));
+    if (buf == NULL) {
+        return -ENOBUFS;
+    }
+    p_cmd = net_buf_add(buf, sizeof(*p_cmd));
+    p_cmd->enable = 1;
+
+    err = bt_hci_cmd_send_sync(SDC_HCI_OPCODE_CMD_VS_QOS_CONN_EVENT_REPORT_ENABLE, buf, NULL);
+    if (err) {
+        LOG_ERR("Failed to enable connection event reports (err %d)", err);
+    }
+    return err;
+#else
+    LOG_INF("No connection event reports, work held up to %d ms", SCHED_MAX_DEFER_MS);
+    return 0;
+#endif
+}
+
+void SCHED_Submit(struct k_work_q * p_queue, struct k_work * p_work)
+{
+    bool held = false;
+#if defined(CONFIG_BT_LL_SOFTDEVICE)
+    uint32_t last = atomic_get(&last_report_ms);
+    bool hold = (last != 0 && k_uptime_get_32() - last < SCHED_REPORT_TIMEOUT_MS);
+#else
+    /* Nothing to align with while no central is connected */
+    bool hold = BLE_IsConnected();
+#endif
+
+    if (hold)
+    {
+        k_spinlock_key_t key = k_spin_lock(&pending_lock);
+        for (uint8_t i = 0; i < pending_count; i++) {
+            held |= (pending[i].p_work == p_work);
+        }
+        /* Without a free slot, work runs at once */
+        if (!held && pending_count < SCHED_MAX_PENDING)
+        {
+            pending[pending_count].p_queue = p_queue;
+            pending[pending_count].p_work = p_work;
+            pending_count++;
+            held = true;
+        }
+        k_spin_unlock(&pending_lock, key);
+    }
+
+    if (held) {
+        k_work_schedule(&fallback_work, K_MSEC(SCHED_MAX_DEFER_MS));
+    }
+    else {
+        k_work_submit_to_queue(p_queue, p_work);
+    }
+}
+
+uint32_t SCHED_GetWakeupRate(void)
+{
+    int64_t now = k_uptime_get();
+    uint32_t entries = atomic_get(&idle_entries);
+    uint32_t rate = 0;
+
+    if (now > last_rate_ms) {
+        rate = ((uint64_t)(entries - last_entries) * MSEC_PER_SEC) / (now - last_rate_ms);
+    }
+    last_entries = entries;
+    last_rate_ms = now;
+    return rate;
+}
+
+#if defined(CONFIG_TRACING_USER)
+/* Idle thread is about to sleep, called once per wakeup */
+void sys_trace_idle_user(void)
+{
+    atomic_inc(&idle_entries);
+}
+#endif
+
+/*******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
+
+#if defined(CONFIG_BT_LL_SOFTDEVICE)
+/* Connection event is over, held work runs in the same active window */
+static bool conn_event_report(struct net_buf_simple * buf)
+{
+    uint8_t subevent = net_buf_simple_pull_u8(buf);
+
+    if (subevent != SDC_HCI_SUBEVENT_VS_QOS_CONN_EVENT_REPORT) {
+        return false;
+    }
+
+    /* Uptime 0 is reserved for no report */
+    atomic_set(&last_report_ms, MAX(k_uptime_get_32(), 1));
+    release_pending();
+    return true;
+}
+#endif
+
+static void release_pending(void)
+{
+    sched_item_t items[SCHED_MAX_PENDING];
+
+    k_spinlock_key_t key = k_spin_lock(&pending_lock);
+    uint8_t count = pending_count;
+    memcpy(items, pending, count * sizeof(sched_item_t));
+    pending_count = 0;
+    k_spin_unlock(&pending_lock, key);
+
+    if (count == 0) {
+        return;
+    }
+    k_work_cancel_delayable(&fallback_work);
+    for (uint8_t i = 0; i < count; i++) {
+        k_work_submit_to_queue(items[i].p_queue, items[i].p_work);
+    }
+}
+
+/* No connection event came in time */
+static void fallback_work_handler(struct k_work * work)
+{
+    release_pending();
+}
@@ -0,0 +1,70 @@
+/**
+ *******************************************************************************
+ * @file    scheduler.h
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Radio aligned work scheduler module header file
+ *******************************************************************************
+ */
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+
+/*******************************************************************************
+ * MACROS AND DEFINES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * TYPEDEFS
+ ******************************************************************************/
+
+/*******************************************************************************
+ * EXPORTED VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/**
+ * @brief Enable connection event reports from the controller, must be called
+ * after BLE_Init(). Work is submitted at once until reports come. Does
+ * nothing without the SoftDevice Controller on this core.
+ * @return 0 on success, negative error code from Bluetooth stack otherwise
+ */
+int SCHED_Init(void);
+
+/**
+ * @brief Submit work in the next active window, right after a connection
+ * event, or at once while no central is connected. Without connection event
+ * reports, work is held up to 250 ms so that items share a wakeup. Work
+ * still pending is not added twice. Pipeline stages bypass it once they are
+ * about to be full (see PIPE_SetSubmit()).
+ * @param [in] p_queue workqueue running the work
+ * @param [in] p_work work item
+ */
+void SCHED_Submit(struct k_work_q * p_queue, struct k_work * p_work);
+
+/**
+ * @brief Get CPU wakeups from idle per second since previous call, 0 when
+ * built without CONFIG_TRACING_USER (overlay-trace.conf)
+ */
+uint32_t SCHED_GetWakeupRate(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SCHEDULER_H__ */
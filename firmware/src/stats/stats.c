@@ -0,0 +1,158 @@
+/**
+ *******************************************************************************
+ * @file    stats.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Stream statistics module source file
+ *
+ * Loss accounting of the NUS stream. Each frame produced ends up either sent
+ * or in one drop counter, so the receiver can split missing sequence numbers
+ * between device side causes and losses in the link or reassembly.
+ *
+ * Counters run from boot. Each central gets them from its connection, as
+ * differences with a baseline taken then, and high-water marks of its own.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <stdint.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+
+/* Application includes */
+#include "stats.h"
+
+/*******************************************************************************
+ * EXTERN VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define STATS_MAX_LINKS     CONFIG_BT_MAX_CONN
+#define STATS_MAXIMA        (BIT(STATS_TX_HIGH_WATER) | BIT(STATS_SEND_LATENCY_MAX))
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+static atomic_t counters[NUM_OF_STATS_COUNTERS];
+
+/* Counters when each central connected, and its own high-water marks */
+static atomic_t baselines[STATS_MAX_LINKS][NUM_OF_STATS_COUNTERS];
+static atomic_t maxima[STATS_MAX_LINKS][NUM_OF_STATS_COUNTERS];
+
+/*******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+static void raise_max(atomic_t * p_counter, uint32_t value);
+static uint32_t get(uint8_t link, stats_counter_t counter);
+
+/*******************************************************************************
+ * GLOBAL FUNCTIONS
+ ******************************************************************************/
+
+void STATS_Reset(uint8_t link)
+{
+    if (link >= STATS_MAX_LINKS) {
+        return;
+    }
+
+    for (size_t i = 0; i < STATS_IDLE_CURRENT; i++)
+    {
+        if (STATS_MAXIMA & BIT(i)) {
+            atomic_clear(&maxima[link][i]);
+        } else {
+            atomic_set(&baselines[link][i], atomic_get(&counters[i]));
+        }
+    }
+}
+
+void STATS_Add(stats_counter_t counter, uint32_t value)
+{
+    if (counter < NUM_OF_STATS_COUNTERS && value != 0) {
+        atomic_add(&counters[counter], value);
+    }
+}
+
+void STATS_Max(stats_counter_t counter, uint32_t value)
+{
+    if (counter >= NUM_OF_STATS_COUNTERS) {
+        return;
+    }
+
+    raise_max(&counters[counter], value);
+    for (uint8_t i = 0; i < STATS_MAX_LINKS; i++) {
+        raise_max(&maxima[i][counter], value);
+    }
+}
+
+void STATS_Set(stats_counter_t counter, uint32_t value)
+{
+    if (counter < NUM_OF_STATS_COUNTERS) {
+        atomic_set(&counters[counter], value);
+    }
+}
+
+void STATS_Get(uint8_t link, Stats * p_stats)
+{
+    if (link >= STATS_MAX_LINKS) {
+        link = 0;
+    }
+
+    p_stats->frames_produced  = get(link, STATS_FRAMES_PRODUCED);
+    p_stats->frames_encoded   = get(link, STATS_FRAMES_ENCODED);
+    p_stats->frames_sent      = get(link, STATS_FRAMES_SENT);
+    p_stats->dropped_disabled = get(link, STATS_DROPPED_DISABLED);
+    p_stats->dropped_encode   = get(link, STATS_DROPPED_ENCODE);
+    p_stats->dropped_busy     = get(link, STATS_DROPPED_BUSY);
+    p_stats->buffers_overrun  = get(link, STATS_BUFFERS_OVERRUN);
+    p_stats->tx_errors        = get(link, STATS_TX_ERRORS);
+    p_stats->tx_high_water    = get(link, STATS_TX_HIGH_WATER);
+    p_stats->frames_resent    = get(link, STATS_FRAMES_RESENT);
+    p_stats->resend_missed    = get(link, STATS_RESEND_MISSED);
+    p_stats->link_dropped     = get(link, STATS_LINK_DROPPED);
+    p_stats->oversize         = get(link, STATS_OVERSIZE);
+    p_stats->send_latency_max_us = get(link, STATS_SEND_LATENCY_MAX);
+    p_stats->send_late        = get(link, STATS_SEND_LATE);
+    p_stats->idle_current_ua  = get(link, STATS_IDLE_CURRENT);
+}
+
+/*******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
+
+static void raise_max(atomic_t * p_counter, uint32_t value)
+{
+    atomic_val_t current = atomic_get(p_counter);
+    while ((uint32_t)current < value)
+    {
+        if (atomic_cas(p_counter, current, value)) {
+            break;
+        }
+        current = atomic_get(p_counter);
+    }
+}
+
+/* Counter value for a central, device levels are shared */
+static uint32_t get(uint8_t link, stats_counter_t counter)
+{
+    if (counter >= STATS_IDLE_CURRENT) {
+        return atomic_get(&counters[counter]);
+    }
+    if (STATS_MAXIMA & BIT(counter)) {
+        return atomic_get(&maxima[link][counter]);
+    }
+    return (uint32_t)atomic_get(&counters[counter]) - (uint32_t)atomic_get(&baselines[link][counter]);
+}
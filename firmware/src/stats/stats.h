@@ -0,0 +1,103 @@
+/**
+ *******************************************************************************
+ * @file    stats.h
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Stream statistics module header file
+ *******************************************************************************
+ */
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+#include <stdint.h>
+
+#include "protocol/protocol.pb.h"
+
+/*******************************************************************************
+ * MACROS AND DEFINES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * TYPEDEFS
+ ******************************************************************************/
+
+/* Counters, all NUS EcgBuffer frames unless stated otherwise */
+typedef enum
+{
+    STATS_FRAMES_PRODUCED = 0,  /**< Frames completed */
+    STATS_FRAMES_ENCODED,       /**< Frames encoded in a transfer */
+    STATS_FRAMES_SENT,          /**< Frames in transfers accepted by Bluetooth module */
+    STATS_DROPPED_DISABLED,     /**< Frames dropped as NUS notifications were disabled */
+    STATS_DROPPED_ENCODE,       /**< Frames not fitting in transfer buffer */
+    STATS_DROPPED_BUSY,         /**< Frames dropped as previous transfer was in progress */
+    STATS_BUFFERS_OVERRUN,      /**< Acquisition buffers replaced before being processed */
+    STATS_TX_ERRORS,            /**< Transfers cut short by Bluetooth stack errors */
+    STATS_TX_HIGH_WATER,        /**< Largest number of bytes waiting for transmission */
+    STATS_FRAMES_RESENT,        /**< Frames sent again on host request */
+    STATS_RESEND_MISSED,        /**< Requested frames no longer in history */
+    STATS_LINK_DROPPED,         /**< Transfers skipped for a central lagging behind others */
+    STATS_OVERSIZE,             /**< Messages split across ECG service notifications */
+    STATS_SEND_LATENCY_MAX,     /**< Longest time from ADC buffer completion to transfer (us) */
+    STATS_SEND_LATE,            /**< Transfers queued after next buffer completion */
+    /* Device levels below are shared by all centrals */
+    STATS_IDLE_CURRENT,         /**< Fuel gauge average current between sessions (uA) */
+    NUM_OF_STATS_COUNTERS,
+} stats_counter_t;
+
+/*******************************************************************************
+ * EXPORTED VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/**
+ * @brief Restart counters of a central, on its connection, device levels
+ * and other centrals counters are kept
+ * @param [in] link central index
+ */
+void STATS_Reset(uint8_t link);
+
+/**
+ * @brief Increase a counter, can be called from any context
+ * @param [in] counter counter to increase
+ * @param [in] value amount to add
+ */
+void STATS_Add(stats_counter_t counter, uint32_t value);
+
+/**
+ * @brief Raise a high-water mark, can be called from any context
+ * @param [in] counter high-water mark
+ * @param [in] value current level
+ */
+void STATS_Max(stats_counter_t counter, uint32_t value);
+
+/**
+ * @brief Set a level, can be called from any context
+ * @param [in] counter level
+ * @param [in] value new value
+ */
+void STATS_Set(stats_counter_t counter, uint32_t value);
+
+/**
+ * @brief Snapshot counters of a central into a Stats message
+ * @param [in]  link central index
+ * @param [out] p_stats message to fill, next_sequence is left to caller
+ */
+void STATS_Get(uint8_t link, Stats * p_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STATS_H__ */
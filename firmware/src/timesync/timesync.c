@@ -0,0 +1,269 @@
+/**
+ *******************************************************************************
+ * @file    timesync.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Host time synchronization module source file
+ *
+ * NTP-like exchanges: the host sends its transmit time (t1), the device
+ * replies with receive (t2) and transmit (t3) times, and the host sends its
+ * arrival time (t4) within the next request. Each complete exchange gives a
+ * host minus device offset and a round trip delay. Only the exchange with the
+ * shortest round trip of each period is kept, as it is the least biased by
+ * asymmetric BLE latency, and the kept offsets are fitted with a line whose
+ * slope is the RTC skew: periods make the fit span minutes, which is needed
+ * as offsets are only known within a few milliseconds. The calendar then
+ * follows the host clock from the fitted model.
+ *
+ * Each central keeps its own exchanges and model. The calendar follows the
+ * first one to complete an exchange, until it leaves.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+/* Application includes */
+#include "calendar/calendar.h"
+#include "timesync.h"
+
+/*******************************************************************************
+ * EXTERN VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define LOG_MODULE_NAME timesync
+LOG_MODULE_REGISTER(LOG_MODULE_NAME);
+
+#define TSYNC_MAX_SAMPLES       16      /**< Periods kept for estimation */
+#define TSYNC_PERIOD_US         (60 * USEC_PER_SEC) /**< One exchange is kept per period */
+#define TSYNC_MAX_SKEW_PPB      200000  /**< Crystal tolerance and ageing are far below 200 ppm */
+#define TSYNC_MAX_LINKS         CONFIG_BT_MAX_CONN
+#define TSYNC_NO_LINK           UINT8_MAX
+
+#define TICKS_TO_US(ticks)      (((int64_t)(ticks) * USEC_PER_SEC) / CAL_TICKS_PER_SEC)
+#define TIMESTAMP_TO_US(ts)     ((int64_t)(ts).time * USEC_PER_SEC + (ts).us)
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+/* Complete exchange */
+typedef struct
+{
+    uint64_t device_ticks;  /**< Middle of device processing */
+    int64_t  device_us;     /**< Same instant in RTC microseconds since start */
+    int64_t  offset_us;     /**< Host minus device time */
+    int64_t  delay_us;      /**< Round trip without device processing */
+} tsync_sample_t;
+
+/* Exchanges and model of a central */
+typedef struct
+{
+    tsync_sample_t samples[TSYNC_MAX_SAMPLES];
+    uint8_t  sample_count;
+    uint8_t  sample_pos;
+    int64_t  period_start_us;
+
+    /* Last reply, waiting for host arrival time */
+    struct
+    {
+        bool     valid;
+        uint32_t sequence;
+        int64_t  origin_us;
+        uint64_t receive_ticks;
+        uint64_t transmit_ticks;
+    } last;
+
+    int32_t  skew_ppb;
+    uint32_t last_delay_us;
+} tsync_link_t;
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+/* Only used from the workqueue handling host requests */
+static tsync_link_t links[TSYNC_MAX_LINKS];
+
+/* Central the calendar follows */
+static uint8_t calendar_link = TSYNC_NO_LINK;
+
+/*******************************************************************************
+ * STATIC FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+static void add_sample(tsync_link_t * p_link, int64_t host_arrival_us);
+static void estimate(uint8_t link);
+
+/*******************************************************************************
+ * GLOBAL FUNCTIONS
+ ******************************************************************************/
+
+void TSYNC_Reset(uint8_t link)
+{
+    if (link >= TSYNC_MAX_LINKS) {
+        return;
+    }
+    memset(&links[link], 0, sizeof(links[link]));
+
+    /* Calendar followed by no other central starts again from host time */
+    if (calendar_link == TSYNC_NO_LINK || calendar_link == link)
+    {
+        calendar_link = TSYNC_NO_LINK;
+        CAL_ClearSync();
+    }
+}
+
+void TSYNC_Release(uint8_t link)
+{
+    /* Calendar keeps last model until another central takes over */
+    if (calendar_link == link) {
+        calendar_link = TSYNC_NO_LINK;
+    }
+}
+
+void TSYNC_HandleRequest(uint8_t link, const TimeSyncRequest * p_request, uint64_t rx_ticks, TimeSync * p_reply)
+{
+    uint64_t time;
+    uint32_t us;
+
+    if (link >= TSYNC_MAX_LINKS) {
+        return;
+    }
+    tsync_link_t * p_link = &links[link];
+
+    /* Host arrival time of previous reply completes previous exchange */
+    if (p_link->last.valid && p_request->has_prev_arrival && p_request->prev_sequence == p_link->last.sequence)
+    {
+        add_sample(p_link, TIMESTAMP_TO_US(p_request->prev_arrival));
+        estimate(link);
+    }
+
+    p_link->last.valid = p_request->has_origin;
+    p_link->last.sequence = p_request->sequence;
+    p_link->last.origin_us = TIMESTAMP_TO_US(p_request->origin);
+    p_link->last.receive_ticks = rx_ticks;
+
+    p_reply->sequence = p_request->sequence;
+    p_reply->has_origin = p_request->has_origin;
+    p_reply->origin = p_request->origin;
+    p_reply->skew_ppb = p_link->skew_ppb;
+    p_reply->delay_us = p_link->last_delay_us;
+
+    CAL_TicksToTime(rx_ticks, &time, &us);
+    p_reply->has_receive = true;
+    p_reply->receive.time = time;
+    p_reply->receive.us = us;
+
+    /* Taken last, reply is sent right after */
+    p_link->last.transmit_ticks = CAL_GetTicks64();
+    CAL_TicksToTime(p_link->last.transmit_ticks, &time, &us);
+    p_reply->has_transmit = true;
+    p_reply->transmit.time = time;
+    p_reply->transmit.us = us;
+}
+
+/*******************************************************************************
+ * STATIC FUNCTIONS
+ ******************************************************************************/
+
+/* Offset and delay of last exchange, device times are taken from RTC without correction */
+static void add_sample(tsync_link_t * p_link, int64_t host_arrival_us)
+{
+    tsync_sample_t sample;
+    int64_t t2 = TICKS_TO_US(p_link->last.receive_ticks);
+    int64_t t3 = TICKS_TO_US(p_link->last.transmit_ticks);
+
+    sample.device_ticks = p_link->last.receive_ticks + (p_link->last.transmit_ticks - p_link->last.receive_ticks) / 2;
+    sample.device_us = TICKS_TO_US(sample.device_ticks);
+    sample.offset_us = ((p_link->last.origin_us - t2) + (host_arrival_us - t3)) / 2;
+    sample.delay_us = (host_arrival_us - p_link->last.origin_us) - (t3 - t2);
+
+    if (sample.delay_us < 0) {
+        LOG_WRN("inconsistent exchange %u ignored", p_link->last.sequence);
+        return;
+    }
+    p_link->last_delay_us = sample.delay_us;
+
+    /* Fastest exchange of current period replaces slower ones */
+    tsync_sample_t * p_current = &p_link->samples[(p_link->sample_pos + TSYNC_MAX_SAMPLES - 1) % TSYNC_MAX_SAMPLES];
+    if (p_link->sample_count > 0 && sample.device_us - p_link->period_start_us < TSYNC_PERIOD_US)
+    {
+        if (sample.delay_us < p_current->delay_us) {
+            *p_current = sample;
+        }
+        return;
+    }
+
+    p_link->period_start_us = sample.device_us;
+    p_link->samples[p_link->sample_pos] = sample;
+    p_link->sample_pos = (p_link->sample_pos + 1) % TSYNC_MAX_SAMPLES;
+    if (p_link->sample_count < TSYNC_MAX_SAMPLES) {
+        p_link->sample_count++;
+    }
+}
+
+/* Least squares line through kept offsets, relative to the most recent one */
+static void estimate(uint8_t link)
+{
+    tsync_link_t * p_link = &links[link];
+    const tsync_sample_t * samples = p_link->samples;
+    const tsync_sample_t * p_ref = &samples[(p_link->sample_pos + TSYNC_MAX_SAMPLES - 1) % TSYNC_MAX_SAMPLES];
+
+    if (p_link->sample_count == 0) {
+        return;
+    }
+
+    /* Sums are taken around integer means, so that single precision floats,
+     * which the FPU handles, keep sub-ppb slopes over hours of exchanges */
+    int64_t n = p_link->sample_count;
+    int64_t mean_x = 0, mean_y = 0;
+    for (uint8_t i = 0; i < n; i++)
+    {
+        mean_x += samples[i].device_us - p_ref->device_us;
+        mean_y += samples[i].offset_us - p_ref->offset_us;
+    }
+    mean_x /= n;
+    mean_y /= n;
+
+    float sxx = 0, sxy = 0;
+    for (uint8_t i = 0; i < n; i++)
+    {
+        float x = (float)(samples[i].device_us - p_ref->device_us - mean_x);
+        float y = (float)(samples[i].offset_us - p_ref->offset_us - mean_y);
+        sxx += x * x;
+        sxy += x * y;
+    }
+
+    float slope = p_link->skew_ppb * 1e-9f;
+    if (n >= 2 && sxx > 0) {
+        slope = sxy / sxx;
+    }
+    slope = CLAMP(slope, -TSYNC_MAX_SKEW_PPB * 1e-9f, TSYNC_MAX_SKEW_PPB * 1e-9f);
+    /* Line offset at the most recent exchange */
+    int64_t intercept = mean_y - (int64_t)(slope * (float)mean_x);
+
+    p_link->skew_ppb = (int32_t)(slope * 1e9f);
+    LOG_INF("Time sync %u: %d ppb skew, %lld us round trip", link, p_link->skew_ppb, p_ref->delay_us);
+
+    if (calendar_link == TSYNC_NO_LINK) {
+        calendar_link = link;
+    }
+    if (calendar_link == link) {
+        CAL_SetSync(p_ref->device_ticks, p_ref->device_us + p_ref->offset_us + intercept, p_link->skew_ppb);
+    }
+}
@@ -0,0 +1,71 @@
+/**
+ *******************************************************************************
+ * @file    timesync.h
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Host time synchronization module header file
+ *******************************************************************************
+ */
+
+#ifndef __TIMESYNC_H__
+#define __TIMESYNC_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+#include <stdint.h>
+
+#include "protocol/protocol.pb.h"
+
+/*******************************************************************************
+ * MACROS AND DEFINES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * TYPEDEFS
+ ******************************************************************************/
+
+/*******************************************************************************
+ * EXPORTED VARIABLES
+ ******************************************************************************/
+
+/*******************************************************************************
+ * GLOBAL FUNCTION PROTOTYPES
+ ******************************************************************************/
+
+/**
+ * @brief Forget exchanges of a previous host on a link, on connection. The
+ * calendar stops following host clock unless another central drives it
+ * @param [in] link central index
+ */
+void TSYNC_Reset(uint8_t link);
+
+/**
+ * @brief Let another central drive the calendar, on disconnection. The
+ * calendar keeps following the last model meanwhile
+ * @param [in] link central index
+ */
+void TSYNC_Release(uint8_t link);
+
+/**
+ * @brief Answer a time synchronization request. The previous exchange,
+ * completed by the host arrival time carried in the request, is added to
+ * the offset and skew estimation of that central, applied to the calendar
+ * if it drives it
+ * @param [in]  link central index
+ * @param [in]  p_request request from host
+ * @param [in]  rx_ticks calendar ticks when request was received
+ * @param [out] p_reply reply to send back at once
+ */
+void TSYNC_HandleRequest(uint8_t link, const TimeSyncRequest * p_request, uint64_t rx_ticks, TimeSync * p_reply);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TIMESYNC_H__ */
@@ -0,0 +1,239 @@
+/**
+ *******************************************************************************
+ * @file    main.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Codec tests
+ *
+ * Messages are framed as for NUS, then read back either as NUS frames or as
+ * the bare messages the ECG service decodes from the transfers ring.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+/* Application includes */
+#include "bluetooth/ring.h"
+#include "codec/codec.h"
+#include "protocol/protocol.pb.h"
+#include "stats/stats.h"
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define TEST_SAMPLES            1000    /**< Full EcgBuffer data */
+#define TEST_FRAME_SIZE         CODEC_BUFFER_SIZE(EcgBuffer_size)
+#define TEST_RING_SIZE          (4 * TEST_FRAME_SIZE)
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+static EcgBuffer ecg_buffer;
+static EcgBuffer decoded;
+static uint8_t frame[TEST_FRAME_SIZE];
+static uint8_t message[EcgBuffer_size];
+
+/*******************************************************************************
+ * FAKE STATISTICS
+ ******************************************************************************/
+
+void STATS_Add(stats_counter_t counter, uint32_t value)
+{
+}
+
+/*******************************************************************************
+ * HELPERS
+ ******************************************************************************/
+
+/* Small samples around zero, as from a flat line: many zero bytes, and long
+ * runs without any when saturated */
+static void make_ecg_buffer(EcgBuffer * p_buffer, uint16_t samples)
+{
+    *p_buffer = (EcgBuffer) EcgBuffer_init_zero;
+    for (uint16_t i = 0; i < samples; i++)
+    {
+        int16_t sample = (i < samples / 2) ? (int16_t)(i % 7) - 3 : (int16_t)0x7F7F;
+        p_buffer->data.bytes[2 * i] = sample & 0xFF;
+        p_buffer->data.bytes[2 * i + 1] = (sample >> 8) & 0xFF;
+    }
+    p_buffer->data.size = 2 * samples;
+    p_buffer->lodpn = 1;
+    p_buffer->has_timestamp = true;
+    p_buffer->timestamp.time = 1760000000;
+    p_buffer->timestamp.us = 250000;
+    p_buffer->rate = 512;
+    p_buffer->lodpn_changes[0] = 40;
+    p_buffer->lodpn_changes[1] = 0;
+    p_buffer->lodpn_changes_count = 2;
+    p_buffer->sequence = 1234;
+    p_buffer->period_ns = 1953125;
+}
+
+static void check_ecg_buffer(const EcgBuffer * p_buffer, const EcgBuffer * p_expected)
+{
+    zassert_equal(p_buffer->data.size, p_expected->data.size);
+    zassert_mem_equal(p_buffer->data.bytes, p_expected->data.bytes, p_expected->data.size);
+    zassert_equal(p_buffer->lodpn, p_expected->lodpn);
+    zassert_equal(p_buffer->has_timestamp, p_expected->has_timestamp);
+    zassert_equal(p_buffer->timestamp.time, p_expected->timestamp.time);
+    zassert_equal(p_buffer->timestamp.us, p_expected->timestamp.us);
+    zassert_equal(p_buffer->rate, p_expected->rate);
+    zassert_equal(p_buffer->lodpn_changes_count, p_expected->lodpn_changes_count);
+    zassert_mem_equal(p_buffer->lodpn_changes, p_expected->lodpn_changes,
+                      p_expected->lodpn_changes_count * sizeof(uint32_t));
+    zassert_equal(p_buffer->sequence, p_expected->sequence);
+    zassert_equal(p_buffer->period_ns, p_expected->period_ns);
+}
+
+/* A frame ends with its only delimiter */
+static void check_frame(const uint8_t * p_frame, int length)
+{
+    zassert_true(length >= 2);
+    zassert_equal(p_frame[length - 1], COBS_FRAME_DELIMITER);
+    for (int i = 0; i < length - 1; i++) {
+        zassert_not_equal(p_frame[i], COBS_FRAME_DELIMITER, "byte %d", i);
+    }
+}
+
+/*******************************************************************************
+ * TESTS
+ ******************************************************************************/
+
+/* Largest frame, over many COBS blocks */
+ZTEST(codec, test_frame)
+{
+    make_ecg_buffer(&ecg_buffer, TEST_SAMPLES);
+
+    int length = CODEC_Encode(EcgBuffer_fields, &ecg_buffer, frame, sizeof(frame));
+    zassert_true(length > 2 * TEST_SAMPLES);
+    check_frame(frame, length);
+
+    zassert_ok(CODEC_Decode(EcgBuffer_fields, &decoded, frame, length));
+    check_ecg_buffer(&decoded, &ecg_buffer);
+}
+
+ZTEST(codec, test_packet)
+{
+    Packet packet = Packet_init_zero;
+    Packet received = Packet_init_zero;
+
+    packet.which_payload = Packet_heart_rate_tag;
+    packet.payload.heart_rate.bpm = 72;
+    packet.payload.heart_rate.rr[0] = 853;
+    packet.payload.heart_rate.rr_count = 1;
+
+    int length = CODEC_Encode(Packet_fields, &packet, frame, sizeof(frame));
+    check_frame(frame, length);
+    zassert_ok(CODEC_Decode(Packet_fields, &received, frame, length));
+    zassert_equal(received.which_payload, Packet_heart_rate_tag);
+    zassert_equal(received.payload.heart_rate.bpm, 72);
+    zassert_equal(received.payload.heart_rate.rr_count, 1);
+    zassert_equal(received.payload.heart_rate.rr[0], 853);
+}
+
+/* Unframed NUS frame is the bare message, as written to the ECG service */
+ZTEST(codec, test_bare)
+{
+    make_ecg_buffer(&ecg_buffer, TEST_SAMPLES / 3);
+
+    int bare = CODEC_EncodeMessage(EcgBuffer_fields, &ecg_buffer, message, sizeof(message));
+    zassert_true(bare > 0);
+    int length = CODEC_Encode(EcgBuffer_fields, &ecg_buffer, frame, sizeof(frame));
+    zassert_true(length > bare);
+
+    zassert_equal(CODEC_Unframe(frame, length), bare);
+    zassert_mem_equal(&frame[1], message, bare);
+    zassert_ok(CODEC_DecodeMessage(EcgBuffer_fields, &decoded, message, bare));
+    check_ecg_buffer(&decoded, &ecg_buffer);
+
+    /* Command written to the ECG service control point */
+    Command command = Command_init_zero;
+    command.which_request = Command_start_tag;
+    command.request.start = true;
+    bare = CODEC_EncodeMessage(Command_fields, &command, message, sizeof(message));
+    command = (Command) Command_init_zero;
+    zassert_ok(CODEC_DecodeMessage(Command_fields, &command, message, bare));
+    zassert_equal(command.which_request, Command_start_tag);
+    zassert_true(command.request.start);
+}
+
+ZTEST(codec, test_no_room)
+{
+    make_ecg_buffer(&ecg_buffer, TEST_SAMPLES);
+
+    zassert_true(CODEC_Encode(EcgBuffer_fields, &ecg_buffer, frame, 2 * TEST_SAMPLES) < 0);
+    zassert_equal(CODEC_EncodeMessage(EcgBuffer_fields, &ecg_buffer, message, 2 * TEST_SAMPLES), -ENOMEM);
+}
+
+ZTEST(codec, test_corrupt)
+{
+    make_ecg_buffer(&ecg_buffer, 50);
+    int length = CODEC_Encode(EcgBuffer_fields, &ecg_buffer, frame, sizeof(frame));
+
+    /* Delimiter within frame, or missing */
+    frame[length / 2] = COBS_FRAME_DELIMITER;
+    zassert_equal(CODEC_Decode(EcgBuffer_fields, &decoded, frame, length), -EINVAL);
+    length = CODEC_Encode(EcgBuffer_fields, &ecg_buffer, frame, sizeof(frame));
+    zassert_equal(CODEC_Decode(EcgBuffer_fields, &decoded, frame, length - 1), -EINVAL);
+
+    /* Data field longer than the message */
+    static const uint8_t truncated[] = { 0x0A, 0x10, 0x01, 0x02 };
+    zassert_equal(CODEC_DecodeMessage(EcgBuffer_fields, &decoded, truncated, sizeof(truncated)), -EBADMSG);
+}
+
+/* Frames queued for the centrals are decoded by the ECG service to the bare
+ * messages, whatever their position in the ring */
+ZTEST(codec, test_ecg_service)
+{
+    static uint8_t ring_buffer[TEST_RING_SIZE];
+    static uint8_t ecg_message[EcgBuffer_size];
+    ring_reader_t reader;
+    ring_t ring;
+
+    RING_Init(&ring, ring_buffer, sizeof(ring_buffer), &reader, 1);
+    RING_Attach(&ring, &reader);
+
+    for (uint16_t i = 0; i < 20; i++)
+    {
+        make_ecg_buffer(&ecg_buffer, TEST_SAMPLES - 37 * i);
+        ecg_buffer.sequence = i;
+        int bare = CODEC_EncodeMessage(EcgBuffer_fields, &ecg_buffer, message, sizeof(message));
+        int length = CODEC_Encode(EcgBuffer_fields, &ecg_buffer, frame, sizeof(frame));
+
+        zassert_ok(RING_Reserve(&ring, length));
+        RING_Write(&ring, BIT(0), frame, length);
+        RING_Publish(&ring, length);
+
+        zassert_true(RING_NextRecord(&ring, &reader));
+        uint32_t size = RING_GetFrame(&ring, &reader);
+        zassert_equal(size, length);
+        zassert_equal(RING_GetDecodedSize(&ring, &reader, size), bare);
+
+        /* Split across notifications */
+        RING_BeginDecode(&reader);
+        for (int offset = 0, piece; offset < bare; offset += piece)
+        {
+            piece = MIN(244, bare - offset);
+            RING_Decode(&ring, &reader, &ecg_message[offset], piece);
+        }
+        zassert_mem_equal(ecg_message, message, bare, "frame %u", i);
+        zassert_ok(CODEC_DecodeMessage(EcgBuffer_fields, &decoded, ecg_message, bare));
+        check_ecg_buffer(&decoded, &ecg_buffer);
+        reader.tail = reader.record_end;
+    }
+}
+
+ZTEST_SUITE(codec, NULL, NULL, NULL, NULL, NULL);
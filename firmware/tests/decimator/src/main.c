@@ -0,0 +1,238 @@
+/**
+ *******************************************************************************
+ * @file    main.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Decimator tests
+ *
+ * Tones at 512 Hz are decimated by 2 and 4, output energy tells passband and
+ * stopband gains.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/ztest.h>
+
+/* Application includes */
+#include "dsp/decimator.h"
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define TEST_AMPLITUDE          8000
+#define TEST_SAMPLES            2048    /**< 4 s at 512 Hz */
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+/* Tone at 512 Hz, as cos and sin of the phase step (no libm needed) */
+typedef struct
+{
+    double cos_w;
+    double sin_w;
+} test_tone_t;
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+static const test_tone_t tone_16hz  = { 0.98078528040323044913, 0.19509032201612826785 };
+static const test_tone_t tone_100hz = { 0.33688985339222005111, 0.94154406518302077841 };
+static const test_tone_t tone_192hz = { -0.70710678118654752440, 0.70710678118654752440 };
+
+static int16_t input[TEST_SAMPLES];
+static int16_t output[TEST_SAMPLES + 1];
+static int16_t expected[TEST_SAMPLES + 1];
+
+/*******************************************************************************
+ * HELPERS
+ ******************************************************************************/
+
+static void make_tone(const test_tone_t * p_tone, int16_t * p_out, size_t count)
+{
+    /* sin((n + 1) w) = 2 cos(w) sin(n w) - sin((n - 1) w) */
+    double prev = -p_tone->sin_w;
+    double cur = 0.0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        p_out[i] = (int16_t)(TEST_AMPLITUDE * cur);
+        double next = 2.0 * p_tone->cos_w * cur - prev;
+        prev = cur;
+        cur = next;
+    }
+}
+
+/* Mean output energy once filter history is filled with the tone */
+static uint64_t tone_energy(uint8_t factor, const test_tone_t * p_tone)
+{
+    decimator_t decim;
+    uint64_t energy = 0;
+
+    zassert_ok(DECIM_Init(&decim, factor));
+    make_tone(p_tone, input, TEST_SAMPLES);
+    size_t count = DECIM_Process(&decim, input, TEST_SAMPLES, output);
+    zassert_equal(count, TEST_SAMPLES / factor);
+
+    size_t settled = DECIM_MAX_TAPS / factor;
+    for (size_t i = settled; i < count; i++) {
+        energy += (int32_t)output[i] * output[i];
+    }
+    return energy / (count - settled);
+}
+
+/*******************************************************************************
+ * TESTS
+ ******************************************************************************/
+
+ZTEST(decimator, test_factors)
+{
+    decimator_t decim;
+
+    zassert_ok(DECIM_Init(&decim, 1));
+    zassert_ok(DECIM_Init(&decim, 2));
+    zassert_ok(DECIM_Init(&decim, 4));
+    zassert_equal(DECIM_Init(&decim, 0), -EINVAL);
+    zassert_equal(DECIM_Init(&decim, 3), -EINVAL);
+    zassert_equal(DECIM_Init(&decim, 8), -EINVAL);
+}
+
+ZTEST(decimator, test_pass_through)
+{
+    decimator_t decim;
+
+    zassert_ok(DECIM_Init(&decim, 1));
+    make_tone(&tone_100hz, input, 100);
+    zassert_equal(DECIM_Process(&decim, input, 100, output), 100);
+    zassert_mem_equal(output, input, 100 * sizeof(int16_t));
+    zassert_equal(DECIM_GetDelay2(&decim), 0);
+}
+
+/* Phase goes on across calls, buffers need not be multiples of the factor */
+ZTEST(decimator, test_phase)
+{
+    decimator_t decim;
+
+    zassert_ok(DECIM_Init(&decim, 4));
+    zassert_equal(DECIM_Process(&decim, input, 7, output), 1);
+    zassert_equal(DECIM_Process(&decim, input, 9, output), 3);
+    zassert_equal(DECIM_Process(&decim, input, 2, output), 0);
+    zassert_equal(DECIM_Process(&decim, input, 2, output), 1);
+
+    zassert_ok(DECIM_Init(&decim, 2));
+    zassert_equal(DECIM_Process(&decim, input, 5, output), 2);
+    zassert_equal(DECIM_Process(&decim, input, 5, output), 3);
+}
+
+/* Same output whatever the buffer lengths */
+ZTEST(decimator, test_chunks)
+{
+    decimator_t decim;
+    size_t count = 0;
+
+    make_tone(&tone_16hz, input, TEST_SAMPLES);
+    zassert_ok(DECIM_Init(&decim, 4));
+    size_t total = DECIM_Process(&decim, input, TEST_SAMPLES, expected);
+
+    zassert_ok(DECIM_Init(&decim, 4));
+    for (size_t i = 0, length = 1; i < TEST_SAMPLES; i += length, length = (length % 13) + 1)
+    {
+        length = MIN(length, TEST_SAMPLES - i);
+        count += DECIM_Process(&decim, &input[i], length, &output[count]);
+    }
+    zassert_equal(count, total);
+    zassert_mem_equal(output, expected, total * sizeof(int16_t));
+}
+
+ZTEST(decimator, test_reset)
+{
+    decimator_t decim;
+
+    make_tone(&tone_100hz, input, TEST_SAMPLES);
+    zassert_ok(DECIM_Init(&decim, 2));
+    size_t total = DECIM_Process(&decim, input, TEST_SAMPLES, expected);
+
+    /* History and phase of previous samples are forgotten */
+    zassert_ok(DECIM_Init(&decim, 2));
+    DECIM_Process(&decim, input, 101, output);
+    DECIM_Reset(&decim);
+    zassert_equal(DECIM_Process(&decim, input, TEST_SAMPLES, output), total);
+    zassert_mem_equal(output, expected, total * sizeof(int16_t));
+}
+
+/* Unity gain at DC, without rounding error */
+ZTEST(decimator, test_dc_gain)
+{
+    static const uint8_t factors[] = { 2, 4 };
+    decimator_t decim;
+
+    for (size_t i = 0; i < TEST_SAMPLES; i++) {
+        input[i] = -1234;
+    }
+    for (size_t f = 0; f < ARRAY_SIZE(factors); f++)
+    {
+        zassert_ok(DECIM_Init(&decim, factors[f]));
+        size_t count = DECIM_Process(&decim, input, TEST_SAMPLES, output);
+        for (size_t i = DECIM_MAX_TAPS / factors[f]; i < count; i++) {
+            zassert_equal(output[i], -1234);
+        }
+    }
+}
+
+/* A ramp comes out delayed by the reported group delay */
+ZTEST(decimator, test_delay)
+{
+    static const uint8_t factors[] = { 2, 4 };
+    decimator_t decim;
+
+    for (size_t i = 0; i < TEST_SAMPLES; i++) {
+        input[i] = i;
+    }
+    for (size_t f = 0; f < ARRAY_SIZE(factors); f++)
+    {
+        uint8_t factor = factors[f];
+        zassert_ok(DECIM_Init(&decim, factor));
+        uint32_t delay2 = DECIM_GetDelay2(&decim);
+        zassert_true(delay2 > 0 && delay2 < 2 * DECIM_MAX_TAPS);
+
+        size_t count = DECIM_Process(&decim, input, TEST_SAMPLES, output);
+        for (size_t k = DECIM_MAX_TAPS / factor; k < count; k++)
+        {
+            /* Output k is computed on input (k + 1) * factor - 1 */
+            int32_t last = (k + 1) * factor - 1;
+            zassert_within(2 * output[k], 2 * last - (int32_t)delay2, 2);
+        }
+    }
+}
+
+ZTEST(decimator, test_passband)
+{
+    uint64_t in = (uint64_t)TEST_AMPLITUDE * TEST_AMPLITUDE / 2;
+
+    /* 16 Hz within 0.5 dB */
+    zassert_between_inclusive(tone_energy(2, &tone_16hz), in * 89 / 100, in * 101 / 100);
+    zassert_between_inclusive(tone_energy(4, &tone_16hz), in * 89 / 100, in * 101 / 100);
+}
+
+ZTEST(decimator, test_stopband)
+{
+    uint64_t in = (uint64_t)TEST_AMPLITUDE * TEST_AMPLITUDE / 2;
+
+    /* Tones above the output Nyquist frequency would alias: 192 Hz at 256 Hz
+     * output more than 40 dB down, 100 Hz at 128 Hz output more than 60 dB down */
+    zassert_true(tone_energy(2, &tone_192hz) < in / 10000);
+    zassert_true(tone_energy(4, &tone_100hz) < in / 1000000);
+}
+
+ZTEST_SUITE(decimator, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,239 @@
+/**
+ *******************************************************************************
+ * @file    main.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Retransmission history tests
+ *
+ * Frames of varying length are stored in a 1000 bytes history, so that they
+ * wrap around its end, then requested back and compared to what was stored.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+/* Application includes */
+#include "stats/stats.h"
+#include "history/history.h"
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define TEST_MAX_LENGTH         64
+#define TEST_MAX_RANGES         8       /**< As in history.c */
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+static uint32_t missed;
+static uint8_t frame[TEST_MAX_LENGTH];
+
+/*******************************************************************************
+ * FAKE STATISTICS
+ ******************************************************************************/
+
+void STATS_Add(stats_counter_t counter, uint32_t value)
+{
+    if (counter == STATS_RESEND_MISSED) {
+        missed += value;
+    }
+}
+
+/*******************************************************************************
+ * HELPERS
+ ******************************************************************************/
+
+/* Lengths do not divide history size, frames end up across its end */
+static uint16_t test_length(uint32_t sequence)
+{
+    return 20 + (sequence % 37);
+}
+
+static void make_frame(uint32_t sequence, uint8_t * p_frame)
+{
+    for (uint16_t i = 0; i < test_length(sequence); i++) {
+        p_frame[i] = (uint8_t)(sequence * 7 + i);
+    }
+}
+
+static void store(uint32_t first, uint32_t count)
+{
+    for (uint32_t sequence = first; sequence < first + count; sequence++)
+    {
+        make_frame(sequence, frame);
+        HIST_Store(sequence, frame, test_length(sequence));
+    }
+}
+
+/* Next frame resent is the one of that sequence */
+static void check_next(uint32_t sequence)
+{
+    uint8_t expected[TEST_MAX_LENGTH];
+
+    make_frame(sequence, expected);
+    zassert_equal(HIST_Next(frame, sizeof(frame)), test_length(sequence), "frame %u", sequence);
+    zassert_mem_equal(frame, expected, test_length(sequence), "frame %u", sequence);
+}
+
+/*******************************************************************************
+ * TESTS
+ ******************************************************************************/
+
+ZTEST(history, test_resend)
+{
+    store(0, 10);
+    zassert_equal(HIST_Next(frame, sizeof(frame)), 0);
+
+    zassert_ok(HIST_Request(2, 3));
+    zassert_ok(HIST_Request(7, 1));
+    check_next(2);
+    check_next(3);
+    check_next(4);
+    check_next(7);
+    zassert_equal(HIST_Next(frame, sizeof(frame)), 0);
+    zassert_equal(missed, 0);
+}
+
+/* Frames are copied back whole from both ends of the history */
+ZTEST(history, test_wrap)
+{
+    uint32_t written = 0;
+    uint32_t sequence = 0;
+
+    /* Find a frame across the end of the history, on its second pass */
+    while (written < HIST_BUFFER_SIZE ||
+           (written % HIST_BUFFER_SIZE) + test_length(sequence) <= HIST_BUFFER_SIZE)
+    {
+        written += test_length(sequence);
+        sequence++;
+    }
+    store(0, sequence + 2);
+
+    zassert_ok(HIST_Request(sequence - 1, 3));
+    check_next(sequence - 1);
+    check_next(sequence);
+    check_next(sequence + 1);
+    zassert_equal(missed, 0);
+}
+
+/* Frames whose bytes were overwritten are skipped and counted, the rest of
+ * the range is still sent */
+ZTEST(history, test_overwritten)
+{
+    /* About 1500 bytes, oldest frames kept are those of the last 1000 */
+    uint32_t first = 40;
+    uint32_t kept = 0;
+    while (kept + test_length(first - 1) <= HIST_BUFFER_SIZE) {
+        kept += test_length(--first);
+    }
+    zassert_true(first > 0);
+
+    store(0, 40);
+    zassert_ok(HIST_Request(0, 40));
+    for (uint32_t sequence = first; sequence < 40; sequence++) {
+        check_next(sequence);
+    }
+    zassert_equal(HIST_Next(frame, sizeof(frame)), 0);
+    zassert_equal(missed, first);
+}
+
+/* Frame index holds fewer frames than the history bytes once they are small */
+ZTEST(history, test_index)
+{
+    static const uint8_t tiny = 0x5A;
+
+    for (uint32_t sequence = 0; sequence < HIST_MAX_FRAMES + 10; sequence++) {
+        HIST_Store(sequence, &tiny, 1);
+    }
+
+    zassert_ok(HIST_Request(8, 4));
+    zassert_equal(HIST_Next(frame, sizeof(frame)), 1);
+    zassert_equal(frame[0], tiny);
+    zassert_equal(missed, 2);
+
+    /* A sequence never stored is not mistaken for the one sharing its entry */
+    zassert_ok(HIST_Request(HIST_MAX_FRAMES + 20, 1));
+    zassert_equal(HIST_Next(frame, sizeof(frame)), 1);
+    zassert_equal(HIST_Next(frame, sizeof(frame)), 0);
+    zassert_equal(missed, 3);
+}
+
+/* A frame that does not fit is kept for one call, then given up */
+ZTEST(history, test_too_long)
+{
+    store(0, 3);
+    zassert_ok(HIST_Request(0, 3));
+
+    zassert_equal(HIST_Next(frame, test_length(0) - 1), 0);
+    zassert_equal(missed, 0);
+    check_next(0);
+
+    zassert_equal(HIST_Next(frame, test_length(1) - 1), 0);
+    zassert_equal(HIST_Next(frame, test_length(1) - 1), 0);
+    zassert_equal(missed, 1);
+    check_next(2);
+}
+
+ZTEST(history, test_requests)
+{
+    zassert_equal(HIST_Request(5, 0), -EINVAL);
+
+    for (int i = 0; i < TEST_MAX_RANGES; i++) {
+        zassert_ok(HIST_Request(i, 1));
+    }
+    zassert_equal(HIST_Request(100, 1), -ENOMEM);
+
+    /* Nothing was stored, every requested frame is missed */
+    zassert_equal(HIST_Next(frame, sizeof(frame)), 0);
+    zassert_equal(missed, TEST_MAX_RANGES);
+
+    /* Ranges are bounded by the frames indexed */
+    zassert_ok(HIST_Request(0, UINT32_MAX));
+    zassert_equal(HIST_Next(frame, sizeof(frame)), 0);
+    zassert_equal(missed, TEST_MAX_RANGES + HIST_MAX_FRAMES);
+}
+
+/* Sequence restarts with a new acquisition, previous frames and requests are forgotten */
+ZTEST(history, test_reset)
+{
+    store(0, 5);
+    zassert_ok(HIST_Request(0, 5));
+    check_next(0);
+
+    HIST_Reset();
+    zassert_equal(HIST_Next(frame, sizeof(frame)), 0);
+    zassert_equal(missed, 0);
+
+    zassert_ok(HIST_Request(1, 1));
+    zassert_equal(HIST_Next(frame, sizeof(frame)), 0);
+    zassert_equal(missed, 1);
+
+    store(0, 2);
+    zassert_ok(HIST_Request(1, 1));
+    check_next(1);
+}
+
+/*******************************************************************************
+ * SUITE
+ ******************************************************************************/
+
+static void history_before(void * fixture)
+{
+    HIST_Reset();
+    missed = 0;
+}
+
+ZTEST_SUITE(history, NULL, NULL, history_before, NULL, NULL);
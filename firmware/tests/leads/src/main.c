@@ -0,0 +1,194 @@
+/**
+ *******************************************************************************
+ * @file    main.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Lead status changes tests
+ *
+ * Frame changes are decoded back to one status per sample, as the host does.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <stdint.h>
+#include <string.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/ztest.h>
+
+/* Application includes */
+#include "dsp/leads.h"
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define TEST_INTERVAL           64      /**< 512 Hz in 32768 Hz ticks */
+#define TEST_START              100000
+#define TEST_SAMPLES            100
+#define TEST_MAX_CHANGES        8       /**< As EcgBuffer.lodpn_changes */
+
+/*******************************************************************************
+ * HELPERS
+ ******************************************************************************/
+
+/* Status of every sample of a frame from its first status and changes */
+static void decode_runs(const uint32_t * p_runs, size_t count, uint16_t lodpn,
+                        uint16_t * p_status, size_t samples)
+{
+    size_t index = 0;
+
+    for (size_t i = 0; i + 1 < count; i += 2)
+    {
+        for (size_t end = index + p_runs[i]; index < end && index < samples; index++) {
+            p_status[index] = lodpn;
+        }
+        lodpn = p_runs[i + 1];
+    }
+    for (; index < samples; index++) {
+        p_status[index] = lodpn;
+    }
+}
+
+/* Code a frame as the output does: a change is added when status differs from previous sample */
+static size_t encode_runs(const uint16_t * p_status, size_t samples, uint32_t * p_storage, size_t size)
+{
+    leads_runs_t runs;
+
+    LEADS_Begin(&runs, p_storage, size);
+    for (size_t i = 1; i < samples; i++)
+    {
+        if (p_status[i] != p_status[i - 1]) {
+            LEADS_Add(&runs, i, p_status[i]);
+        }
+    }
+    return runs.count;
+}
+
+/*******************************************************************************
+ * TESTS
+ ******************************************************************************/
+
+/* A change applies from the first sample acquired after it */
+ZTEST(leads, test_locate)
+{
+    const leads_event_t events[] = {
+        { TEST_START - 10, 1 },                         /* Before buffer, from first sample */
+        { TEST_START + 5 * TEST_INTERVAL, 0 },          /* On sample 5 */
+        { TEST_START + 5 * TEST_INTERVAL + 1, 2 },      /* Just after, from sample 6 */
+        { TEST_START + 40 * TEST_INTERVAL - 1, 3 },     /* Just before sample 40 */
+    };
+    leads_change_t changes[ARRAY_SIZE(events)];
+
+    size_t count = LEADS_Locate(events, ARRAY_SIZE(events), TEST_START, TEST_INTERVAL,
+                                TEST_SAMPLES, 0, changes);
+    zassert_equal(count, 4);
+    zassert_equal(changes[0].index, 0);
+    zassert_equal(changes[0].lodpn, 1);
+    zassert_equal(changes[1].index, 5);
+    zassert_equal(changes[1].lodpn, 0);
+    zassert_equal(changes[2].index, 6);
+    zassert_equal(changes[2].lodpn, 2);
+    zassert_equal(changes[3].index, 40);
+    zassert_equal(changes[3].lodpn, 3);
+}
+
+/* Changes to the current status and after the buffer are left out */
+ZTEST(leads, test_locate_skip)
+{
+    const leads_event_t events[] = {
+        { TEST_START + 2 * TEST_INTERVAL, 1 },          /* Same as first sample */
+        { TEST_START + 10 * TEST_INTERVAL, 0 },
+        { TEST_START + 11 * TEST_INTERVAL, 0 },         /* Bounce back to same status */
+        { TEST_START + TEST_SAMPLES * TEST_INTERVAL, 1 }, /* Next buffer */
+        { TEST_START + (TEST_SAMPLES + 5) * TEST_INTERVAL, 3 },
+    };
+    leads_change_t changes[ARRAY_SIZE(events)];
+
+    size_t count = LEADS_Locate(events, ARRAY_SIZE(events), TEST_START, TEST_INTERVAL,
+                                TEST_SAMPLES, 1, changes);
+    zassert_equal(count, 1);
+    zassert_equal(changes[0].index, 10);
+    zassert_equal(changes[0].lodpn, 0);
+
+    zassert_equal(LEADS_Locate(events, 0, TEST_START, TEST_INTERVAL, TEST_SAMPLES, 1, changes), 0);
+}
+
+ZTEST(leads, test_runs)
+{
+    uint32_t storage[2 * TEST_MAX_CHANGES];
+    leads_runs_t runs;
+
+    LEADS_Begin(&runs, storage, ARRAY_SIZE(storage));
+    zassert_equal(runs.count, 0);
+
+    LEADS_Add(&runs, 10, 1);
+    LEADS_Add(&runs, 25, 0);
+    LEADS_Add(&runs, 26, 3);
+    zassert_equal(runs.count, 6);
+    zassert_equal(storage[0], 10);
+    zassert_equal(storage[1], 1);
+    zassert_equal(storage[2], 15);
+    zassert_equal(storage[3], 0);
+    zassert_equal(storage[4], 1);
+    zassert_equal(storage[5], 3);
+
+    /* Next frame starts its runs from its own first sample */
+    LEADS_Begin(&runs, storage, ARRAY_SIZE(storage));
+    LEADS_Add(&runs, 3, 2);
+    zassert_equal(runs.count, 2);
+    zassert_equal(storage[0], 3);
+}
+
+/* Bouncing leads fill the changes, last run is then off with every status seen */
+ZTEST(leads, test_runs_full)
+{
+    uint32_t storage[4];
+    leads_runs_t runs;
+
+    LEADS_Begin(&runs, storage, ARRAY_SIZE(storage));
+    LEADS_Add(&runs, 10, 0);
+    LEADS_Add(&runs, 20, 1);
+    LEADS_Add(&runs, 30, 0);
+    LEADS_Add(&runs, 40, 2);
+    zassert_equal(runs.count, 4);
+    zassert_equal(storage[2], 10);
+    zassert_equal(storage[3], 3);
+}
+
+/* Host gets back the status of every sample */
+ZTEST(leads, test_round_trip)
+{
+    uint16_t status[TEST_SAMPLES];
+    uint16_t decoded[TEST_SAMPLES];
+    uint32_t storage[2 * TEST_MAX_CHANGES];
+    uint32_t seed = 1;
+
+    for (int frame = 0; frame < 100; frame++)
+    {
+        /* Up to 8 runs of random status */
+        status[0] = frame % 4;
+        for (size_t i = 1; i < TEST_SAMPLES; i++)
+        {
+            seed = seed * 1103515245 + 12345;
+            status[i] = ((seed >> 16) % 16 == 0) ? ((seed >> 20) % 4) : status[i - 1];
+        }
+        size_t changes = 0;
+        for (size_t i = 1; i < TEST_SAMPLES; i++)
+        {
+            if (status[i] != status[i - 1] && ++changes > TEST_MAX_CHANGES) {
+                status[i] = status[i - 1];
+            }
+        }
+
+        size_t count = encode_runs(status, TEST_SAMPLES, storage, ARRAY_SIZE(storage));
+        decode_runs(storage, count, status[0], decoded, TEST_SAMPLES);
+        zassert_mem_equal(decoded, status, sizeof(status), "frame %d", frame);
+    }
+}
+
+ZTEST_SUITE(leads, NULL, NULL, NULL, NULL, NULL);
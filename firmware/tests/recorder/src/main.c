@@ -0,0 +1,353 @@
+/**
+ *******************************************************************************
+ * @file    main.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Recorder tests
+ *
+ * Sessions are recorded to a partition of the simulated flash, then listed
+ * and downloaded through a fake NUS that decodes every frame sent.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+#include <zephyr/storage/flash_map.h>
+
+/* Application includes */
+#include "bluetooth/bluetooth.h"
+#include "codec/codec.h"
+#include "recorder/recorder.h"
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define TEST_RATE               512
+#define TEST_PERIOD_NS          1953125
+#define TEST_TIME_US            1760000000000000ULL
+#define TEST_BUFFER_SAMPLES     128
+/* Samples of the test signal take one byte, block is closed when less than
+ * 3 bytes (largest difference) are left */
+#define TEST_BLOCK_SAMPLES      (sizeof(((RecordData *)0)->samples.bytes) - 2)
+#define TEST_MAX_BLOCKS         256
+#define TEST_STATUS_TIMEOUT     K_SECONDS(5)
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+/* Downloaded block, samples already checked against the test signal */
+typedef struct
+{
+    uint32_t session;
+    uint32_t block;
+    uint32_t index;
+    uint32_t count;
+} test_block_t;
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+static Packet received;
+static RecordStatus status;
+K_SEM_DEFINE(status_sem, 0, 1);
+
+static test_block_t blocks[TEST_MAX_BLOCKS];
+static uint32_t block_count;
+static uint32_t bad_samples;
+static uint32_t bad_frames;
+
+K_THREAD_DEFINE(recorder, 4096, REC_Thread, NULL, NULL, NULL, 7, 0, 0);
+
+/*******************************************************************************
+ * FAKE BLUETOOTH
+ ******************************************************************************/
+
+/* Small sawtooth, every difference is a single byte varint */
+static int16_t test_sample(uint32_t index)
+{
+    return (int16_t)(index % 50) - 25;
+}
+
+static void check_block(const RecordData * p_data)
+{
+    int16_t sample = 0;
+    uint32_t count = 0;
+    uint32_t zigzag = 0;
+    uint8_t shift = 0;
+
+    for (pb_size_t i = 0; i < p_data->samples.size; i++)
+    {
+        zigzag |= (uint32_t)(p_data->samples.bytes[i] & 0x7F) << shift;
+        shift += 7;
+        if (p_data->samples.bytes[i] & 0x80) {
+            continue;
+        }
+        sample += (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+        if (sample != test_sample(p_data->index + count)) {
+            bad_samples++;
+        }
+        count++;
+        zigzag = 0;
+        shift = 0;
+    }
+
+    if (block_count < TEST_MAX_BLOCKS)
+    {
+        blocks[block_count++] = (test_block_t) {
+            .session = p_data->session,
+            .block = p_data->block,
+            .index = p_data->index,
+            .count = count,
+        };
+    }
+}
+
+int BLE_SendTo(uint8_t link, const uint8_t * p_data, uint16_t length)
+{
+    static uint8_t frame[CODEC_BUFFER_SIZE(Packet_size)];
+
+    /* Sent from recorder thread, failures are checked by tests */
+    if (length > sizeof(frame))
+    {
+        bad_frames++;
+        return -EMSGSIZE;
+    }
+    memcpy(frame, p_data, length);
+    if (CODEC_Decode(Packet_fields, &received, frame, length) != 0)
+    {
+        bad_frames++;
+        return -EINVAL;
+    }
+
+    switch (received.which_payload)
+    {
+        case Packet_record_data_tag:
+            check_block(&received.payload.record_data);
+            break;
+
+        case Packet_record_status_tag:
+            status = received.payload.record_status;
+            k_sem_give(&status_sem);
+            break;
+
+        default:
+            break;
+    }
+    return 0;
+}
+
+bool BLE_IsSendBusy(void)
+{
+    return false;
+}
+
+int BLE_BulkBegin(uint8_t link)
+{
+    return -ENOTSUP;
+}
+
+int BLE_SendBulk(const uint8_t * p_data, uint32_t length)
+{
+    return -ENOTSUP;
+}
+
+void BLE_BulkEnd(void)
+{
+}
+
+int BLE_GetLinkInfo(uint8_t link, ble_link_info_t * p_info)
+{
+    return -ENOTCONN;
+}
+
+/*******************************************************************************
+ * HELPERS
+ ******************************************************************************/
+
+/* Send a request and wait for the status answering it */
+static const RecordStatus * request(RecordRequest_Action action, uint32_t session, uint32_t block)
+{
+    RecordRequest record = {
+        .action = action,
+        .session = session,
+        .block = block,
+    };
+
+    k_sem_reset(&status_sem);
+    zassert_ok(REC_Request(&record, 0));
+    zassert_ok(k_sem_take(&status_sem, TEST_STATUS_TIMEOUT), "no status");
+    return &status;
+}
+
+/* Record a whole session of the test signal, as acquisition buffers */
+static uint32_t record(uint32_t samples)
+{
+    int16_t buffer[TEST_BUFFER_SAMPLES];
+
+    uint32_t session = request(RecordRequest_Action_START, 0, 0)->session;
+    zassert_true(status.recording);
+
+    for (uint32_t index = 0; index < samples; index += TEST_BUFFER_SAMPLES)
+    {
+        uint16_t count = MIN(samples - index, TEST_BUFFER_SAMPLES);
+        for (uint16_t i = 0; i < count; i++) {
+            buffer[i] = test_sample(index + i);
+        }
+        REC_Append(buffer, count, TEST_RATE, TEST_PERIOD_NS,
+                   TEST_TIME_US + ((uint64_t)index * TEST_PERIOD_NS) / NSEC_PER_USEC, 0, true);
+        /* Flash writes keep up with acquisition */
+        k_msleep(1);
+    }
+
+    zassert_false(request(RecordRequest_Action_STOP, 0, 0)->recording);
+    return session;
+}
+
+static const RecordSession * find_session(uint32_t session)
+{
+    for (pb_size_t i = 0; i < status.sessions_count; i++)
+    {
+        if (status.sessions[i].session == session) {
+            return &status.sessions[i];
+        }
+    }
+    return NULL;
+}
+
+/* Download a session from a block, and check received blocks follow each other
+ * from first to last */
+static void download(uint32_t session, uint32_t block, uint32_t first, uint32_t last)
+{
+    block_count = 0;
+    bad_samples = 0;
+    bad_frames = 0;
+    request(RecordRequest_Action_DOWNLOAD, session, block);
+
+    zassert_equal(bad_frames, 0);
+    zassert_equal(block_count, last - first + 1);
+    zassert_equal(bad_samples, 0);
+    for (uint32_t i = 0; i < block_count; i++)
+    {
+        zassert_equal(blocks[i].session, session);
+        zassert_equal(blocks[i].block, first + i);
+        zassert_equal(blocks[i].index, (first + i) * TEST_BLOCK_SAMPLES);
+        if (i + 1 < block_count) {
+            zassert_equal(blocks[i].count, TEST_BLOCK_SAMPLES);
+        }
+    }
+}
+
+/*******************************************************************************
+ * TESTS
+ ******************************************************************************/
+
+ZTEST(recorder, test_append)
+{
+    uint32_t dropped = request(RecordRequest_Action_STATUS, 0, 0)->dropped_blocks;
+    zassert_true(status.size_kb > 0);
+    zassert_equal(status.used_kb, 0);
+
+    uint32_t session = record(3 * TEST_BLOCK_SAMPLES + 100);
+
+    const RecordSession * p_session = find_session(session);
+    zassert_not_null(p_session);
+    zassert_equal(p_session->first_block, 0);
+    zassert_equal(p_session->blocks, 4);
+    zassert_equal(p_session->rate, TEST_RATE);
+    zassert_true(p_session->has_start);
+    zassert_equal(p_session->start.time, TEST_TIME_US / USEC_PER_SEC);
+    zassert_equal(p_session->start.us, TEST_TIME_US % USEC_PER_SEC);
+    zassert_equal(status.dropped_blocks, dropped);
+    zassert_true(status.used_kb > 0);
+
+    /* Last block holds the samples left when recording stopped */
+    download(session, 0, 0, 3);
+    zassert_equal(blocks[3].count, 100);
+}
+
+ZTEST(recorder, test_list)
+{
+    uint32_t first = record(TEST_BLOCK_SAMPLES);
+    record(2 * TEST_BLOCK_SAMPLES);
+    uint32_t last = record(TEST_BLOCK_SAMPLES / 2);
+
+    request(RecordRequest_Action_STATUS, 0, 0);
+    zassert_equal(status.session, last);
+    zassert_equal(status.sessions_count, 3);
+    for (pb_size_t i = 0; i < status.sessions_count; i++)
+    {
+        zassert_equal(status.sessions[i].session, first + i);
+        zassert_equal(status.sessions[i].first_block, 0);
+    }
+    zassert_equal(status.sessions[0].blocks, 1);
+    zassert_equal(status.sessions[1].blocks, 2);
+    zassert_equal(status.sessions[2].blocks, 1);
+
+    /* Only requested session is sent */
+    download(first + 1, 0, 0, 1);
+}
+
+ZTEST(recorder, test_resume)
+{
+    uint32_t session = record(5 * TEST_BLOCK_SAMPLES);
+
+    /* Download interrupted after block 2 goes on from block 3 */
+    download(session, 3, 3, 4);
+
+    /* Sessions are still there after a reboot, numbering goes on */
+    zassert_ok(REC_Init());
+    zassert_not_null(find_session(request(RecordRequest_Action_STATUS, 0, 0)->session));
+    zassert_equal(record(TEST_BLOCK_SAMPLES), session + 1);
+    download(session, 0, 0, 4);
+}
+
+ZTEST(recorder, test_wrap)
+{
+    uint32_t old = record(10 * TEST_BLOCK_SAMPLES);
+    uint32_t dropped = status.dropped_blocks;
+
+    /* More blocks than the partition holds, oldest sectors are erased */
+    uint32_t session = record(200 * TEST_BLOCK_SAMPLES);
+
+    request(RecordRequest_Action_STATUS, 0, 0);
+    zassert_is_null(find_session(old));
+    const RecordSession * p_session = find_session(session);
+    zassert_not_null(p_session);
+    zassert_true(p_session->first_block > 0);
+    zassert_equal(p_session->first_block + p_session->blocks, 200);
+    zassert_true(status.used_kb <= status.size_kb);
+    zassert_equal(status.dropped_blocks, dropped);
+
+    /* Download from the start goes on from the oldest block left */
+    download(session, 0, p_session->first_block, 199);
+}
+
+/*******************************************************************************
+ * SUITE
+ ******************************************************************************/
+
+/* Every test starts from an erased partition */
+static void recorder_before(void * fixture)
+{
+    const struct flash_area * p_area;
+
+    zassert_ok(flash_area_open(FIXED_PARTITION_ID(recording_partition), &p_area));
+    zassert_ok(flash_area_erase(p_area, 0, p_area->fa_size));
+    flash_area_close(p_area);
+    zassert_ok(REC_Init());
+}
+
+ZTEST_SUITE(recorder, NULL, NULL, recorder_before, NULL, NULL);
@@ -0,0 +1,386 @@
+/**
+ *******************************************************************************
+ * @file    main.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Transfers ring tests
+ *
+ * Three readers stand for centrals keeping up, lagging behind or not reading
+ * at all. Transfers carry their sequence number in their bytes, so that each
+ * reader can tell which ones it lost.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+/* Application includes */
+#include "nanocobs/cobs.h"
+#include "stats/stats.h"
+#include "bluetooth/ring.h"
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define TEST_RING_SIZE          256
+#define TEST_READERS            3
+#define TEST_ALL_READERS        BIT_MASK(TEST_READERS)
+#define TEST_LENGTH             40      /**< Transfers of 43 bytes with header, 5 fit in ring */
+#define TEST_MESSAGE            300     /**< Longer than a COBS block */
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+static uint8_t buffer[TEST_RING_SIZE];
+static ring_reader_t readers[TEST_READERS];
+static ring_t ring;
+static uint32_t dropped;
+
+/*******************************************************************************
+ * FAKE STATISTICS
+ ******************************************************************************/
+
+void STATS_Add(stats_counter_t counter, uint32_t value)
+{
+    if (counter == STATS_LINK_DROPPED) {
+        dropped += value;
+    }
+}
+
+/*******************************************************************************
+ * HELPERS
+ ******************************************************************************/
+
+static void make_transfer(uint8_t sequence, uint8_t * p_data, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++) {
+        p_data[i] = sequence + i;
+    }
+}
+
+/* Queue a transfer, as ring_send() does */
+static int send(uint8_t mask, uint8_t sequence, uint16_t length)
+{
+    uint8_t data[TEST_RING_SIZE];
+
+    make_transfer(sequence, data, length);
+    int err = RING_Reserve(&ring, length);
+    if (err == 0)
+    {
+        RING_Write(&ring, mask, data, length);
+        RING_Publish(&ring, length);
+    }
+    return err;
+}
+
+/* Read next whole transfer of a reader, in contiguous pieces of at most max bytes */
+static int receive(uint8_t reader, uint32_t max, uint8_t * p_data)
+{
+    ring_reader_t * p_reader = &readers[reader];
+    uint32_t length = 0;
+
+    if (!RING_NextRecord(&ring, p_reader)) {
+        return -ENODATA;
+    }
+    while (p_reader->tail != p_reader->record_end)
+    {
+        const uint8_t * p_piece;
+        uint32_t piece = RING_Hold(&ring, p_reader, max, &p_piece);
+        zassert_true(piece > 0 && piece <= max);
+        memcpy(&p_data[length], p_piece, piece);
+        RING_Release(p_reader);
+        length += piece;
+    }
+    return length;
+}
+
+/* Next transfer of a reader is the one of that sequence */
+static void check_receive(uint8_t reader, uint8_t sequence, uint16_t length)
+{
+    uint8_t data[TEST_RING_SIZE];
+    uint8_t expected[TEST_RING_SIZE];
+
+    make_transfer(sequence, expected, length);
+    zassert_equal(receive(reader, UINT32_MAX, data), length, "reader %u", reader);
+    zassert_mem_equal(data, expected, length, "reader %u sequence %u", reader, data[0]);
+}
+
+/*******************************************************************************
+ * TESTS
+ ******************************************************************************/
+
+ZTEST(ring, test_send)
+{
+    uint8_t data[TEST_RING_SIZE];
+
+    zassert_true(RING_IsEmpty(&ring, &readers[0]));
+    for (uint8_t sequence = 0; sequence < 3; sequence++) {
+        zassert_ok(send(TEST_ALL_READERS, sequence, 10 + sequence));
+    }
+    zassert_false(RING_IsEmpty(&ring, &readers[0]));
+
+    for (uint8_t sequence = 0; sequence < 3; sequence++) {
+        check_receive(0, sequence, 10 + sequence);
+    }
+    zassert_true(RING_IsEmpty(&ring, &readers[0]));
+    zassert_equal(receive(0, UINT32_MAX, data), -ENODATA);
+}
+
+/* Transfers for other readers are skipped */
+ZTEST(ring, test_readers)
+{
+    uint8_t data[TEST_RING_SIZE];
+
+    zassert_ok(send(BIT(1), 0, 10));
+    zassert_ok(send(BIT(0), 1, 10));
+    zassert_ok(send(BIT(0) | BIT(2), 2, 10));
+    zassert_ok(send(BIT(1), 3, 10));
+
+    check_receive(0, 1, 10);
+    check_receive(0, 2, 10);
+    zassert_equal(receive(0, UINT32_MAX, data), -ENODATA);
+    check_receive(1, 0, 10);
+    check_receive(1, 3, 10);
+    zassert_equal(receive(1, UINT32_MAX, data), -ENODATA);
+    check_receive(2, 2, 10);
+
+    /* Transfers for others are passed over when next one is looked for */
+    zassert_false(RING_IsEmpty(&ring, &readers[2]));
+    zassert_equal(receive(2, UINT32_MAX, data), -ENODATA);
+    zassert_true(RING_IsEmpty(&ring, &readers[2]));
+}
+
+/* A transfer across the end of the ring is read in two pieces */
+ZTEST(ring, test_wrap)
+{
+    uint8_t data[TEST_RING_SIZE];
+    uint8_t expected[TEST_RING_SIZE];
+
+    for (uint8_t sequence = 0; sequence < 12; sequence++)
+    {
+        zassert_ok(send(TEST_ALL_READERS, sequence, TEST_LENGTH));
+        for (uint8_t reader = 0; reader < TEST_READERS; reader++) {
+            check_receive(reader, sequence, TEST_LENGTH);
+        }
+    }
+    zassert_true(ring.head > TEST_RING_SIZE);
+    zassert_equal(dropped, 0);
+
+    /* Pieces are also bounded by the size asked for */
+    zassert_ok(send(TEST_ALL_READERS, 12, TEST_LENGTH));
+    make_transfer(12, expected, TEST_LENGTH);
+    zassert_equal(receive(0, 7, data), TEST_LENGTH);
+    zassert_mem_equal(data, expected, TEST_LENGTH);
+}
+
+/* Ring holds what the slowest active reader did not read yet */
+ZTEST(ring, test_used)
+{
+    zassert_equal(RING_Used(&ring), 0);
+    zassert_ok(send(TEST_ALL_READERS, 0, 10));
+    zassert_ok(send(TEST_ALL_READERS, 1, 20));
+    zassert_equal(RING_Used(&ring), 30 + 2 * RING_RECORD_HEADER);
+
+    check_receive(0, 0, 10);
+    check_receive(0, 1, 20);
+    check_receive(1, 0, 10);
+    check_receive(1, 1, 20);
+    zassert_equal(RING_Used(&ring), 30 + 2 * RING_RECORD_HEADER);
+    check_receive(2, 0, 10);
+    zassert_equal(RING_Used(&ring), 20 + RING_RECORD_HEADER);
+
+    /* Bytes held for a copy are still used */
+    const uint8_t * p_piece;
+    zassert_true(RING_NextRecord(&ring, &readers[2]));
+    zassert_equal(RING_Hold(&ring, &readers[2], 5, &p_piece), 5);
+    zassert_equal(RING_Used(&ring), 20);
+    RING_Release(&readers[2]);
+    zassert_equal(RING_Used(&ring), 15);
+
+    /* Reader gone, space is no longer kept for it */
+    RING_Detach(&readers[0]);
+    zassert_equal(RING_Used(&ring), 15);
+    RING_Detach(&readers[2]);
+    zassert_equal(RING_Used(&ring), 0);
+
+    /* Reader back, from next transfer on */
+    RING_Attach(&ring, &readers[0]);
+    zassert_true(RING_IsEmpty(&ring, &readers[0]));
+    zassert_ok(send(TEST_ALL_READERS, 2, 10));
+    check_receive(0, 2, 10);
+}
+
+/* Full ring drops oldest transfers of the slowest reader only */
+ZTEST(ring, test_reserve_slowest)
+{
+    uint8_t data[TEST_RING_SIZE];
+
+    /* Reader 0 keeps up, reader 1 is two transfers ahead of reader 2 */
+    for (uint8_t sequence = 0; sequence < 5; sequence++)
+    {
+        zassert_ok(send(TEST_ALL_READERS, sequence, TEST_LENGTH));
+        check_receive(0, sequence, TEST_LENGTH);
+    }
+    check_receive(1, 0, TEST_LENGTH);
+    check_receive(1, 1, TEST_LENGTH);
+    zassert_equal(dropped, 0);
+
+    /* No room left for a sixth one, reader 2 loses its oldest */
+    zassert_ok(send(TEST_ALL_READERS, 5, TEST_LENGTH));
+    zassert_equal(dropped, 1);
+    zassert_true(RING_Used(&ring) <= TEST_RING_SIZE);
+    check_receive(0, 5, TEST_LENGTH);
+
+    /* Then both lag as much, each loses what the ring no longer holds */
+    zassert_ok(send(TEST_ALL_READERS, 6, TEST_LENGTH));
+    zassert_ok(send(TEST_ALL_READERS, 7, TEST_LENGTH));
+    check_receive(0, 6, TEST_LENGTH);
+    check_receive(0, 7, TEST_LENGTH);
+    zassert_true(RING_Used(&ring) <= TEST_RING_SIZE);
+
+    for (uint8_t sequence = 3; sequence < 8; sequence++) {
+        check_receive(1, sequence, TEST_LENGTH);
+        check_receive(2, sequence, TEST_LENGTH);
+    }
+    zassert_equal(receive(1, UINT32_MAX, data), -ENODATA);
+    zassert_equal(receive(2, UINT32_MAX, data), -ENODATA);
+    zassert_equal(dropped, 4);
+}
+
+/* Transfer a slow reader was in the middle of is cut short, the rest is sent */
+ZTEST(ring, test_reserve_cut)
+{
+    const uint8_t * p_piece;
+
+    for (uint8_t sequence = 0; sequence < 5; sequence++)
+    {
+        zassert_ok(send(TEST_ALL_READERS, sequence, TEST_LENGTH));
+        check_receive(0, sequence, TEST_LENGTH);
+        check_receive(2, sequence, TEST_LENGTH);
+    }
+
+    /* Reader 1 sent the first bytes of its oldest transfer */
+    zassert_true(RING_NextRecord(&ring, &readers[1]));
+    zassert_equal(RING_Hold(&ring, &readers[1], 10, &p_piece), 10);
+    RING_Release(&readers[1]);
+
+    zassert_ok(send(TEST_ALL_READERS, 5, TEST_LENGTH));
+    zassert_false(readers[1].resync);
+    zassert_equal(dropped, 0);
+
+    /* Its rest is dropped, with the next transfer to make room */
+    zassert_ok(send(TEST_ALL_READERS, 6, TEST_LENGTH));
+    zassert_true(readers[1].resync);
+    zassert_equal(readers[1].tail, readers[1].record_end);
+    zassert_equal(dropped, 2);
+
+    /* Next transfers are whole */
+    for (uint8_t sequence = 2; sequence < 7; sequence++) {
+        check_receive(1, sequence, TEST_LENGTH);
+    }
+    RING_Skip(&ring, &readers[1]);
+    zassert_false(readers[1].resync);
+}
+
+/* Bytes being copied are not overwritten */
+ZTEST(ring, test_reserve_busy)
+{
+    const uint8_t * p_piece;
+
+    RING_Detach(&readers[1]);
+    RING_Detach(&readers[2]);
+    for (uint8_t sequence = 0; sequence < 5; sequence++) {
+        zassert_ok(send(BIT(0), sequence, TEST_LENGTH));
+    }
+    zassert_true(RING_NextRecord(&ring, &readers[0]));
+    RING_Hold(&ring, &readers[0], TEST_LENGTH, &p_piece);
+
+    /* Only the header of the transfer held could be freed */
+    zassert_equal(send(BIT(0), 5, TEST_LENGTH + RING_RECORD_HEADER), -EBUSY);
+    zassert_equal(dropped, 0);
+
+    RING_Release(&readers[0]);
+    zassert_ok(send(BIT(0), 5, TEST_LENGTH + RING_RECORD_HEADER));
+    check_receive(0, 1, TEST_LENGTH);
+
+    zassert_equal(RING_Reserve(&ring, TEST_RING_SIZE - RING_RECORD_HEADER + 1), -EMSGSIZE);
+    zassert_ok(RING_Reserve(&ring, TEST_RING_SIZE - RING_RECORD_HEADER));
+}
+
+/* COBS frames are decoded from the ring in pieces, as for the ECG service */
+ZTEST(ring, test_decode)
+{
+    static uint8_t frames_buffer[4 * TEST_MESSAGE];
+    uint8_t message[TEST_MESSAGE];
+    uint8_t frame[COBS_ENCODE_MAX(TEST_MESSAGE)];
+    uint8_t decoded[TEST_MESSAGE];
+    unsigned frame_length;
+
+    /* A few zeros, then a run longer than a COBS block */
+    for (uint32_t i = 0; i < TEST_MESSAGE; i++) {
+        message[i] = (i < 40 && i % 7 == 0) ? 0 : (uint8_t)(i | 1);
+    }
+    zassert_equal(cobs_encode(message, sizeof(message), frame, sizeof(frame), &frame_length), COBS_RET_SUCCESS);
+    zassert_equal(frame[frame_length - 1], COBS_FRAME_DELIMITER);
+
+    RING_Init(&ring, frames_buffer, sizeof(frames_buffer), readers, 1);
+    RING_Attach(&ring, &readers[0]);
+    for (int i = 0; i < 3; i++)
+    {
+        zassert_ok(RING_Reserve(&ring, frame_length));
+        RING_Write(&ring, BIT(0), frame, frame_length);
+        RING_Publish(&ring, frame_length);
+    }
+
+    ring_reader_t * p_reader = &readers[0];
+    for (int i = 0; i < 3; i++)
+    {
+        zassert_true(RING_NextRecord(&ring, p_reader));
+        uint32_t frame_end = p_reader->tail + RING_GetFrame(&ring, p_reader);
+        zassert_equal(frame_end - p_reader->tail, frame_length);
+        zassert_equal(RING_GetDecodedSize(&ring, p_reader, frame_length), TEST_MESSAGE);
+
+        RING_BeginDecode(p_reader);
+        for (uint32_t length = 0, piece = 7; length < TEST_MESSAGE; length += piece) {
+            piece = MIN(piece, TEST_MESSAGE - length);
+            RING_Decode(&ring, p_reader, &decoded[length], piece);
+        }
+        zassert_mem_equal(decoded, message, TEST_MESSAGE, "frame %d", i);
+        p_reader->tail = frame_end;
+    }
+
+    /* Frame without its delimiter, as left by a transfer cut short */
+    zassert_ok(RING_Reserve(&ring, frame_length - 1));
+    RING_Write(&ring, BIT(0), frame, frame_length - 1);
+    RING_Publish(&ring, frame_length - 1);
+    zassert_true(RING_NextRecord(&ring, p_reader));
+    zassert_equal(RING_GetFrame(&ring, p_reader), frame_length - 1);
+    zassert_equal(RING_GetDecodedSize(&ring, p_reader, frame_length - 1), 0);
+}
+
+/*******************************************************************************
+ * SUITE
+ ******************************************************************************/
+
+static void ring_before(void * fixture)
+{
+    RING_Init(&ring, buffer, sizeof(buffer), readers, TEST_READERS);
+    for (uint8_t reader = 0; reader < TEST_READERS; reader++) {
+        RING_Attach(&ring, &readers[reader]);
+    }
+    dropped = 0;
+}
+
+ZTEST_SUITE(ring, NULL, NULL, ring_before, NULL, NULL);
@@ -0,0 +1,296 @@
+/**
+ *******************************************************************************
+ * @file    main.c
+ * @author  Bertrand Massot (bertrand.massot@insa-lyon.fr)
+ * @date    2026-10-18
+ * @brief   Time synchronization tests
+ *
+ * A host clock with a known offset and skew exchanges requests with the
+ * device over links of random latency. The calendar is faked to check the
+ * model it is given.
+ *******************************************************************************
+ */
+
+/*******************************************************************************
+ * INCLUDES
+ ******************************************************************************/
+
+/* C Standard Library includes */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+/* Zephyr Projet includes */
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+/* Application includes */
+#include "calendar/calendar.h"
+#include "timesync/timesync.h"
+
+/*******************************************************************************
+ * PRIVATE MACROS AND DEFINES
+ ******************************************************************************/
+
+#define TEST_HOST_OFFSET_US     1760000000000000LL
+#define TEST_PERIOD_US          (60 * USEC_PER_SEC)     /**< As in timesync.c */
+#define TEST_EXCHANGES          5                       /**< Per period */
+#define TEST_PROCESSING_TICKS   33                      /**< ~1 ms between receive and transmit */
+#define TEST_MIN_LATENCY_US     7500                    /**< One connection interval */
+#define TEST_JITTER_US          7500                    /**< Up to one more interval each way */
+
+/*******************************************************************************
+ * PRIVATE TYPEDEFS
+ ******************************************************************************/
+
+/* Host side of the exchanges */
+typedef struct
+{
+    int32_t   skew_ppb;         /**< Host clock rate minus device RTC rate */
+    uint32_t  sequence;
+    bool      has_prev;
+    uint32_t  prev_sequence;
+    Timestamp prev_arrival;
+} test_host_t;
+
+/*******************************************************************************
+ * STATIC VARIABLES
+ ******************************************************************************/
+
+/* Fake calendar */
+static uint64_t now_ticks;
+static struct
+{
+    uint32_t calls;
+    uint32_t clears;
+    uint64_t ref_ticks;
+    int64_t  ref_us;
+    int32_t  skew_ppb;
+} sync;
+
+static uint32_t seed;
+
+/*******************************************************************************
+ * FAKE CALENDAR
+ ******************************************************************************/
+
+uint64_t CAL_GetTicks64(void)
+{
+    return now_ticks;
+}
+
+void CAL_TicksToTime(uint64_t ticks, uint64_t * p_timestamp, uint32_t * p_us)
+{
+    uint64_t us = (ticks * USEC_PER_SEC) / CAL_TICKS_PER_SEC;
+    *p_timestamp = us / USEC_PER_SEC;
+    *p_us = us % USEC_PER_SEC;
+}
+
+void CAL_SetSync(uint64_t ref_ticks, int64_t ref_us, int32_t skew_ppb)
+{
+    sync.calls++;
+    sync.ref_ticks = ref_ticks;
+    sync.ref_us = ref_us;
+    sync.skew_ppb = skew_ppb;
+}
+
+void CAL_ClearSync(void)
+{
+    sync.clears++;
+}
+
+/*******************************************************************************
+ * HELPERS
+ ******************************************************************************/
+
+static uint32_t random_us(uint32_t range)
+{
+    if (range == 0) {
+        return 0;
+    }
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % range;
+}
+
+static int64_t ticks_to_us(uint64_t ticks)
+{
+    return (ticks * USEC_PER_SEC) / CAL_TICKS_PER_SEC;
+}
+
+static uint64_t us_to_ticks(int64_t us)
+{
+    return (us * CAL_TICKS_PER_SEC) / USEC_PER_SEC;
+}
+
+/* Host time at a device RTC time */
+static int64_t host_us(const test_host_t * p_host, int64_t device_us)
+{
+    return TEST_HOST_OFFSET_US + device_us + (device_us * p_host->skew_ppb) / 1000000000;
+}
+
+static Timestamp to_timestamp(int64_t us)
+{
+    return (Timestamp) { .time = us / USEC_PER_SEC, .us = us % USEC_PER_SEC };
+}
+
+/* One request sent at a device time, with given latency each way */
+static void exchange(test_host_t * p_host, uint8_t link, int64_t device_us,
+                     uint32_t up_us, uint32_t down_us, TimeSync * p_reply)
+{
+    TimeSyncRequest request = {
+        .sequence = ++p_host->sequence,
+        .has_origin = true,
+        .origin = to_timestamp(host_us(p_host, device_us)),
+        .prev_sequence = p_host->prev_sequence,
+        .has_prev_arrival = p_host->has_prev,
+        .prev_arrival = p_host->prev_arrival,
+    };
+    uint64_t rx_ticks = us_to_ticks(device_us + up_us);
+
+    now_ticks = rx_ticks + TEST_PROCESSING_TICKS;
+    TSYNC_HandleRequest(link, &request, rx_ticks, p_reply);
+    zassert_equal(p_reply->sequence, request.sequence);
+
+    p_host->has_prev = true;
+    p_host->prev_sequence = request.sequence;
+    p_host->prev_arrival = to_timestamp(host_us(p_host, ticks_to_us(now_ticks) + down_us));
+}
+
+/* Exchanges every few seconds over a number of periods, from a device time */
+static int64_t run(test_host_t * p_host, uint8_t link, int64_t device_us, uint32_t periods,
+                   uint32_t jitter_us, TimeSync * p_reply)
+{
+    for (uint32_t i = 0; i < periods * TEST_EXCHANGES; i++)
+    {
+        exchange(p_host, link, device_us, TEST_MIN_LATENCY_US + random_us(jitter_us),
+                 TEST_MIN_LATENCY_US + random_us(jitter_us), p_reply);
+        device_us += TEST_PERIOD_US / TEST_EXCHANGES;
+    }
+    return device_us;
+}
+
+/* Error of the calendar model against host time, at a device time */
+static int64_t model_error_us(const test_host_t * p_host, int64_t device_us)
+{
+    int64_t elapsed_us = device_us - ticks_to_us(sync.ref_ticks);
+    int64_t model_us = sync.ref_us + elapsed_us + (elapsed_us * sync.skew_ppb) / 1000000000;
+    return model_us - host_us(p_host, device_us);
+}
+
+/*******************************************************************************
+ * TESTS
+ ******************************************************************************/
+
+ZTEST(timesync, test_skew)
+{
+    static const int32_t skews_ppb[] = { 0, 25000, -40000, 3000 };
+    TimeSync reply;
+
+    for (size_t i = 0; i < ARRAY_SIZE(skews_ppb); i++)
+    {
+        test_host_t host = { .skew_ppb = skews_ppb[i] };
+
+        TSYNC_Reset(0);
+        int64_t device_us = run(&host, 0, 1000 * USEC_PER_SEC, 16, TEST_JITTER_US, &reply);
+
+        /* Offsets are known within a millisecond, a quarter hour of them gives the skew within 3 ppm */
+        zassert_within(sync.skew_ppb, host.skew_ppb, 3000, "skew %d", host.skew_ppb);
+        zassert_equal(reply.skew_ppb, sync.skew_ppb);
+        zassert_within(model_error_us(&host, device_us), 0, 5000);
+        /* And the calendar stays within a few milliseconds a quarter hour later */
+        zassert_within(model_error_us(&host, device_us + 15 * 60 * USEC_PER_SEC), 0, 5000);
+    }
+}
+
+/* Of the exchanges of a period, the fastest one is kept */
+ZTEST(timesync, test_fastest)
+{
+    test_host_t host = { 0 };
+    TimeSync reply;
+
+    /* Slow replies bias offset by half their asymmetry (100 ms) */
+    exchange(&host, 0, 0, 5000, 205000, &reply);
+    exchange(&host, 0, 10 * USEC_PER_SEC, 5000, 5000, &reply);
+    exchange(&host, 0, 20 * USEC_PER_SEC, 5000, 205000, &reply);
+    exchange(&host, 0, 30 * USEC_PER_SEC, 5000, 5000, &reply);
+    zassert_within(reply.delay_us, 210000, 100);
+    zassert_within(model_error_us(&host, 30 * USEC_PER_SEC), 0, 100);
+}
+
+/* Replies out of order or arriving before they were sent are ignored */
+ZTEST(timesync, test_ignored)
+{
+    test_host_t host = { 0 };
+    TimeSync reply;
+
+    exchange(&host, 0, 0, 5000, 5000, &reply);
+    host.prev_sequence++;
+    exchange(&host, 0, USEC_PER_SEC, 5000, 5000, &reply);
+    zassert_equal(sync.calls, 0);
+
+    host.prev_arrival = to_timestamp(TEST_HOST_OFFSET_US);
+    exchange(&host, 0, 2 * USEC_PER_SEC, 5000, 5000, &reply);
+    zassert_equal(sync.calls, 0);
+
+    exchange(&host, 0, 3 * USEC_PER_SEC, 5000, 5000, &reply);
+    zassert_equal(sync.calls, 1);
+}
+
+/* Skew beyond crystal tolerance is a host clock step, not followed */
+ZTEST(timesync, test_clamp)
+{
+    test_host_t host = { .skew_ppb = 1000000 };
+    TimeSync reply;
+
+    run(&host, 0, 0, 4, 0, &reply);
+    zassert_within(sync.skew_ppb, 200000, 1);
+}
+
+/* Calendar follows the first central to complete an exchange, until it leaves */
+ZTEST(timesync, test_links)
+{
+    test_host_t first = { .skew_ppb = 10000 };
+    test_host_t second = { .skew_ppb = -10000 };
+    TimeSync reply;
+
+    int64_t device_us = run(&first, 0, 0, 2, 0, &reply);
+    zassert_within(sync.skew_ppb, first.skew_ppb, 1000);
+    zassert_within(model_error_us(&first, device_us), 0, 1000);
+    uint32_t calls = sync.calls;
+
+    /* Second central keeps its own model meanwhile */
+    device_us = run(&second, 1, device_us, 2, 0, &reply);
+    zassert_equal(sync.calls, calls);
+    zassert_within(reply.skew_ppb, second.skew_ppb, 1000);
+
+    /* A new central on the second link does not reset the calendar */
+    TSYNC_Reset(1);
+    zassert_equal(sync.clears, 0);
+
+    /* Calendar keeps the last model once first central left, then follows the other one */
+    TSYNC_Release(0);
+    zassert_equal(sync.clears, 0);
+    second = (test_host_t) { .skew_ppb = -10000 };
+    device_us = run(&second, 1, device_us, 2, 0, &reply);
+    zassert_true(sync.calls > calls);
+    zassert_within(sync.skew_ppb, second.skew_ppb, 1000);
+    zassert_within(model_error_us(&second, device_us), 0, 1000);
+
+    /* Reconnection of the central driving the calendar starts again from host time */
+    TSYNC_Reset(1);
+    zassert_equal(sync.clears, 1);
+}
+
+/*******************************************************************************
+ * SUITE
+ ******************************************************************************/
+
+static void timesync_before(void * fixture)
+{
+    TSYNC_Reset(0);
+    TSYNC_Reset(1);
+    memset(&sync, 0, sizeof(sync));
+    seed = 1;
+}
+
+ZTEST_SUITE(timesync, NULL, NULL, timesync_before, NULL, NULL);
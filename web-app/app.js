@@ -125,8 +125,9 @@ function bleSetupRxListener(rxchar) {
             const char = e.target;
             let rx_data = new Uint8Array(char.value.buffer);
             rx_buf = new Uint8Array([...rx_buf,...rx_data]);
-            let zeroIndex = rx_buf.indexOf(0);
-            if(zeroIndex != -1) {
+            let zeroIndex;
+            /* A notification may carry several frames */
+            while((zeroIndex = rx_buf.indexOf(0)) != -1) {
                 const cobs_data = rx_buf.slice(0, zeroIndex + 1);
                 decodeMessage(cobs_data);
                 rx_buf = rx_buf.slice(zeroIndex + 1);
@@ -155,7 +156,10 @@ function bleSetupBatListener(batchar) {
  ******************************************************************************/
 
 /* Global variables */
-const samplingFrequency = 512; // Hertz
+const samplingFrequency = 512; // Hertz, rate of frames without rate field
+const packetFirstField = 16; // Packet payloads never overlap EcgBuffer fields
+/* Last anchor frame (with timestamp) of each rate, compact frames are timed from it */
+let ecgAnchors = {};
 
 /**
  * @param {Uint8Array} message
@@ -163,19 +167,56 @@ const samplingFrequency = 512; // Hertz
 function decodeMessage(message) {
     try {
         const decoded = decode(message).subarray(0,-1);
+        /* Other device messages are wrapped in a Packet, not handled here */
+        if (!isEcgBuffer(decoded)) {
+            return;
+        }
         const ecgBuffer = proto.EcgBuffer.deserializeBinary(decoded);
         const data = ecgBuffer.getData_asU8();
         const dataBuffer = data.buffer.slice(data.byteOffset, data.byteOffset + data.byteLength);
         const int16Data = new Int16Array(dataBuffer);
-        const timestamp = ecgBuffer.getTimestamp();
-        const time = (timestamp.getTime() + (timestamp.getUs() * 10**-6)) - timeDataStart;
-        const timeArray = makeArr(time, 1.0 / samplingFrequency, int16Data.length);
+        const rate = ecgBuffer.getRate() || samplingFrequency;
+        const period = ecgBuffer.getPeriodNs() ? ecgBuffer.getPeriodNs() * 10**-9 : 1.0 / rate;
+        let time;
+        if (ecgBuffer.hasTimestamp()) {
+            const timestamp = ecgBuffer.getTimestamp();
+            time = timestamp.getTime() + (timestamp.getUs() * 10**-6);
+            ecgAnchors[rate] = { time: time, index: ecgBuffer.getIndex() };
+        }
+        else {
+            /* Compact mode: time from last anchor of the same rate */
+            const anchor = ecgAnchors[rate];
+            if (anchor === undefined) {
+                return;
+            }
+            time = anchor.time + (ecgBuffer.getIndex() - anchor.index) * period;
+        }
+        const timeArray = makeArr(time - timeDataStart, period, int16Data.length);
         ecgChartAddData(int16Data, timeArray);
     } catch (error) {
         console.error("Error while decoding message: " + error);
     }
 }
 
+/**
+ * Tell an EcgBuffer frame from a Packet, which only has a payload field
+ * @param {Uint8Array} message
+ * @returns {boolean}
+ */
+function isEcgBuffer(message) {
+    const reader = new jspb.BinaryReader(message);
+    while (reader.nextField()) {
+        if (reader.isEndGroup()) {
+            break;
+        }
+        if (reader.getFieldNumber() >= packetFirstField) {
+            return false;
+        }
+        reader.skipField();
+    }
+    return true;
+}
+
 /* Helper to create lineary spaced data array */
 /**
  * 
@@ -285,7 +326,9 @@ async function onStartMeasureButtonClick() {
     timeDataStart = millis * 0.001;
     // Placeholder to save data in file later
     window.data = [];
-    // Enable notifications
+    // Compact frames wait for the first anchor of the new acquisition
+    ecgAnchors = {};
+    // Enable notifications, the sensor starts acquisition on subscription
     window.rxChar.startNotifications();
     // Reset graphes
     onClearGraphClick();
@@ -293,7 +336,7 @@ async function onStartMeasureButtonClick() {
 
 async function onStopMeasureButtonClick() {
     if (bleConnected == false) return;
-    // Disable notifications
+    // Disable notifications, the sensor stops acquisition when none is left
     window.rxChar.stopNotifications();
     // Save data
     saveWindowData();
@@ -299,7 +299,11 @@ proto.EcgBuffer.toObject = function(includeInstance, msg) {
   var f, obj = {
     data: msg.getData_asB64(),
     lodpn: jspb.Message.getFieldWithDefault(msg, 2, 0),
-    timestamp: (f = msg.getTimestamp()) && proto.Timestamp.toObject(includeInstance, f)
+    timestamp: (f = msg.getTimestamp()) && proto.Timestamp.toObject(includeInstance, f),
+    rate: jspb.Message.getFieldWithDefault(msg, 4, 0),
+    index: jspb.Message.getFieldWithDefault(msg, 6, 0),
+    sequence: jspb.Message.getFieldWithDefault(msg, 7, 0),
+    periodNs: jspb.Message.getFieldWithDefault(msg, 8, 0)
   };
 
   if (includeInstance) {
@@ -349,6 +353,22 @@ proto.EcgBuffer.deserializeBinaryFromReader = function(msg, reader) {
       reader.readMessage(value,proto.Timestamp.deserializeBinaryFromReader);
       msg.setTimestamp(value);
       break;
+    case 4:
+      var value = /** @type {number} */ (reader.readUint32());
+      msg.setRate(value);
+      break;
+    case 6:
+      var value = /** @type {number} */ (reader.readUint32());
+      msg.setIndex(value);
+      break;
+    case 7:
+      var value = /** @type {number} */ (reader.readUint32());
+      msg.setSequence(value);
+      break;
+    case 8:
+      var value = /** @type {number} */ (reader.readUint32());
+      msg.setPeriodNs(value);
+      break;
     default:
       reader.skipField();
       break;
@@ -400,6 +420,34 @@ proto.EcgBuffer.serializeBinaryToWriter = function(message, writer) {
       proto.Timestamp.serializeBinaryToWriter
     );
   }
+  f = message.getRate();
+  if (f !== 0) {
+    writer.writeUint32(
+      4,
+      f
+    );
+  }
+  f = message.getIndex();
+  if (f !== 0) {
+    writer.writeUint32(
+      6,
+      f
+    );
+  }
+  f = message.getSequence();
+  if (f !== 0) {
+    writer.writeUint32(
+      7,
+      f
+    );
+  }
+  f = message.getPeriodNs();
+  if (f !== 0) {
+    writer.writeUint32(
+      8,
+      f
+    );
+  }
 };
 
 
@@ -500,6 +548,78 @@ proto.EcgBuffer.prototype.hasTimestamp = function() {
 };
 
 
+/**
+ * optional uint32 rate = 4;
+ * @return {number}
+ */
+proto.EcgBuffer.prototype.getRate = function() {
+  return /** @type {number} */ (jspb.Message.getFieldWithDefault(this, 4, 0));
+};
+
+
+/**
+ * @param {number} value
+ * @return {!proto.EcgBuffer} returns this
+ */
+proto.EcgBuffer.prototype.setRate = function(value) {
+  return jspb.Message.setProto3IntField(this, 4, value);
+};
+
+
+/**
+ * optional uint32 index = 6;
+ * @return {number}
+ */
+proto.EcgBuffer.prototype.getIndex = function() {
+  return /** @type {number} */ (jspb.Message.getFieldWithDefault(this, 6, 0));
+};
+
+
+/**
+ * @param {number} value
+ * @return {!proto.EcgBuffer} returns this
+ */
+proto.EcgBuffer.prototype.setIndex = function(value) {
+  return jspb.Message.setProto3IntField(this, 6, value);
+};
+
+
+/**
+ * optional uint32 sequence = 7;
+ * @return {number}
+ */
+proto.EcgBuffer.prototype.getSequence = function() {
+  return /** @type {number} */ (jspb.Message.getFieldWithDefault(this, 7, 0));
+};
+
+
+/**
+ * @param {number} value
+ * @return {!proto.EcgBuffer} returns this
+ */
+proto.EcgBuffer.prototype.setSequence = function(value) {
+  return jspb.Message.setProto3IntField(this, 7, value);
+};
+
+
+/**
+ * optional uint32 period_ns = 8;
+ * @return {number}
+ */
+proto.EcgBuffer.prototype.getPeriodNs = function() {
+  return /** @type {number} */ (jspb.Message.getFieldWithDefault(this, 8, 0));
+};
+
+
+/**
+ * @param {number} value
+ * @return {!proto.EcgBuffer} returns this
+ */
+proto.EcgBuffer.prototype.setPeriodNs = function(value) {
+  return jspb.Message.setProto3IntField(this, 8, value);
+};
+
+
 
 
 